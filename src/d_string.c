@@ -131,7 +131,7 @@ DString * d_string_new(const char * startingString) {
 	}
 
 	newString->currentStringBufferSize = startingBufferSize;
-	strncpy(newString->str, startingString, startingStringSize);
+	memcpy(newString->str, startingString, startingStringSize);
 	newString->str[startingStringSize] = '\0';
 	newString->currentStringLength = startingStringSize;
 
@@ -161,20 +161,26 @@ char * d_string_free(DString * ripString, bool freeCharacterData) {
 }
 
 
+/// Grow buffer capacity from `bufferSize` until it can hold `bufferSizeNeeded` bytes
+static size_t grownBufferSize(size_t bufferSize, size_t bufferSizeNeeded) {
+	while (bufferSizeNeeded > bufferSize) {
+		if (bufferSize > kStringBufferMaxIncrement) {
+			bufferSize += kStringBufferMaxIncrement;
+		} else {
+			bufferSize *= kStringBufferGrowthMultiplier;
+		}
+	}
+
+	return bufferSize;
+}
+
+
 /// Ensure that dynamic string has specified capacity
 static void ensureStringBufferCanHold(DString * baseString, size_t newStringSize) {
 	size_t newBufferSizeNeeded = newStringSize + 1;
 
 	if (newBufferSizeNeeded > baseString->currentStringBufferSize) {
-		size_t newBufferSize = baseString->currentStringBufferSize;
-
-		while (newBufferSizeNeeded > newBufferSize) {
-			if (newBufferSize > kStringBufferMaxIncrement) {
-				newBufferSize += kStringBufferMaxIncrement;
-			} else {
-				newBufferSize *= kStringBufferGrowthMultiplier;
-			}
-		}
+		size_t newBufferSize = grownBufferSize(baseString->currentStringBufferSize, newBufferSizeNeeded);
 
 		char * temp;
 		temp = realloc(baseString->str, newBufferSize);
@@ -192,17 +198,31 @@ static void ensureStringBufferCanHold(DString * baseString, size_t newStringSize
 }
 
 
-/// Append null-terminated string to end of dynamic string
-void d_string_append(DString * baseString, const char * appendedString) {
-	size_t appendedStringLength = strlen(appendedString);
+/// Make room for at least `bytes` more bytes without reallocating.  Unlike
+/// appending, the buffer is sized exactly rather than rounded up.
+void d_string_reserve(DString * baseString, size_t bytes) {
+	size_t newBufferSizeNeeded = baseString->currentStringLength + bytes + 1;
 
-	if ((appendedString != NULL) && (appendedStringLength > 0)) {
-		size_t newStringLength = baseString->currentStringLength + appendedStringLength;
-		ensureStringBufferCanHold(baseString, newStringLength);
+	if (newBufferSizeNeeded > baseString->currentStringBufferSize) {
+		char * temp = realloc(baseString->str, newBufferSizeNeeded);
 
-		/* We already know where the current string ends, so pass that as the starting address for strncat */
-		strncat(baseString->str + baseString->currentStringLength, appendedString, appendedStringLength);
-		baseString->currentStringLength = newStringLength;
+		if (temp == NULL) {
+			/* realloc failed */
+			fprintf(stderr, "Error reallocating memory for d_string. Current buffer size %lu.\n", baseString->currentStringBufferSize);
+
+			exit(1);
+		}
+
+		baseString->str = temp;
+		baseString->currentStringBufferSize = newBufferSizeNeeded;
+	}
+}
+
+
+/// Append null-terminated string to end of dynamic string
+void d_string_append(DString * baseString, const char * appendedString) {
+	if (appendedString != NULL) {
+		d_string_append_c_array(baseString, appendedString, strlen(appendedString));
 	}
 }
 
@@ -230,18 +250,39 @@ void d_string_append_c_array(DString * baseString, const char * appendedChars, s
 }
 
 
+/// Append to end of dynamic string using format specifier and argument list.
+/// Formats directly into the spare capacity, and only formats a second time
+/// (after growing the buffer) if the result didn't fit.
+void d_string_append_vprintf(DString * baseString, const char * format, va_list args) {
+	size_t available = baseString->currentStringBufferSize - baseString->currentStringLength;
+	va_list retry;
+	int len;
+
+	va_copy(retry, args);
+	len = vsnprintf(baseString->str + baseString->currentStringLength, available, format, args);
+
+	if (len > 0) {
+		if ((size_t) len >= available) {
+			ensureStringBufferCanHold(baseString, baseString->currentStringLength + len);
+			vsnprintf(baseString->str + baseString->currentStringLength, len + 1, format, retry);
+		}
+
+		baseString->currentStringLength += len;
+	}
+
+	// An encoding error may leave partial output behind
+	baseString->str[baseString->currentStringLength] = '\0';
+
+	va_end(retry);
+}
+
+
 /// Append to end of dynamic string using format specifier
 void d_string_append_printf(DString * baseString, const char * format, ...) {
 	va_list args;
 	va_start(args, format);
 
-	char * formattedString = NULL;
-	vasprintf(&formattedString, format, args);
-
-	if (formattedString != NULL) {
-		d_string_append(baseString, formattedString);
-		free(formattedString);
-	}
+	d_string_append_vprintf(baseString, format, args);
 
 	va_end(args);
 }
@@ -249,14 +290,14 @@ void d_string_append_printf(DString * baseString, const char * format, ...) {
 
 /// Prepend null-terminated string to end of dynamic string
 void d_string_prepend(DString * baseString, const char * prependedString) {
-	size_t prependedStringLength = strlen(prependedString);
+	size_t prependedStringLength = prependedString ? strlen(prependedString) : 0;
 
-	if ((prependedString != NULL) && (prependedStringLength > 0)) {
+	if (prependedStringLength > 0) {
 		size_t newStringLength = baseString->currentStringLength + prependedStringLength;
 		ensureStringBufferCanHold(baseString, newStringLength);
 
 		memmove(baseString->str + prependedStringLength, baseString->str, baseString->currentStringLength);
-		strncpy(baseString->str, prependedString, prependedStringLength);
+		memcpy(baseString->str, prependedString, prependedStringLength);
 		baseString->currentStringLength = newStringLength;
 		baseString->str[baseString->currentStringLength] = '\0';
 	}
@@ -265,9 +306,9 @@ void d_string_prepend(DString * baseString, const char * prependedString) {
 
 /// Insert null-terminated string inside dynamic string
 void d_string_insert(DString * baseString, size_t pos, const char * insertedString) {
-	size_t insertedStringLength = strlen(insertedString);
+	size_t insertedStringLength = insertedString ? strlen(insertedString) : 0;
 
-	if ((insertedString != NULL) && (insertedStringLength > 0)) {
+	if (insertedStringLength > 0) {
 		if (pos > baseString->currentStringLength) {
 			pos = baseString->currentStringLength;
 		}
@@ -277,7 +318,7 @@ void d_string_insert(DString * baseString, size_t pos, const char * insertedStri
 
 		/* Shift following string to 'right' */
 		memmove(baseString->str + pos + insertedStringLength, baseString->str + pos, baseString->currentStringLength - pos);
-		strncpy(baseString->str + pos, insertedString, insertedStringLength);
+		memcpy(baseString->str + pos, insertedString, insertedStringLength);
 		baseString->currentStringLength = newStringLength;
 		baseString->str[baseString->currentStringLength] = '\0';
 	}
@@ -302,20 +343,37 @@ void d_string_insert_c(DString * baseString, size_t pos, char insertedCharacter)
 }
 
 
+/// Reverse the bytes in [start, end)
+static void reverseBytes(char * start, char * end) {
+	char c;
+
+	while (end - start > 1) {
+		c = *start;
+		*start++ = *--end;
+		*end = c;
+	}
+}
+
+
 /// Insert inside dynamic string using format specifier
 void d_string_insert_printf(DString * baseString, size_t pos, const char * format, ...) {
+	size_t oldLength = baseString->currentStringLength;
 	va_list args;
-	va_start(args, format);
-
-	char * formattedString = NULL;
-	vasprintf(&formattedString, format, args);
 
-	if (formattedString != NULL) {
-		d_string_insert(baseString, pos, formattedString);
-		free(formattedString);
+	if (pos > oldLength) {
+		pos = oldLength;
 	}
 
+	// Format at the end, then rotate into place
+	va_start(args, format);
+	d_string_append_vprintf(baseString, format, args);
 	va_end(args);
+
+	if ((pos < oldLength) && (baseString->currentStringLength > oldLength)) {
+		reverseBytes(baseString->str + pos, baseString->str + oldLength);
+		reverseBytes(baseString->str + oldLength, baseString->str + baseString->currentStringLength);
+		reverseBytes(baseString->str + pos, baseString->str + baseString->currentStringLength);
+	}
 }
 
 
@@ -355,7 +413,7 @@ char * d_string_copy_substring(DString * d, size_t start, size_t len) {
 	}
 
 	result = malloc(len + 1);
-	strncpy(result, &d->str[start], len);
+	memcpy(result, &d->str[start], len);
 	result[len] = '\0';
 
 	return result;
@@ -364,33 +422,176 @@ char * d_string_copy_substring(DString * d, size_t start, size_t len) {
 
 /// Replace occurences of "original" with "replace" inside the specified range
 /// Returns the change in overall length
+///
+/// Works in a single pass over the string -- in place if the replacement is
+/// no longer than the original, otherwise into a new buffer sized after
+/// counting the matches.
 long d_string_replace_text_in_range(DString * d, size_t pos, size_t len, const char * original, const char * replace) {
-	long delta = 0;		// Overall change in length
-
-	long len_o = strlen(original);
-	long len_r = strlen(replace);
-	long change = len_r - len_o;	// Change in length for each replacement
-
-	size_t stop;
+	size_t len_o = strlen(original);
+	size_t len_r = strlen(replace);
+	size_t count = 0;
+	size_t stop, newLength, newBufferSize, segment, i;
+	const char * read, * match, * limit;
+	char * write, * buffer;
+
+	if ((len_o == 0) || (pos > d->currentStringLength)) {
+		return 0;
+	}
 
-	if (len == -1) {
+	if ((len == (size_t) -1) || (len > d->currentStringLength - pos)) {
 		stop = d->currentStringLength;
 	} else {
 		stop = pos + len;
 	}
 
-	char * match = strstr(&(d->str[pos]), original);
+	limit = d->str + stop;
+
+	// Matches must start before `stop` (but may extend past it)
+	if (len_r <= len_o) {
+		// Result is never ahead of the text still to be read
+		read = write = d->str + pos;
+
+		while ((match = strstr(read, original)) && (match < limit)) {
+			segment = (size_t) (match - read);
+			memmove(write, read, segment);
+			memcpy(write + segment, replace, len_r);
+			write += segment + len_r;
+			read = match + len_o;
+			count++;
+		}
+
+		if (count) {
+			segment = (size_t) (d->str + d->currentStringLength - read);
+			memmove(write, read, segment + 1);
+			d->currentStringLength = write + segment - d->str;
+		}
+
+		return -(long) (count * (len_o - len_r));
+	}
+
+	for (read = d->str + pos; (match = strstr(read, original)) && (match < limit); read = match + len_o) {
+		count++;
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	newLength = d->currentStringLength + count * (len_r - len_o);
+	newBufferSize = grownBufferSize(d->currentStringBufferSize, newLength + 1);
+	buffer = malloc(newBufferSize);
+
+	if (buffer == NULL) {
+		fprintf(stderr, "Error allocating memory for d_string. Current buffer size %lu.\n", d->currentStringBufferSize);
 
-	while (match && (match - d->str < stop)) {
-		pos = match - d->str;
-		d_string_erase(d, match - d->str, len_o);
-		d_string_insert(d, match - d->str, replace);
+		exit(1);
+	}
 
-		delta += change;
-		stop += change;
-		match = strstr(d->str + pos + len_r, original);
+	memcpy(buffer, d->str, pos);
+	read = d->str + pos;
+	write = buffer + pos;
+
+	for (i = 0; i < count; i++) {
+		match = strstr(read, original);
+		segment = (size_t) (match - read);
+		memcpy(write, read, segment);
+		memcpy(write + segment, replace, len_r);
+		write += segment + len_r;
+		read = match + len_o;
 	}
 
-	return delta;
+	memcpy(write, read, (size_t) (d->str + d->currentStringLength - read) + 1);
+
+	free(d->str);
+	d->str = buffer;
+	d->currentStringBufferSize = newBufferSize;
+	d->currentStringLength = newLength;
+
+	return (long) (count * (len_r - len_o));
+}
+
+
+#ifdef TEST
+void Test_d_string_replace(CuTest * tc) {
+	DString * d = d_string_new("one\ntwo\nthree\n");
+
+	// Longer
+	CuAssertIntEquals(tc, 6, (int) d_string_replace_text_in_range(d, 0, -1, "\n", "\n  "));
+	CuAssertStrEquals(tc, "one\n  two\n  three\n  ", d->str);
+	CuAssertIntEquals(tc, 20, (int) d->currentStringLength);
+
+	// Shorter, and the same length
+	CuAssertIntEquals(tc, -6, (int) d_string_replace_text_in_range(d, 0, -1, "\n  ", "\n"));
+	CuAssertStrEquals(tc, "one\ntwo\nthree\n", d->str);
+	CuAssertIntEquals(tc, 0, (int) d_string_replace_text_in_range(d, 0, -1, "o", "0"));
+	CuAssertStrEquals(tc, "0ne\ntw0\nthree\n", d->str);
+	CuAssertIntEquals(tc, -3, (int) d_string_replace_text_in_range(d, 0, -1, "e", ""));
+	CuAssertStrEquals(tc, "0n\ntw0\nthr\n", d->str);
+	CuAssertIntEquals(tc, 11, (int) d->currentStringLength);
+
+	// Only matches that start within the range, without overlaps
+	d_string_erase(d, 0, -1);
+	d_string_append(d, "aaaaaa-aaa");
+	CuAssertIntEquals(tc, 2, (int) d_string_replace_text_in_range(d, 1, 3, "aa", "bbb"));
+	CuAssertStrEquals(tc, "abbbbbba-aaa", d->str);
+	CuAssertIntEquals(tc, -1, (int) d_string_replace_text_in_range(d, 8, 10, "aa", "c"));
+	CuAssertStrEquals(tc, "abbbbbba-ca", d->str);
+
+	// Nothing to do
+	CuAssertIntEquals(tc, 0, (int) d_string_replace_text_in_range(d, 0, -1, "x", "yy"));
+	CuAssertIntEquals(tc, 0, (int) d_string_replace_text_in_range(d, 0, -1, "", "yy"));
+	CuAssertIntEquals(tc, 0, (int) d_string_replace_text_in_range(d, 20, -1, "a", "yy"));
+	CuAssertStrEquals(tc, "abbbbbba-ca", d->str);
+
+	// Growing past the buffer
+	d_string_erase(d, 0, -1);
+
+	while (d->currentStringLength < 3000) {
+		d_string_append(d, "x\n");
+	}
+
+	CuAssertIntEquals(tc, 3 * 1500, (int) d_string_replace_text_in_range(d, 0, -1, "\n", "\r\n  "));
+	CuAssertIntEquals(tc, 7500, (int) d->currentStringLength);
+	CuAssertIntEquals(tc, 7500, (int) strlen(d->str));
+	CuAssertTrue(tc, d->currentStringBufferSize > 7500);
+	CuAssertTrue(tc, strncmp(d->str + 7490, "x\r\n  x\r\n  ", 10) == 0);
+
+	d_string_free(d, true);
+}
+
+
+void Test_d_string_printf(CuTest * tc) {
+	DString * d = d_string_new("hello world");
+
+	d_string_append_printf(d, " %d", 42);
+	CuAssertStrEquals(tc, "hello world 42", d->str);
+
+	d_string_insert_printf(d, 5, ",%s", "");
+	CuAssertStrEquals(tc, "hello, world 42", d->str);
+
+	// Past the end appends
+	d_string_insert_printf(d, 1000, "%c", '!');
+	CuAssertStrEquals(tc, "hello, world 42!", d->str);
+
+	// Too large for the spare capacity
+	d_string_insert_printf(d, 0, "%0*d|", 3000, 7);
+	CuAssertIntEquals(tc, 3017, (int) d->currentStringLength);
+	CuAssertIntEquals(tc, 3017, (int) strlen(d->str));
+	CuAssertTrue(tc, strncmp(d->str + 2998, "07|hello", 8) == 0);
+
+	d_string_erase(d, 0, -1);
+	d_string_append_printf(d, "%0*d", 5000, 0);
+	CuAssertIntEquals(tc, 5000, (int) d->currentStringLength);
+	CuAssertIntEquals(tc, 5000, (int) strlen(d->str));
+
+	d_string_erase(d, 0, -1);
+	d_string_append_printf(d, "%s", "");
+	d_string_append(d, "abc");
+	d_string_prepend(d, "<");
+	d_string_insert(d, 2, "-");
+	CuAssertStrEquals(tc, "<a-bc", d->str);
+
+	d_string_free(d, true);
 }
+#endif
 
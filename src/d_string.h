@@ -60,9 +60,14 @@
 #ifndef D_STRING_SMART_STRING_H
 #define D_STRING_SMART_STRING_H
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
 /* WE implement minimal mirror implementations of GLib's GString
  * sufficient to cover the functionality required by MultiMarkdown.
  *
@@ -94,6 +99,13 @@ char * d_string_free(
 );
 
 
+/// Make room for at least `bytes` more bytes without reallocating
+void d_string_reserve(
+	DString * baseString,                   //!< DString to be grown
+	size_t bytes                            //!< Number of bytes that will be appended
+);
+
+
 /// Append null-terminated string to end of dynamic string
 void d_string_append(
 	DString * baseString,                   //!< DString to be appended
@@ -116,6 +128,14 @@ void d_string_append_c_array(
 );
 
 
+/// Append to end of dynamic string using format specifier and argument list
+void d_string_append_vprintf(
+	DString * baseString,                   //!< DString to be appended
+	const char * format,                    //!< Format specifier for appending
+	va_list args                            //!< Arguments for format specifier
+);
+
+
 /// Append to end of dynamic string using format specifier
 void d_string_append_printf(
 	DString * baseString,                   //!< DString to be appended
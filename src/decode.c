@@ -0,0 +1,870 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file decode.c
+
+	@brief Build tapes from MessagePack and CBOR data.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decode.h"
+
+
+#define kMaxNesting		2048
+
+
+/// Progress through the data
+typedef struct {
+	const unsigned char *	cursor;
+	const unsigned char *	end;
+	json_tape *				tape;		//!< Tape being filled, or NULL while measuring
+	tape_keys *				keys;		//!< Member names in the tape
+	size_t					nodes;		//!< Nodes needed (counted while measuring)
+	size_t					bytes;		//!< String pool bytes needed (counted while measuring)
+	int						depth;
+} decoder;
+
+
+/// Decode one value (and its descendants), which has member name `key` (an
+/// offset in the string pool) if it is in an object
+typedef bool (*decode_value)(decoder * d, uint32_t key);
+
+
+/// Consume `len` bytes of input
+static bool read_bytes(decoder * d, uint64_t len, const unsigned char ** bytes) {
+	if ((uint64_t) (d->end - d->cursor) < len) {
+		return false;
+	}
+
+	*bytes = d->cursor;
+	d->cursor += len;
+
+	return true;
+}
+
+
+/// Consume a big-endian unsigned integer of `size` bytes
+static bool read_uint(decoder * d, size_t size, uint64_t * value) {
+	const unsigned char * bytes;
+	size_t i;
+
+	if (!read_bytes(d, size, &bytes)) {
+		return false;
+	}
+
+	*value = 0;
+
+	for (i = 0; i < size; i++) {
+		*value = (*value << 8) | bytes[i];
+	}
+
+	return true;
+}
+
+
+/// Start a node, returning its index (meaningless while measuring)
+static size_t begin_node(decoder * d, int type, uint32_t key) {
+	tape_node * node;
+
+	if (d->tape == NULL) {
+		d->nodes++;
+		return 0;
+	}
+
+	node = &d->tape->nodes[d->tape->count];
+	memset(node, 0, sizeof(tape_node));
+
+	node->tag = TAPE_TAG(type, 0);
+	node->key = key;
+
+	return d->tape->count++;
+}
+
+
+/// Finish a node once its descendants have been added
+static void end_node(decoder * d, size_t index, size_t count) {
+	tape_node * node;
+
+	if (d->tape) {
+		node = &d->tape->nodes[index];
+
+		if ((TAPE_TYPE(node) == JSONArray) || (TAPE_TYPE(node) == JSONObject)) {
+			node->value.count = (uint32_t) count;
+		}
+
+		node->tag = TAPE_TAG(TAPE_TYPE(node), d->tape->count);
+	}
+}
+
+
+/// Add a number, or null if it isn't finite
+static void add_number(decoder * d, uint32_t key, double number) {
+	size_t index = begin_node(d, isfinite(number) ? JSONNumber : JSONNull, key);
+
+	if (d->tape && isfinite(number)) {
+		d->tape->nodes[index].value.number = number;
+	}
+
+	end_node(d, index, 0);
+}
+
+
+/// Add null (`JSONNull`) or a boolean (`JSONBoolean`)
+static void add_literal(decoder * d, uint32_t key, int type, int boolean) {
+	size_t index = begin_node(d, type, key);
+
+	if (d->tape) {
+		d->tape->nodes[index].value.boolean = boolean;
+	}
+
+	end_node(d, index, 0);
+}
+
+
+/// Add a string already in the pool
+static void add_string(decoder * d, uint32_t key, uint32_t offset, uint32_t length) {
+	size_t index = begin_node(d, JSONString, key);
+
+	if (d->tape) {
+		d->tape->nodes[index].value.string.offset = offset;
+		d->tape->nodes[index].value.string.length = length;
+	}
+
+	end_node(d, index, 0);
+}
+
+
+/// Share a member name that was just read into the pool at `offset`
+static uint32_t pool_intern(decoder * d, uint32_t offset, uint32_t length) {
+	return d->tape ? tape_keys_intern(d->keys, d->tape, offset, length) : 0;
+}
+
+
+/// Offset in the pool of the next string
+static uint32_t pool_offset(decoder * d) {
+	return d->tape ? (uint32_t) d->tape->strings_len : 0;
+}
+
+
+/// Append bytes to the string being added to the pool
+static void pool_append(decoder * d, const unsigned char * bytes, size_t len) {
+	if (d->tape) {
+		memcpy(d->tape->strings + d->tape->strings_len, bytes, len);
+		d->tape->strings_len += len;
+	} else {
+		d->bytes += len;
+	}
+}
+
+
+/// Terminate the string that started at `offset`, returning its length
+static uint32_t pool_finish(decoder * d, uint32_t offset) {
+	uint32_t len;
+
+	if (d->tape == NULL) {
+		d->bytes++;
+		return 0;
+	}
+
+	len = (uint32_t) (d->tape->strings_len - offset);
+	d->tape->strings[d->tape->strings_len++] = '\0';
+
+	return len;
+}
+
+
+/// Consume `len` bytes of input as a string in the pool
+static bool pool_read(decoder * d, uint64_t len, uint32_t * offset, uint32_t * length) {
+	const unsigned char * bytes;
+
+	if (!read_bytes(d, len, &bytes)) {
+		return false;
+	}
+
+	*offset = pool_offset(d);
+	pool_append(d, bytes, len);
+	*length = pool_finish(d, *offset);
+
+	return true;
+}
+
+
+/// Decode all of `data` (a single value) into a tape
+static json_tape * decode(const char * data, size_t len, decode_value value) {
+	decoder d;
+	json_tape * tape;
+
+	// First pass only measures
+	d.cursor = (const unsigned char *) data;
+	d.end = d.cursor + len;
+	d.tape = NULL;
+	d.keys = NULL;
+	d.nodes = 0;
+	d.bytes = 1;
+	d.depth = 0;
+
+	if ((data == NULL) || !value(&d, 0) || (d.cursor != d.end) ||
+			(d.nodes >= kTapeMaxNodes) || (d.bytes >= UINT32_MAX)) {
+		return NULL;
+	}
+
+	tape = malloc(sizeof(json_tape));
+
+	if (tape == NULL) {
+		return NULL;
+	}
+
+	tape->nodes = malloc(d.nodes * sizeof(tape_node));
+	tape->strings = malloc(d.bytes);
+	tape->count = 0;
+	tape->strings_len = 0;
+	tape->borrowed = false;
+
+	if ((tape->nodes == NULL) || (tape->strings == NULL)) {
+		json_tape_free(tape);
+		return NULL;
+	}
+
+	// Second pass fills the tape (and succeeds, as the first one did)
+	d.cursor = (const unsigned char *) data;
+	d.tape = tape;
+	d.keys = tape_keys_new();
+	d.depth = 0;
+
+	// Empty string at offset 0 (which is also the empty member name)
+	pool_intern(&d, 0, pool_finish(&d, 0));
+
+	value(&d, 0);
+
+	tape_keys_free(d.keys);
+	json_tape_shrink(tape);
+
+	return tape;
+}
+
+
+// MessagePack -- https://github.com/msgpack/msgpack/blob/master/spec.md
+
+static bool msgpack_value(decoder * d, uint32_t key);
+
+
+/// Size of the length that follows a str, bin, array, or map type byte (or 0)
+static size_t msgpack_length_size(unsigned char type) {
+	switch (type) {
+		case 0xc4:		// bin 8
+		case 0xd9:		// str 8
+			return 1;
+
+		case 0xc5:		// bin 16
+		case 0xda:		// str 16
+		case 0xdc:		// array 16
+		case 0xde:		// map 16
+			return 2;
+
+		case 0xc6:		// bin 32
+		case 0xdb:		// str 32
+		case 0xdd:		// array 32
+		case 0xdf:		// map 32
+			return 4;
+
+		default:
+			return 0;
+	}
+}
+
+
+/// Decode a string (str or bin) with type byte `type` into the pool
+static bool msgpack_string(decoder * d, unsigned char type, uint32_t * offset, uint32_t * length) {
+	uint64_t len;
+
+	if ((type & 0xe0) == 0xa0) {
+		// fixstr
+		len = type & 0x1f;
+	} else if ((type == 0xc4) || (type == 0xc5) || (type == 0xc6) ||
+			(type == 0xd9) || (type == 0xda) || (type == 0xdb)) {
+		if (!read_uint(d, msgpack_length_size(type), &len)) {
+			return false;
+		}
+	} else {
+		return false;
+	}
+
+	return pool_read(d, len, offset, length);
+}
+
+
+/// Decode `count` elements of an array, or members of a map
+static bool msgpack_container(decoder * d, int type, uint64_t count, uint32_t key) {
+	uint32_t member = 0, member_len = 0;
+	size_t index;
+	uint64_t i;
+
+	if (++d->depth > kMaxNesting) {
+		return false;
+	}
+
+	index = begin_node(d, type, key);
+
+	for (i = 0; i < count; i++) {
+		if ((type == JSONObject) &&
+				((d->cursor == d->end) || !msgpack_string(d, *d->cursor++, &member, &member_len))) {
+			return false;
+		}
+
+		if (!msgpack_value(d, (type == JSONObject) ? pool_intern(d, member, member_len) : 0)) {
+			return false;
+		}
+	}
+
+	end_node(d, index, count);
+	d->depth--;
+
+	return true;
+}
+
+
+static bool msgpack_value(decoder * d, uint32_t key) {
+	uint32_t offset, length;
+	unsigned char type;
+	uint64_t bits;
+	uint32_t bits32;
+	float f;
+	double number;
+	size_t size;
+
+	if (d->cursor == d->end) {
+		return false;
+	}
+
+	type = *d->cursor++;
+
+	if (type <= 0x7f) {
+		// positive fixint
+		add_number(d, key, type);
+		return true;
+	}
+
+	if (type >= 0xe0) {
+		// negative fixint
+		add_number(d, key, (int8_t) type);
+		return true;
+	}
+
+	switch (type & 0xf0) {
+		case 0x80:
+			return msgpack_container(d, JSONObject, type & 0x0f, key);
+
+		case 0x90:
+			return msgpack_container(d, JSONArray, type & 0x0f, key);
+	}
+
+	switch (type) {
+		case 0xc0:
+			add_literal(d, key, JSONNull, 0);
+			return true;
+
+		case 0xc2:
+		case 0xc3:
+			add_literal(d, key, JSONBoolean, type == 0xc3);
+			return true;
+
+		case 0xca:
+			// float 32
+			if (!read_uint(d, 4, &bits)) {
+				return false;
+			}
+
+			bits32 = (uint32_t) bits;
+			memcpy(&f, &bits32, sizeof(f));
+			add_number(d, key, f);
+			return true;
+
+		case 0xcb:
+			// float 64
+			if (!read_uint(d, 8, &bits)) {
+				return false;
+			}
+
+			memcpy(&number, &bits, sizeof(number));
+			add_number(d, key, number);
+			return true;
+
+		case 0xcc:
+		case 0xcd:
+		case 0xce:
+		case 0xcf:
+			// uint 8/16/32/64
+			if (!read_uint(d, (size_t) 1 << (type - 0xcc), &bits)) {
+				return false;
+			}
+
+			add_number(d, key, (double) bits);
+			return true;
+
+		case 0xd0:
+		case 0xd1:
+		case 0xd2:
+		case 0xd3:
+			// int 8/16/32/64
+			size = (size_t) 1 << (type - 0xd0);
+
+			if (!read_uint(d, size, &bits)) {
+				return false;
+			}
+
+			// Sign extend
+			add_number(d, key, (double) ((int64_t) (bits << (64 - 8 * size)) >> (64 - 8 * size)));
+			return true;
+
+		case 0xdc:
+		case 0xdd:
+		case 0xde:
+		case 0xdf:
+			if (!read_uint(d, msgpack_length_size(type), &bits)) {
+				return false;
+			}
+
+			return msgpack_container(d, (type >= 0xde) ? JSONObject : JSONArray, bits, key);
+
+		default:
+			// Strings, or unsupported (extension types, and the unused 0xc1)
+			if (!msgpack_string(d, type, &offset, &length)) {
+				return false;
+			}
+
+			add_string(d, key, offset, length);
+			return true;
+	}
+}
+
+
+/// Decode MessagePack into a tape
+json_tape * json_tape_from_msgpack(const char * data, size_t len) {
+	return decode(data, len, msgpack_value);
+}
+
+
+// CBOR -- RFC 8949
+
+static bool cbor_value(decoder * d, uint32_t key);
+
+
+/// Consume the argument that follows an initial byte with additional
+/// information `info` (other than 31, for indefinite length)
+static bool cbor_argument(decoder * d, unsigned char info, uint64_t * value) {
+	if (info < 24) {
+		*value = info;
+		return true;
+	}
+
+	if (info > 27) {
+		return false;
+	}
+
+	return read_uint(d, (size_t) 1 << (info - 24), value);
+}
+
+
+/// Consume a "break" (end of an indefinite length item) if there is one
+static bool cbor_break(decoder * d) {
+	if ((d->cursor < d->end) && (*d->cursor == 0xff)) {
+		d->cursor++;
+		return true;
+	}
+
+	return false;
+}
+
+
+/// Decode a byte or text string with initial byte `initial` into the pool
+static bool cbor_string(decoder * d, unsigned char initial, uint32_t * offset, uint32_t * length) {
+	const unsigned char * bytes;
+	unsigned char chunk;
+	uint64_t len;
+
+	if ((initial >> 5 != 2) && (initial >> 5 != 3)) {
+		return false;
+	}
+
+	if ((initial & 0x1f) != 31) {
+		return cbor_argument(d, initial & 0x1f, &len) && pool_read(d, len, offset, length);
+	}
+
+	// Indefinite length -- definite length chunks of the same type, then a break
+	*offset = pool_offset(d);
+
+	while (!cbor_break(d)) {
+		if (d->cursor == d->end) {
+			return false;
+		}
+
+		chunk = *d->cursor++;
+
+		if ((chunk >> 5 != initial >> 5) || ((chunk & 0x1f) == 31) ||
+				!cbor_argument(d, chunk & 0x1f, &len) || !read_bytes(d, len, &bytes)) {
+			return false;
+		}
+
+		pool_append(d, bytes, len);
+	}
+
+	*length = pool_finish(d, *offset);
+
+	return true;
+}
+
+
+/// Decode an array or map with additional information `info`
+static bool cbor_container(decoder * d, int type, unsigned char info, uint32_t key) {
+	uint32_t member = 0, member_len = 0;
+	uint64_t count = 0, i;
+	size_t index;
+
+	if ((info != 31) && !cbor_argument(d, info, &count)) {
+		return false;
+	}
+
+	if (++d->depth > kMaxNesting) {
+		return false;
+	}
+
+	index = begin_node(d, type, key);
+
+	for (i = 0; (info == 31) ? !cbor_break(d) : (i < count); i++) {
+		if ((type == JSONObject) &&
+				((d->cursor == d->end) || !cbor_string(d, *d->cursor++, &member, &member_len))) {
+			return false;
+		}
+
+		if (!cbor_value(d, (type == JSONObject) ? pool_intern(d, member, member_len) : 0)) {
+			return false;
+		}
+	}
+
+	end_node(d, index, i);
+	d->depth--;
+
+	return true;
+}
+
+
+/// Value of an IEEE 754 half precision float
+static double cbor_half(uint64_t bits) {
+	int exponent = (bits >> 10) & 0x1f;
+	double mantissa = (double) (bits & 0x3ff);
+	double value;
+
+	if (exponent == 0) {
+		value = ldexp(mantissa, -24);
+	} else if (exponent == 31) {
+		value = (mantissa == 0) ? INFINITY : NAN;
+	} else {
+		value = ldexp(mantissa + 1024, exponent - 25);
+	}
+
+	return (bits & 0x8000) ? -value : value;
+}
+
+
+static bool cbor_value(decoder * d, uint32_t key) {
+	uint32_t offset, length;
+	unsigned char initial, info;
+	uint64_t argument;
+	uint32_t bits32;
+	double number;
+	float f;
+	bool ok;
+
+	if (d->cursor == d->end) {
+		return false;
+	}
+
+	initial = *d->cursor++;
+	info = initial & 0x1f;
+
+	switch (initial >> 5) {
+		case 2:
+		case 3:
+			if (!cbor_string(d, initial, &offset, &length)) {
+				return false;
+			}
+
+			add_string(d, key, offset, length);
+			return true;
+
+		case 4:
+			return cbor_container(d, JSONArray, info, key);
+
+		case 5:
+			return cbor_container(d, JSONObject, info, key);
+	}
+
+	// Everything else has a definite argument
+	if ((info == 31) || !cbor_argument(d, info, &argument)) {
+		return false;
+	}
+
+	switch (initial >> 5) {
+		case 0:
+			add_number(d, key, (double) argument);
+			return true;
+
+		case 1:
+			add_number(d, key, -1.0 - (double) argument);
+			return true;
+
+		case 6:
+			// Tags (dates, bignums, etc.) are ignored, leaving the tagged value
+			if (++d->depth > kMaxNesting) {
+				return false;
+			}
+
+			ok = cbor_value(d, key);
+			d->depth--;
+
+			return ok;
+
+		default:
+			break;
+	}
+
+	// Simple values and floats
+	switch (info) {
+		case 20:
+		case 21:
+			add_literal(d, key, JSONBoolean, info == 21);
+			return true;
+
+		case 22:
+		case 23:
+			// null and undefined
+			add_literal(d, key, JSONNull, 0);
+			return true;
+
+		case 25:
+			add_number(d, key, cbor_half(argument));
+			return true;
+
+		case 26:
+			bits32 = (uint32_t) argument;
+			memcpy(&f, &bits32, sizeof(f));
+			add_number(d, key, f);
+			return true;
+
+		case 27:
+			memcpy(&number, &argument, sizeof(number));
+			add_number(d, key, number);
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+/// Decode CBOR into a tape
+json_tape * json_tape_from_cbor(const char * data, size_t len) {
+	return decode(data, len, cbor_value);
+}
+
+
+#ifdef TEST
+/// Check that two tapes hold the same document
+static void assert_same_tape(CuTest * tc, const json_tape * expected, const json_tape * actual) {
+	size_t i;
+
+	CuAssertPtrNotNull(tc, expected);
+	CuAssertPtrNotNull(tc, actual);
+	CuAssertIntEquals(tc, (int) expected->count, (int) actual->count);
+
+	for (i = 0; i < expected->count; i++) {
+		CuAssertIntEquals(tc, TAPE_TYPE(&expected->nodes[i]), TAPE_TYPE(&actual->nodes[i]));
+		CuAssertIntEquals(tc, (int) TAPE_NEXT(&expected->nodes[i]), (int) TAPE_NEXT(&actual->nodes[i]));
+		CuAssertStrEquals(tc, expected->strings + expected->nodes[i].key, actual->strings + actual->nodes[i].key);
+
+		switch (TAPE_TYPE(&expected->nodes[i])) {
+			case JSONString:
+				CuAssertStrEquals(tc, json_tape_string(expected, i, NULL), json_tape_string(actual, i, NULL));
+				break;
+
+			case JSONNumber:
+				CuAssertDblEquals(tc, expected->nodes[i].value.number, actual->nodes[i].value.number, 0);
+				break;
+
+			case JSONBoolean:
+				CuAssertIntEquals(tc, expected->nodes[i].value.boolean, actual->nodes[i].value.boolean);
+				break;
+
+			case JSONArray:
+			case JSONObject:
+				CuAssertIntEquals(tc, expected->nodes[i].value.count, actual->nodes[i].value.count);
+				break;
+		}
+	}
+}
+
+
+/// Decoding `len` bytes of `data` with `decoder` fails
+static void assert_invalid(CuTest * tc, json_tape * (*decoder)(const char *, size_t), const char * data, size_t len) {
+	CuAssertPtrEquals(tc, NULL, decoder(data, len));
+}
+
+
+static const char * kDecodeJSON = "{\"a\" : [1, \"two\", {\"b\" : true}], \"c\" : -1.5, \"d\" : null, \"e\" : 300, \"f\" : -2, \"\" : \"\"}";
+
+void Test_decode_msgpack(CuTest * tc) {
+	const char data[] = "\x86"
+		"\xa1" "a" "\x93" "\x01" "\xa3" "two" "\x81" "\xa1" "b" "\xc3"
+		"\xa1" "c" "\xcb" "\xbf\xf8\x00\x00\x00\x00\x00\x00"
+		"\xc4\x01" "d" "\xc0"
+		"\xd9\x01" "e" "\xcd\x01\x2c"
+		"\xa1" "f" "\xd0\xfe"
+		"\xa0" "\xa0";
+	size_t len = sizeof(data) - 1;
+	json_tape * expected = json_tape_parse(kDecodeJSON, strlen(kDecodeJSON));
+	json_tape * tape = json_tape_from_msgpack(data, len);
+	char * deep;
+
+	assert_same_tape(tc, expected, tape);
+	json_tape_free(tape);
+
+	// Other integer and float encodings
+	tape = json_tape_from_msgpack("\x96\xcf\x00\x00\x01\x00\x00\x00\x00\x00\xd3\xff\xff\xff\xff\xff\xff\xff\xfd\xd1\xff\x00\xe0\xca\x3f\xc0\x00\x00\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", 37);
+	CuAssertPtrNotNull(tc, tape);
+	CuAssertDblEquals(tc, 1099511627776.0, tape->nodes[1].value.number, 0);
+	CuAssertDblEquals(tc, -3, tape->nodes[2].value.number, 0);
+	CuAssertDblEquals(tc, -256, tape->nodes[3].value.number, 0);
+	CuAssertDblEquals(tc, -32, tape->nodes[4].value.number, 0);
+	CuAssertDblEquals(tc, 1.5, tape->nodes[5].value.number, 0);
+	CuAssertIntEquals(tc, JSONNull, json_tape_type(tape, 6));
+	json_tape_free(tape);
+
+	// Truncated, trailing data, unsupported or invalid types, non-string keys
+	assert_invalid(tc, json_tape_from_msgpack, data, len - 1);
+	assert_invalid(tc, json_tape_from_msgpack, data, 6);
+	assert_invalid(tc, json_tape_from_msgpack, "\xc0\xc0", 2);
+	assert_invalid(tc, json_tape_from_msgpack, "\xd4\x01\x00", 3);
+	assert_invalid(tc, json_tape_from_msgpack, "\xc1", 1);
+	assert_invalid(tc, json_tape_from_msgpack, "\x81\x01\x01", 3);
+	assert_invalid(tc, json_tape_from_msgpack, "\xdd\xff\xff\xff\xff\xc0", 6);
+	assert_invalid(tc, json_tape_from_msgpack, "", 0);
+
+	// Nesting is limited
+	deep = malloc(kMaxNesting + 2);
+	memset(deep, 0x91, kMaxNesting + 1);
+	deep[kMaxNesting + 1] = '\xc0';
+	assert_invalid(tc, json_tape_from_msgpack, deep, kMaxNesting + 2);
+
+	tape = json_tape_from_msgpack(deep + 1, kMaxNesting + 1);
+	CuAssertPtrNotNull(tc, tape);
+	json_tape_free(tape);
+
+	free(deep);
+	json_tape_free(expected);
+}
+
+
+void Test_decode_cbor(CuTest * tc) {
+	const char data[] = "\xa6"
+		"\x61" "a" "\x83" "\x01" "\x63" "two" "\xa1" "\x61" "b" "\xf5"
+		"\x61" "c" "\xf9\xbe\x00"
+		"\x41" "d" "\xf6"
+		"\x78\x01" "e" "\x19\x01\x2c"
+		"\x61" "f" "\x21"
+		"\x60" "\x60";
+	size_t len = sizeof(data) - 1;
+	json_tape * expected = json_tape_parse(kDecodeJSON, strlen(kDecodeJSON));
+	json_tape * tape = json_tape_from_cbor(data, len);
+	const char * chunked, * json;
+	char * deep;
+
+	assert_same_tape(tc, expected, tape);
+	json_tape_free(tape);
+	json_tape_free(expected);
+
+	// Indefinite lengths, and tags
+	chunked = "\xbf" "\x7f\x61" "a" "\x61" "b" "\xff" "\x9f\x01\xc1\x1a\x00\x00\x00\x64\xff"
+		"\x61" "c" "\x5f\xff" "\xff";
+	json = "{\"ab\" : [1, 100], \"c\" : \"\"}";
+	expected = json_tape_parse(json, strlen(json));
+	tape = json_tape_from_cbor(chunked, 21);
+	assert_same_tape(tc, expected, tape);
+	json_tape_free(tape);
+	json_tape_free(expected);
+
+	// Other number encodings
+	tape = json_tape_from_cbor("\x86\x3b\x00\x00\x00\x00\x00\x00\x00\x63\xfa\x3f\xc0\x00\x00\xfb\x40\x09\x21\xfb\x54\x44\x2d\x18\xf9\x00\x01\xf9\x7c\x00\xf7", 31);
+	CuAssertPtrNotNull(tc, tape);
+	CuAssertDblEquals(tc, -100, tape->nodes[1].value.number, 0);
+	CuAssertDblEquals(tc, 1.5, tape->nodes[2].value.number, 0);
+	CuAssertDblEquals(tc, 3.141592653589793, tape->nodes[3].value.number, 0);
+	CuAssertDblEquals(tc, ldexp(1, -24), tape->nodes[4].value.number, 0);
+	CuAssertIntEquals(tc, JSONNull, json_tape_type(tape, 5));
+	CuAssertIntEquals(tc, JSONNull, json_tape_type(tape, 6));
+	json_tape_free(tape);
+
+	// Truncated, trailing data, stray breaks, invalid chunks, non-string keys
+	assert_invalid(tc, json_tape_from_cbor, data, len - 1);
+	assert_invalid(tc, json_tape_from_cbor, "\xf6\xf6", 2);
+	assert_invalid(tc, json_tape_from_cbor, "\xff", 1);
+	assert_invalid(tc, json_tape_from_cbor, "\x9f\x01", 2);
+	assert_invalid(tc, json_tape_from_cbor, "\x7f\x41" "a" "\xff", 4);
+	assert_invalid(tc, json_tape_from_cbor, "\xa1\x01\x01", 3);
+	assert_invalid(tc, json_tape_from_cbor, "\x1c", 1);
+	assert_invalid(tc, json_tape_from_cbor, "\xf0", 1);
+	assert_invalid(tc, json_tape_from_cbor, "", 0);
+
+	// Nesting is limited
+	deep = malloc(kMaxNesting + 2);
+	memset(deep, 0x81, kMaxNesting + 1);
+	deep[kMaxNesting + 1] = '\xf6';
+	assert_invalid(tc, json_tape_from_cbor, deep, kMaxNesting + 2);
+
+	tape = json_tape_from_cbor(deep + 1, kMaxNesting + 1);
+	CuAssertPtrNotNull(tc, tape);
+	json_tape_free(tape);
+
+	free(deep);
+}
+#endif
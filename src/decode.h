@@ -0,0 +1,79 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file decode.h
+
+	@brief Build tapes from MessagePack and CBOR data.
+
+	Binary formats are decoded directly into a tape (see `tape.h`), without
+	converting to JSON text first.  Like `json_tape_new()`, decoding makes two
+	passes over the data -- the first measures it, so that the second can fill
+	a single block of nodes and a single string pool.
+
+	Map keys must be strings (text or binary).  Integers become numbers (those
+	beyond 2^53 lose precision, as with JSON), NaN and infinities become null,
+	and binary strings are treated as text.  CBOR tags are ignored, leaving the
+	tagged value.  MessagePack extension types are not supported.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef DECODE_MAGNUM_H
+#define DECODE_MAGNUM_H
+
+#include <stddef.h>
+
+#include "tape.h"
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// Decode the `len` bytes at `data`, a single MessagePack value, into a tape.
+/// Returns NULL if the data is invalid or unsupported.  Free with
+/// `json_tape_free()`.
+json_tape * json_tape_from_msgpack(const char * data, size_t len);
+
+
+/// Decode the `len` bytes at `data`, a single CBOR data item, into a tape.
+/// Returns NULL if the data is invalid or unsupported.  Free with
+/// `json_tape_free()`.
+json_tape * json_tape_from_cbor(const char * data, size_t len);
+
+
+#endif
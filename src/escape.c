@@ -0,0 +1,609 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file escape.c
+
+	@brief Escape text as it is appended to the output buffer.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_string.h"
+#include "escape.h"
+#include "libMagnum.h"
+
+#ifdef ESCAPE_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#ifdef ESCAPE_HAVE_AVX2
+	#include <immintrin.h>
+#endif
+
+
+/// Replacements for HTML special characters
+static const char * const html_replace[256] = {
+	['"'] = "&quot;",
+	['&'] = "&amp;",
+	['<'] = "&lt;",
+	['>'] = "&gt;",
+};
+
+
+/// Replacements for XML attribute values (whitespace is preserved as character
+/// references so that it survives attribute value normalization)
+static const char * const xml_attribute_replace[256] = {
+	['\t'] = "&#9;",
+	['\n'] = "&#10;",
+	['\r'] = "&#13;",
+	['"'] = "&quot;",
+	['&'] = "&amp;",
+	['\''] = "&apos;",
+	['<'] = "&lt;",
+	['>'] = "&gt;",
+};
+
+
+/// Replacements for the contents of a JSON string
+static const char * const json_replace[256] = {
+	"\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+	"\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+	"\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+	"\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+	['"'] = "\\\"",
+	['\\'] = "\\\\",
+};
+
+
+/// Percent-encoding for a URL component -- everything but RFC 3986 unreserved
+/// characters (`A-Z a-z 0-9 - _ . ~`)
+static const char * const url_replace[256] = {
+	"%00", "%01", "%02", "%03", "%04", "%05", "%06", "%07",
+	"%08", "%09", "%0A", "%0B", "%0C", "%0D", "%0E", "%0F",
+	"%10", "%11", "%12", "%13", "%14", "%15", "%16", "%17",
+	"%18", "%19", "%1A", "%1B", "%1C", "%1D", "%1E", "%1F",
+	"%20", "%21", "%22", "%23", "%24", "%25", "%26", "%27",
+	"%28", "%29", "%2A", "%2B", "%2C", NULL, NULL, "%2F",
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, "%3A", "%3B", "%3C", "%3D", "%3E", "%3F",
+	"%40", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, "%5B", "%5C", "%5D", "%5E", NULL,
+	"%60", NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	NULL, NULL, NULL, "%7B", "%7C", "%7D", NULL, "%7F",
+	"%80", "%81", "%82", "%83", "%84", "%85", "%86", "%87",
+	"%88", "%89", "%8A", "%8B", "%8C", "%8D", "%8E", "%8F",
+	"%90", "%91", "%92", "%93", "%94", "%95", "%96", "%97",
+	"%98", "%99", "%9A", "%9B", "%9C", "%9D", "%9E", "%9F",
+	"%A0", "%A1", "%A2", "%A3", "%A4", "%A5", "%A6", "%A7",
+	"%A8", "%A9", "%AA", "%AB", "%AC", "%AD", "%AE", "%AF",
+	"%B0", "%B1", "%B2", "%B3", "%B4", "%B5", "%B6", "%B7",
+	"%B8", "%B9", "%BA", "%BB", "%BC", "%BD", "%BE", "%BF",
+	"%C0", "%C1", "%C2", "%C3", "%C4", "%C5", "%C6", "%C7",
+	"%C8", "%C9", "%CA", "%CB", "%CC", "%CD", "%CE", "%CF",
+	"%D0", "%D1", "%D2", "%D3", "%D4", "%D5", "%D6", "%D7",
+	"%D8", "%D9", "%DA", "%DB", "%DC", "%DD", "%DE", "%DF",
+	"%E0", "%E1", "%E2", "%E3", "%E4", "%E5", "%E6", "%E7",
+	"%E8", "%E9", "%EA", "%EB", "%EC", "%ED", "%EE", "%EF",
+	"%F0", "%F1", "%F2", "%F3", "%F4", "%F5", "%F6", "%F7",
+	"%F8", "%F9", "%FA", "%FB", "%FC", "%FD", "%FE", "%FF",
+};
+
+
+/// Scalar scanner for HTML special characters (`<`, `>`, `&`, `"`)
+const char * escape_scan_html_scalar(const char * str, const char * end) {
+	while (str < end && !html_replace[(unsigned char) * str]) {
+		str++;
+	}
+
+	return str;
+}
+
+
+/// Scalar scanner for characters that need escaping in a JSON string
+const char * escape_scan_json_scalar(const char * str, const char * end) {
+	while (str < end && !json_replace[(unsigned char) * str]) {
+		str++;
+	}
+
+	return str;
+}
+
+
+// The HTML vector scanners need only two comparisons for the four characters:
+//
+//	'<' (0x3C) and '>' (0x3E) are the only bytes where (b | 0x02) == 0x3E
+//	'"' (0x22) and '&' (0x26) are the only bytes where (b | 0x04) == 0x26
+//
+// The JSON vector scanners look for '"', '\', and control characters, where
+// min(b, 0x1F) == b identifies the control characters.
+
+#ifdef ESCAPE_HAVE_SSE2
+/// SSE2 scanner for HTML special characters
+const char * escape_scan_html_sse2(const char * str, const char * end) {
+	const __m128i bit_angle = _mm_set1_epi8(0x02);
+	const __m128i angle = _mm_set1_epi8(0x3E);
+	const __m128i bit_amp = _mm_set1_epi8(0x04);
+	const __m128i amp = _mm_set1_epi8(0x26);
+
+	__m128i v, m;
+	int mask;
+
+	while (end - str >= 16) {
+		v = _mm_loadu_si128((const __m128i *) str);
+
+		m = _mm_or_si128(
+				_mm_cmpeq_epi8(_mm_or_si128(v, bit_angle), angle),
+				_mm_cmpeq_epi8(_mm_or_si128(v, bit_amp), amp));
+
+		mask = _mm_movemask_epi8(m);
+
+		if (mask) {
+			return str + __builtin_ctz((unsigned int) mask);
+		}
+
+		str += 16;
+	}
+
+	return escape_scan_html_scalar(str, end);
+}
+
+
+/// SSE2 scanner for characters that need escaping in a JSON string
+const char * escape_scan_json_sse2(const char * str, const char * end) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+
+	__m128i v, m;
+	int mask;
+
+	while (end - str >= 16) {
+		v = _mm_loadu_si128((const __m128i *) str);
+
+		m = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+				_mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+
+		mask = _mm_movemask_epi8(m);
+
+		if (mask) {
+			return str + __builtin_ctz((unsigned int) mask);
+		}
+
+		str += 16;
+	}
+
+	return escape_scan_json_scalar(str, end);
+}
+#endif
+
+
+#ifdef ESCAPE_HAVE_AVX2
+/// AVX2 scanner for HTML special characters -- only call if CPU supports AVX2
+__attribute__((target("avx2")))
+const char * escape_scan_html_avx2(const char * str, const char * end) {
+	const __m256i bit_angle = _mm256_set1_epi8(0x02);
+	const __m256i angle = _mm256_set1_epi8(0x3E);
+	const __m256i bit_amp = _mm256_set1_epi8(0x04);
+	const __m256i amp = _mm256_set1_epi8(0x26);
+
+	__m256i v, m;
+	unsigned int mask;
+
+	while (end - str >= 32) {
+		v = _mm256_loadu_si256((const __m256i *) str);
+
+		m = _mm256_or_si256(
+				_mm256_cmpeq_epi8(_mm256_or_si256(v, bit_angle), angle),
+				_mm256_cmpeq_epi8(_mm256_or_si256(v, bit_amp), amp));
+
+		mask = (unsigned int) _mm256_movemask_epi8(m);
+
+		if (mask) {
+			return str + __builtin_ctz(mask);
+		}
+
+		str += 32;
+	}
+
+	#ifdef ESCAPE_HAVE_SSE2
+	return escape_scan_html_sse2(str, end);
+	#else
+	return escape_scan_html_scalar(str, end);
+	#endif
+}
+
+
+/// AVX2 scanner for characters that need escaping in a JSON string -- only
+/// call if CPU supports AVX2
+__attribute__((target("avx2")))
+const char * escape_scan_json_avx2(const char * str, const char * end) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control = _mm256_set1_epi8(0x1F);
+
+	__m256i v, m;
+	unsigned int mask;
+
+	while (end - str >= 32) {
+		v = _mm256_loadu_si256((const __m256i *) str);
+
+		m = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(v, control), v));
+
+		mask = (unsigned int) _mm256_movemask_epi8(m);
+
+		if (mask) {
+			return str + __builtin_ctz(mask);
+		}
+
+		str += 32;
+	}
+
+	#ifdef ESCAPE_HAVE_SSE2
+	return escape_scan_json_sse2(str, end);
+	#else
+	return escape_scan_json_scalar(str, end);
+	#endif
+}
+#endif
+
+
+/// Does the CPU support AVX2?
+static int cpu_has_avx2(void) {
+	#ifdef ESCAPE_HAVE_AVX2
+	// Benign race -- every thread would store the same result
+	static int avx2 = -1;
+
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	return avx2;
+	#else
+	return 0;
+	#endif
+}
+
+
+/// Best HTML scanner available on the current CPU (chosen at runtime)
+escape_scanner escape_html_scanner(void) {
+	#ifdef ESCAPE_HAVE_AVX2
+
+	if (cpu_has_avx2()) {
+		return escape_scan_html_avx2;
+	}
+
+	#endif
+
+	#ifdef ESCAPE_HAVE_SSE2
+	return escape_scan_html_sse2;
+	#else
+	return escape_scan_html_scalar;
+	#endif
+}
+
+
+/// Best JSON string scanner available on the current CPU (chosen at runtime)
+escape_scanner escape_json_scanner(void) {
+	#ifdef ESCAPE_HAVE_AVX2
+
+	if (cpu_has_avx2()) {
+		return escape_scan_json_avx2;
+	}
+
+	#endif
+
+	#ifdef ESCAPE_HAVE_SSE2
+	return escape_scan_json_sse2;
+	#else
+	return escape_scan_json_scalar;
+	#endif
+}
+
+
+/// Append `len` bytes of `str` to `out`, replacing each byte that has a
+/// non-NULL entry in `replace`.  `scan` must locate exactly those bytes --
+/// pass NULL to scan using the table itself.
+void escape_with_table(DString * out, const char * str, size_t len, const char * const * replace, escape_scanner scan) {
+	const char * end = str + len;
+	const char * next;
+	const char * r;
+
+	while (str < end) {
+		if (scan) {
+			next = scan(str, end);
+		} else {
+			next = str;
+
+			while (next < end && !replace[(unsigned char) * next]) {
+				next++;
+			}
+		}
+
+		// Copy clean run in one step
+		if (next > str) {
+			d_string_append_c_array(out, str, next - str);
+		}
+
+		if (next == end) {
+			break;
+		}
+
+		r = replace[(unsigned char) * next];
+		d_string_append_c_array(out, r, strlen(r));
+
+		str = next + 1;
+	}
+}
+
+
+/// Append `len` bytes of `str` to `out`, escaping HTML special characters,
+/// using the specified scanner
+void escape_html_with_scanner(DString * out, const char * str, size_t len, escape_scanner scan) {
+	escape_with_table(out, str, len, html_replace, scan);
+}
+
+
+/// Append `len` bytes of `str` to `out`, escaping HTML special characters
+void escape_html(DString * out, const char * str, size_t len) {
+	escape_with_table(out, str, len, html_replace, escape_html_scanner());
+}
+
+
+/// Append `len` bytes of `str` to `out` as a CSV field (RFC 4180).  The field
+/// is quoted only if it contains a comma, quote, or line break.
+void escape_csv(DString * out, const char * str, size_t len) {
+	const char * end = str + len;
+	const char * next;
+
+	next = str;
+
+	while (next < end && *next != ',' && *next != '"' && *next != '\n' && *next != '\r') {
+		next++;
+	}
+
+	if (next == end) {
+		d_string_append_c_array(out, str, len);
+		return;
+	}
+
+	d_string_append_c(out, '"');
+
+	// Double any embedded quotes
+	while ((next = memchr(str, '"', end - str))) {
+		d_string_append_c_array(out, str, next - str + 1);
+		d_string_append_c(out, '"');
+		str = next + 1;
+	}
+
+	d_string_append_c_array(out, str, end - str);
+	d_string_append_c(out, '"');
+}
+
+
+/// Append `len` bytes of `str` to `out`, escaped according to `mode` (one of
+/// the `MAGNUM_ESCAPE_*` values).  `table` is only used for
+/// `MAGNUM_ESCAPE_CUSTOM`.
+void escape_append(DString * out, const char * str, size_t len, int mode, const char * const * table) {
+	switch (mode) {
+		case MAGNUM_ESCAPE_HTML:
+			escape_with_table(out, str, len, html_replace, escape_html_scanner());
+			break;
+
+		case MAGNUM_ESCAPE_XML_ATTRIBUTE:
+			escape_with_table(out, str, len, xml_attribute_replace, NULL);
+			break;
+
+		case MAGNUM_ESCAPE_JSON:
+			escape_with_table(out, str, len, json_replace, escape_json_scanner());
+			break;
+
+		case MAGNUM_ESCAPE_URL:
+			escape_with_table(out, str, len, url_replace, NULL);
+			break;
+
+		case MAGNUM_ESCAPE_CSV:
+			escape_csv(out, str, len);
+			break;
+
+		case MAGNUM_ESCAPE_CUSTOM:
+			if (table) {
+				escape_with_table(out, str, len, table, NULL);
+			} else {
+				// Never leave text unescaped because a table is missing
+				escape_with_table(out, str, len, html_replace, escape_html_scanner());
+			}
+
+			break;
+
+		default:
+			d_string_append_c_array(out, str, len);
+			break;
+	}
+}
+
+
+#ifdef TEST
+static void check_scanners(CuTest * tc, const char * str, size_t len) {
+	const char * end = str + len;
+	const char * html = escape_scan_html_scalar(str, end);
+	const char * json = escape_scan_json_scalar(str, end);
+
+	#ifdef ESCAPE_HAVE_SSE2
+	CuAssertPtrEquals(tc, (void *) html, (void *) escape_scan_html_sse2(str, end));
+	CuAssertPtrEquals(tc, (void *) json, (void *) escape_scan_json_sse2(str, end));
+	#endif
+
+	#ifdef ESCAPE_HAVE_AVX2
+
+	if (cpu_has_avx2()) {
+		CuAssertPtrEquals(tc, (void *) html, (void *) escape_scan_html_avx2(str, end));
+		CuAssertPtrEquals(tc, (void *) json, (void *) escape_scan_json_avx2(str, end));
+	}
+
+	#endif
+}
+
+
+void Test_escape_html(CuTest * tc) {
+	DString * out = d_string_new("");
+
+	escape_html(out, "", 0);
+	CuAssertStrEquals(tc, "", out->str);
+
+	escape_html(out, "plain text", 10);
+	CuAssertStrEquals(tc, "plain text", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_html(out, "<a href=\"x\">Tom & Jerry</a>", 27);
+	CuAssertStrEquals(tc, "&lt;a href=&quot;x&quot;&gt;Tom &amp; Jerry&lt;/a&gt;", out->str);
+	d_string_erase(out, 0, -1);
+
+	// Only `len` bytes are used
+	escape_html(out, "&&&", 2);
+	CuAssertStrEquals(tc, "&amp;&amp;", out->str);
+	d_string_erase(out, 0, -1);
+
+	// Special character at every position around vector boundaries
+	char buffer[80];
+	size_t i, j;
+
+	for (i = 0; i < 70; i++) {
+		memset(buffer, 'x', sizeof(buffer));
+		buffer[i] = "<>&\"\\\n"[i % 6];
+
+		for (j = 0; j <= 70; j++) {
+			check_scanners(tc, buffer, j);
+		}
+	}
+
+	// Pseudo-random text, mostly clean, with bytes that are "near misses"
+	const char alphabet[] = "abc <>&\"=?'$\\\t\x1f\x20\x7f\xa6\xbc\xfe";
+	char random[4096];
+	unsigned int seed = 12345;
+
+	for (i = 0; i < sizeof(random); i++) {
+		seed = seed * 1103515245 + 12345;
+		random[i] = ((seed >> 16) % 8) ? 'a' : alphabet[(seed >> 8) % (sizeof(alphabet) - 1)];
+	}
+
+	for (i = 0; i < 256; i++) {
+		check_scanners(tc, random + i, sizeof(random) - i);
+	}
+
+	// Output must match regardless of scanner
+	DString * reference = d_string_new("");
+	escape_html_with_scanner(reference, random, sizeof(random), escape_scan_html_scalar);
+	escape_html(out, random, sizeof(random));
+	CuAssertStrEquals(tc, reference->str, out->str);
+
+	d_string_free(reference, true);
+	d_string_free(out, true);
+}
+
+
+void Test_escape_modes(CuTest * tc) {
+	DString * out = d_string_new("");
+	const char * text = "a<b> & \"c\" 'd'\t\\e/f\n";
+
+	escape_append(out, text, strlen(text), MAGNUM_ESCAPE_HTML, NULL);
+	CuAssertStrEquals(tc, "a&lt;b&gt; &amp; &quot;c&quot; 'd'\t\\e/f\n", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, text, strlen(text), MAGNUM_ESCAPE_NONE, NULL);
+	CuAssertStrEquals(tc, text, out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, text, strlen(text), MAGNUM_ESCAPE_XML_ATTRIBUTE, NULL);
+	CuAssertStrEquals(tc, "a&lt;b&gt; &amp; &quot;c&quot; &apos;d&apos;&#9;\\e/f&#10;", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, text, strlen(text), MAGNUM_ESCAPE_JSON, NULL);
+	CuAssertStrEquals(tc, "a<b> & \\\"c\\\" 'd'\\t\\\\e/f\\n", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, "\x01\x1f\x7f", 3, MAGNUM_ESCAPE_JSON, NULL);
+	CuAssertStrEquals(tc, "\\u0001\\u001f\x7f", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, "a b&c=d/e~f-g_h.i\xc3\xa9", 19, MAGNUM_ESCAPE_URL, NULL);
+	CuAssertStrEquals(tc, "a%20b%26c%3Dd%2Fe~f-g_h.i%C3%A9", out->str);
+	d_string_erase(out, 0, -1);
+
+	// CSV fields are only quoted when necessary
+	escape_append(out, "plain field", 11, MAGNUM_ESCAPE_CSV, NULL);
+	CuAssertStrEquals(tc, "plain field", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, "a,b", 3, MAGNUM_ESCAPE_CSV, NULL);
+	CuAssertStrEquals(tc, "\"a,b\"", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, "say \"hi\"", 8, MAGNUM_ESCAPE_CSV, NULL);
+	CuAssertStrEquals(tc, "\"say \"\"hi\"\"\"", out->str);
+	d_string_erase(out, 0, -1);
+
+	escape_append(out, "two\nlines", 9, MAGNUM_ESCAPE_CSV, NULL);
+	CuAssertStrEquals(tc, "\"two\nlines\"", out->str);
+	d_string_erase(out, 0, -1);
+
+	// User-supplied table (e.g. for a single-quoted shell string)
+	const char * shell[256] = {
+		['\''] = "'\\''",
+	};
+
+	escape_append(out, "it's", 4, MAGNUM_ESCAPE_CUSTOM, shell);
+	CuAssertStrEquals(tc, "it'\\''s", out->str);
+	d_string_erase(out, 0, -1);
+
+	// Without a table, HTML escaping is used
+	escape_append(out, "it's <b>", 8, MAGNUM_ESCAPE_CUSTOM, NULL);
+	CuAssertStrEquals(tc, "it's &lt;b&gt;", out->str);
+
+	d_string_free(out, true);
+}
+#endif
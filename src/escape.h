@@ -0,0 +1,138 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file escape.h
+
+	@brief Escape text as it is appended to the output buffer.
+
+	Rather than testing (and appending) one byte at a time, a "scanner" locates
+	the next byte that needs to be escaped so that the clean run before it can
+	be copied in bulk.  Vectorized scanners (SSE2, and AVX2 when the CPU
+	supports it) are used for HTML and JSON when available, with a scalar
+	fallback that produces identical results.  Other modes scan using a
+	256-entry lookup table of replacement strings.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef ESCAPE_MAGNUM_H
+#define ESCAPE_MAGNUM_H
+
+#include <stddef.h>
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// From d_string.h:
+typedef struct DString DString;
+
+
+// Vectorized scanners are only built for x86 with GCC/clang
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#ifdef __SSE2__
+		#define ESCAPE_HAVE_SSE2	1
+	#endif
+
+	#define ESCAPE_HAVE_AVX2	1
+#endif
+
+
+/// Returns pointer to the next byte in [str, end) that needs escaping, or `end`
+typedef const char * (*escape_scanner)(const char * str, const char * end);
+
+
+/// Scalar scanner for HTML special characters (`<`, `>`, `&`, `"`)
+const char * escape_scan_html_scalar(const char * str, const char * end);
+
+/// Scalar scanner for characters that need escaping in a JSON string
+const char * escape_scan_json_scalar(const char * str, const char * end);
+
+#ifdef ESCAPE_HAVE_SSE2
+/// SSE2 scanner for HTML special characters
+const char * escape_scan_html_sse2(const char * str, const char * end);
+
+/// SSE2 scanner for characters that need escaping in a JSON string
+const char * escape_scan_json_sse2(const char * str, const char * end);
+#endif
+
+#ifdef ESCAPE_HAVE_AVX2
+/// AVX2 scanner for HTML special characters -- only call if CPU supports AVX2
+const char * escape_scan_html_avx2(const char * str, const char * end);
+
+/// AVX2 scanner for characters that need escaping in a JSON string -- only
+/// call if CPU supports AVX2
+const char * escape_scan_json_avx2(const char * str, const char * end);
+#endif
+
+
+/// Best HTML scanner available on the current CPU (chosen at runtime)
+escape_scanner escape_html_scanner(void);
+
+
+/// Best JSON string scanner available on the current CPU (chosen at runtime)
+escape_scanner escape_json_scanner(void);
+
+
+/// Append `len` bytes of `str` to `out`, replacing each byte that has a
+/// non-NULL entry in `replace`.  `scan` must locate exactly those bytes --
+/// pass NULL to scan using the table itself.
+void escape_with_table(DString * out, const char * str, size_t len, const char * const * replace, escape_scanner scan);
+
+
+/// Append `len` bytes of `str` to `out`, escaping HTML special characters,
+/// using the specified scanner
+void escape_html_with_scanner(DString * out, const char * str, size_t len, escape_scanner scan);
+
+
+/// Append `len` bytes of `str` to `out`, escaping HTML special characters
+void escape_html(DString * out, const char * str, size_t len);
+
+
+/// Append `len` bytes of `str` to `out` as a CSV field (RFC 4180).  The field
+/// is quoted only if it contains a comma, quote, or line break.
+void escape_csv(DString * out, const char * str, size_t len);
+
+
+/// Append `len` bytes of `str` to `out`, escaped according to `mode` (one of
+/// the `MAGNUM_ESCAPE_*` values).  `table` is only used for
+/// `MAGNUM_ESCAPE_CUSTOM`, which escapes HTML if `table` is NULL.
+void escape_append(DString * out, const char * str, size_t len, int mode, const char * const * table);
+
+
+#endif
@@ -111,54 +111,283 @@
 
 #if defined(__WIN32)
 	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
 #endif
 
 #define kBUFFERSIZE 4096	// How many bytes to read at a time
 
 
-/// Scan file into a DString
-DString * scan_file(const char * fname) {
-	/* Read from stdin and return a DString *
-		`buffer` will need to be freed elsewhere */
-
-	char chunk[kBUFFERSIZE];
-	size_t bytes;
-
-	FILE * file;
-
+/// Open file for reading (handling UTF-8 filenames on Windows)
+static FILE * open_file(const char * fname) {
 #if defined(__WIN32)
 	int wchars_num = MultiByteToWideChar(CP_UTF8, 0, fname, -1, NULL, 0);
 	wchar_t wstr[wchars_num];
 	MultiByteToWideChar(CP_UTF8, 0, fname, -1, wstr, wchars_num);
 
-	if ((file = _wfopen(wstr, L"rb")) == NULL) {
+	return _wfopen(wstr, L"rb");
 #else
-
-	if ((file = fopen(fname, "r")) == NULL ) {
+	return fopen(fname, "r");
 #endif
+}
+
+
+/// Read remainder of file into a single buffer, presized to `size_hint`
+/// bytes (plus room for a terminating NUL).  Returns NULL on failure.
+static char * read_whole_file(FILE * file, size_t size_hint, size_t * length) {
+	size_t allocated = size_hint + 1;
+	size_t used = 0;
+	size_t bytes;
+	char * buffer = malloc(allocated);
+	char * resized;
+	int c;
 
+	if (buffer == NULL) {
 		return NULL;
 	}
 
-	DString * buffer = d_string_new("");
+	while (1) {
+		if (used == allocated - 1) {
+			// Buffer is full -- are we at the end of the file?
+			if ((c = fgetc(file)) == EOF) {
+				break;
+			}
 
-	while ((bytes = fread(chunk, 1, kBUFFERSIZE, file)) > 0) {
-		d_string_append_c_array(buffer, chunk, bytes);
+			// File was larger than expected (or size was unknown)
+			allocated = (allocated < kBUFFERSIZE) ? kBUFFERSIZE : allocated * 2;
+			resized = realloc(buffer, allocated);
 
-		if (buffer->currentStringLength < kBUFFERSIZE) {
-			// Strip BOM
-			if (strncmp(buffer->str, "\xef\xbb\xbf", 3) == 0) {
-				d_string_erase(buffer, 0, 3);
+			if (resized == NULL) {
+				free(buffer);
+				return NULL;
 			}
+
+			buffer = resized;
+			buffer[used++] = (char) c;
+		}
+
+		bytes = fread(buffer + used, 1, allocated - used - 1, file);
+
+		if (bytes == 0) {
+			break;
+		}
+
+		used += bytes;
+	}
+
+	buffer[used] = '\0';
+	*length = used;
+
+	return buffer;
+}
+
+
+/// Size of an open file, or 0 if unknown
+static size_t file_size(FILE * file) {
+#if defined(__WIN32)
+	return 0;
+#else
+	struct stat st;
+
+	if ((fstat(fileno(file), &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+		return (size_t) st.st_size;
+	}
+
+	return 0;
+#endif
+}
+
+
+/// Skip UTF-8 byte order mark
+static void skip_bom(file_map * map) {
+	if ((map->length >= 3) && (memcmp(map->data, "\xef\xbb\xbf", 3) == 0)) {
+		map->data += 3;
+		map->length -= 3;
+	}
+}
+
+
+/// Memory map a file, or if that isn't possible read it into a buffer that
+/// is presized from the file size.  Returns 0 on success.
+static int map_file(file_map * map, const char * fname, bool writable) {
+	FILE * file;
+	size_t size;
+
+	map->data = NULL;
+	map->length = 0;
+	map->base = NULL;
+	map->base_length = 0;
+	map->mapped = false;
+
+	if ((file = open_file(fname)) == NULL) {
+		return -1;
+	}
+
+	size = file_size(file);
+
+#if !defined(__WIN32)
+
+	if (size) {
+		// Private mappings are copy-on-write, so changes never reach the file
+		void * mapping = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fileno(file), 0);
+
+		if (mapping != MAP_FAILED) {
+			// We read it once, front to back
+			madvise(mapping, size, MADV_SEQUENTIAL);
+
+			fclose(file);
+
+			map->base = mapping;
+			map->base_length = size;
+			map->mapped = true;
+			map->data = mapping;
+			map->length = size;
+
+			skip_bom(map);
+
+			return 0;
 		}
 	}
 
+#endif
+
+	map->base = read_whole_file(file, size, &map->length);
 	fclose(file);
 
+	if (map->base == NULL) {
+		return -1;
+	}
+
+	map->data = map->base;
+
+	skip_bom(map);
+
+	return 0;
+}
+
+
+/// Memory map a file (read-only), or if that isn't possible read it into a
+/// buffer that is presized from the file size.  Returns 0 on success.
+int file_map_open(file_map * map, const char * fname) {
+	return map_file(map, fname, false);
+}
+
+
+/// As `file_map_open()`, but the contents may be modified in place
+int file_map_open_writable(file_map * map, const char * fname) {
+	return map_file(map, fname, true);
+}
+
+
+/// Release a file opened with `file_map_open()` or `file_map_open_writable()`
+void file_map_close(file_map * map) {
+#if !defined(__WIN32)
+
+	if (map->mapped) {
+		munmap(map->base, map->base_length);
+	} else
+#endif
+	{
+		free(map->base);
+	}
+
+	map->base = NULL;
+	map->data = NULL;
+	map->length = 0;
+	map->base_length = 0;
+	map->mapped = false;
+}
+
+
+/// Scan file into a DString
+DString * scan_file(const char * fname) {
+	/* Read from file and return a DString *
+		`buffer` will need to be freed elsewhere */
+
+	FILE * file;
+	char * contents;
+	size_t length;
+
+	if ((file = open_file(fname)) == NULL) {
+		return NULL;
+	}
+
+	// Read the whole file in one pass into a buffer of the right size
+	contents = read_whole_file(file, file_size(file), &length);
+	fclose(file);
+
+	if (contents == NULL) {
+		return NULL;
+	}
+
+	// Strip BOM
+	if ((length >= 3) && (memcmp(contents, "\xef\xbb\xbf", 3) == 0)) {
+		memmove(contents, contents + 3, length - 2);
+		length -= 3;
+	}
+
+	DString * buffer = d_string_new("");
+	free(buffer->str);
+	buffer->str = contents;
+	buffer->currentStringLength = length;
+	buffer->currentStringBufferSize = length + 1;
+
 	return buffer;
 }
 
 
+#if defined(TEST) && !defined(__WIN32)
+void Test_file_map(CuTest * tc) {
+	char fname[] = "/tmp/magnum_test_XXXXXX";
+	int fd = mkstemp(fname);
+	file_map map;
+	DString * d;
+
+	CuAssertTrue(tc, fd >= 0);
+	CuAssertIntEquals(tc, 12, (int) write(fd, "\xef\xbb\xbf{\"a\" : 1}", 12));
+	close(fd);
+
+	// Memory mapped, with BOM skipped
+	CuAssertIntEquals(tc, 0, file_map_open(&map, fname));
+	CuAssertTrue(tc, map.mapped);
+	CuAssertIntEquals(tc, 9, (int) map.length);
+	CuAssertIntEquals(tc, 0, memcmp(map.data, "{\"a\" : 1}", 9));
+	file_map_close(&map);
+
+	// Writable copy doesn't change the file
+	CuAssertIntEquals(tc, 0, file_map_open_writable(&map, fname));
+	((char *) map.data)[0] = '[';
+	file_map_close(&map);
+
+	d = scan_file(fname);
+	CuAssertStrEquals(tc, "{\"a\" : 1}", d->str);
+	CuAssertIntEquals(tc, 9, (int) d->currentStringLength);
+	d_string_free(d, true);
+
+	// Empty file is read rather than mapped
+	fd = open(fname, O_WRONLY | O_TRUNC);
+	close(fd);
+
+	CuAssertIntEquals(tc, 0, file_map_open(&map, fname));
+	CuAssertTrue(tc, !map.mapped);
+	CuAssertIntEquals(tc, 0, (int) map.length);
+	file_map_close(&map);
+
+	d = scan_file(fname);
+	CuAssertStrEquals(tc, "", d->str);
+	d_string_free(d, true);
+
+	unlink(fname);
+
+	CuAssertIntEquals(tc, -1, file_map_open(&map, fname));
+	CuAssertPtrEquals(tc, NULL, scan_file(fname));
+}
+#endif
+
+
 /// Scan from stdin into a DString
 DString * stdin_buffer() {
 	/* Read from stdin and return a GString *
@@ -106,6 +106,7 @@
 #define FILE_UTILITIES_MULTIMARKDOWN_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef TEST
 	#include "CuTest.h"
@@ -116,6 +117,31 @@
 typedef struct DString DString;
 
 
+/// Read-only view of a file's contents
+typedef struct {
+	const char *	data;			//!< File contents (not NUL-terminated), after any BOM
+	size_t			length;			//!< Length of `data`
+	void *			base;			//!< Start of mapping or buffer
+	size_t			base_length;	//!< Length of mapping
+	bool			mapped;			//!< Was the file memory mapped (otherwise `base` was allocated)
+} file_map;
+
+
+/// Memory map a file (read-only), or if that isn't possible read it into a
+/// buffer that is presized from the file size.  Returns 0 on success.  The
+/// contents remain valid until `file_map_close()`.
+int file_map_open(file_map * map, const char * fname);
+
+
+/// As `file_map_open()`, but the contents may be modified in place (cast
+/// away the `const` of `data`).  Changes are private, and never written back.
+int file_map_open_writable(file_map * map, const char * fname);
+
+
+/// Release a file opened with `file_map_open()` or `file_map_open_writable()`
+void file_map_close(file_map * map);
+
+
 /// Scan file into a DString
 DString * scan_file(const char * fname);
 
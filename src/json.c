@@ -44,22 +44,23 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include "d_string.h"
 #include "json.h"
 
 
-#define kBUFFERSIZE 4096	// How many bytes to read at a time
-
-
-/// Load JSON from string
-/// JSON_Value will need to be freed
+/// Load JSON from string into a single arena
+/// JSON_Value will need to be freed, and is read-only
 JSON_Value * json_from_string(const char * string) {
 	// Parse JSON source string
 	JSON_Value *	root_value;
 
-	root_value = json_parse_string(string);
+	if (string == NULL) {
+		return NULL;
+	}
+
+	root_value = json_parse_stringn_with_flags(string, strlen(string), JSONParseArena);
 
 	if (json_value_get_type(root_value) == JSONError) {
 		fprintf(stderr, "Invalid JSON...\n");
@@ -71,32 +72,47 @@ JSON_Value * json_from_string(const char * string) {
 }
 
 
-/// Load JSON from file
-/// JSON_Value will need to be freed
+/// Load JSON from file into a single arena
+/// JSON_Value will need to be freed, and is read-only
 JSON_Value * json_from_file(const char * fname) {
-	/* Read from file */
-
-	char chunk[kBUFFERSIZE];
-	size_t bytes;
+	file_map map;
 
-	FILE * file;
-
-	if ((file = fopen(fname, "r")) == NULL ) {
+	// Parse directly from the mapped file
+	if (file_map_open(&map, fname)) {
 		fprintf(stderr, "Error reading file...\n");
 		return NULL;
 	}
 
-	DString * buffer = d_string_new("");
+	JSON_Value * root_value = json_parse_stringn_with_flags(map.data, map.length, JSONParseArena);
+
+	file_map_close(&map);
 
-	while ((bytes = fread(chunk, 1, kBUFFERSIZE, file)) > 0) {
-		d_string_append_c_array(buffer, chunk, bytes);
+	if (json_value_get_type(root_value) == JSONError) {
+		fprintf(stderr, "Invalid JSON...\n");
+		json_value_free(root_value);
+		return NULL;
 	}
 
-	fclose(file);
+	return root_value;
+}
+
+
+/// Load JSON from file, parsing strings in place
+/// JSON_Value will need to be freed, and is read-only
+JSON_Value * json_from_file_in_situ(const char * fname, file_map * map, int flags, JSON_Key_Filter filter, void * context) {
+	if (file_map_open_writable(map, fname)) {
+		fprintf(stderr, "Error reading file...\n");
+		return NULL;
+	}
 
-	JSON_Value * root_value = json_from_string(buffer->str);
+	// The mapping is writable, and private to us
+	JSON_Value * root_value = json_parse_stringn_in_situ_filtered((char *) map->data, map->length, JSONParseArena | flags, filter, context);
 
-	d_string_free(buffer, true);
+	if (root_value == NULL) {
+		fprintf(stderr, "Invalid JSON...\n");
+		file_map_close(map);
+		return NULL;
+	}
 
 	return root_value;
 }
@@ -137,4 +153,276 @@ void Test_json_values(CuTest * tc) {
 
 	json_value_free(json);
 }
+
+
+void Test_json_arena(CuTest * tc) {
+	const char * source = "{ \"list\" : [1, \"two\", {\"three\" : null}], \"name\" : \"a\\u00e9b\" }";
+	const char * duplicate = "{ \"list\" : [1, \"two\"], \"list\" : 0 }";
+	JSON_Value * json;
+	JSON_Value * copy;
+	JSON_Object * o;
+	JSON_Array * a;
+
+	// Errors are reported as with the heap parser
+	CuAssertPtrEquals(tc, NULL, json_parse_stringn_with_flags(duplicate, strlen(duplicate), JSONParseArena));
+	CuAssertPtrEquals(tc, NULL, json_parse_stringn_with_flags(source, 20, JSONParseArena));
+
+	json = json_parse_stringn_with_flags(source, strlen(source), JSONParseArena);
+	CuAssertPtrNotNull(tc, json);
+	CuAssertPtrEquals(tc, NULL, json_value_get_parent(json));
+
+	o = json_value_get_object(json);
+	CuAssertStrEquals(tc, "a\xc3\xa9" "b", json_object_get_string(o, "name"));
+
+	a = json_object_get_array(o, "list");
+	CuAssertIntEquals(tc, 3, (int) json_array_get_count(a));
+	CuAssertDblEquals(tc, 1, json_array_get_number(a, 0), 0);
+	CuAssertStrEquals(tc, "two", json_array_get_string(a, 1));
+	CuAssertPtrEquals(tc, json, json_value_get_parent(json_object_get_value(o, "list")));
+	CuAssertIntEquals(tc, JSONNull, json_value_get_type(json_object_get_value(json_array_get_object(a, 2), "three")));
+
+	// Arena documents are read-only
+	CuAssertIntEquals(tc, JSONFailure, json_object_set_number(o, "new", 1));
+	CuAssertIntEquals(tc, JSONFailure, json_object_remove(o, "name"));
+	CuAssertIntEquals(tc, JSONFailure, json_array_append_null(a));
+	CuAssertIntEquals(tc, JSONFailure, json_array_clear(a));
+	CuAssertIntEquals(tc, 3, (int) json_array_get_count(a));
+
+	// Freeing an interior value does nothing
+	json_value_free(json_object_get_value(o, "list"));
+
+	// But a copy lives on the heap
+	copy = json_value_deep_copy(json);
+	CuAssertTrue(tc, json_value_equals(json, copy));
+	CuAssertIntEquals(tc, JSONSuccess, json_object_set_number(json_value_get_object(copy), "new", 1));
+
+	json_value_free(json);
+	json_value_free(copy);
+
+	// Scalar roots
+	json = json_parse_stringn_with_flags("\"text\"", 6, JSONParseArena);
+	CuAssertStrEquals(tc, "text", json_value_get_string(json));
+	json_value_free(json);
+}
+
+
+void Test_json_in_situ(CuTest * tc) {
+	char source[] = "{\"plain\":\"text\",\"esc\\u0061ped\":\"\\u00e9\\ud83d\\ude00\\n\",\"list\":[\"a\",\"\"]}";
+	char invalid[] = "[\"ok\", \"bad\\x\"]";
+	JSON_Value * json;
+	JSON_Object * o;
+
+	json = json_parse_stringn_in_situ(source, strlen(source), JSONParseDefault);
+	CuAssertPtrNotNull(tc, json);
+
+	o = json_value_get_object(json);
+
+	// Unescaped strings point directly into the buffer
+	CuAssertStrEquals(tc, "text", json_object_get_string(o, "plain"));
+	CuAssertPtrEquals(tc, source + 10, (void *) json_object_get_string(o, "plain"));
+	CuAssertStrEquals(tc, "plain", json_object_get_name(o, 0));
+	CuAssertPtrEquals(tc, source + 2, (void *) json_object_get_name(o, 0));
+
+	// Escaped strings are decoded in place
+	CuAssertStrEquals(tc, "\xc3\xa9\xf0\x9f\x98\x80\n", json_object_get_string(o, "escaped"));
+	CuAssertStrEquals(tc, "a", json_array_get_string(json_object_get_array(o, "list"), 0));
+	CuAssertStrEquals(tc, "", json_array_get_string(json_object_get_array(o, "list"), 1));
+
+	// Still read-only
+	CuAssertIntEquals(tc, JSONFailure, json_object_set_null(o, "plain"));
+
+	json_value_free(json);
+
+	CuAssertPtrEquals(tc, NULL, json_parse_stringn_in_situ(invalid, strlen(invalid), JSONParseDefault));
+
+	// Only the first `len` bytes are considered
+	CuAssertPtrEquals(tc, NULL, json_parse_stringn_in_situ(source, 12, JSONParseDefault));
+}
+
+void Test_json_scan(CuTest * tc) {
+	// Long enough to exercise the vectorized scanners, with the interesting
+	// bytes on either side of the 16 byte block boundaries
+	const char * source = "{\n                                \"long key, longer than a block\":\n"
+		"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\"0123456789abcde\\\"f0123456789abcdef\\u00e9\xc3\xa9\",\r\n"
+		"\"utf8\": \"\xe2\x82\xac\xf0\x9f\x98\x80 0123456789abcdef0123456789abcdef\" \v\f}";
+	const char * invalid[] = {
+		"\"0123456789abcdef\t0123456789abcdef\"",		// Raw control character
+		"\"0123456789abcdef\\",						// Unterminated after escape
+		"\"0123456789abcdef0123456789abcdef",		// Unterminated
+		"[\"0123456789abcdef\xc3\"]",				// Truncated sequence
+		"[\"0123456789abcdef0123456789abcdef\xc0\xaf\"]",	// Overlong encoding
+		"[\"\xed\xa0\x80\"]",						// Surrogate half
+		"                                 \xff" "1",	// Invalid byte outside a string
+	};
+	JSON_Value * json;
+	JSON_Object * o;
+	size_t i;
+
+	json = json_parse_stringn_with_flags(source, strlen(source), JSONParseArena);
+	CuAssertPtrNotNull(tc, json);
+
+	o = json_value_get_object(json);
+	CuAssertIntEquals(tc, 2, (int) json_object_get_count(o));
+	CuAssertStrEquals(tc, "0123456789abcde\"f0123456789abcdef\xc3\xa9\xc3\xa9",
+		json_object_get_string(o, "long key, longer than a block"));
+	CuAssertStrEquals(tc, "\xe2\x82\xac\xf0\x9f\x98\x80 0123456789abcdef0123456789abcdef",
+		json_object_get_string(o, "utf8"));
+
+	json_value_free(json);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		CuAssertPtrEquals(tc, NULL, json_parse_stringn_with_flags(invalid[i], strlen(invalid[i]), JSONParseDefault));
+	}
+}
+
+void Test_json_numbers(CuTest * tc) {
+	const char * valid[] = {
+		"0", "-0", "42", "-17", "9007199254740993", "18446744073709551615", "123456789012345678901234",
+		"19.99", "-0.001", "0.1", "3.14159265358979", "1e5", "2.5E-3", "-0e5", "1.7976931348623157e308",
+		"2.2250738585072014e-308", "0.000000000000000000000000000001",
+	};
+	const char * invalid[] = {
+		"01", "-01", "00", "1.", ".5", "-", "1e", "1e+", "0x10", "1.2.3", "+1", "-inf", "nan", "1e400",
+	};
+	JSON_Value * json;
+	double expected, actual;
+	size_t i;
+
+	for (i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+		json = json_parse_string(valid[i]);
+		CuAssertPtrNotNull(tc, json);
+
+		// Same bits as strtod(), including the sign of zero
+		expected = strtod(valid[i], NULL);
+		actual = json_value_get_number(json);
+		CuAssertIntEquals(tc, 0, memcmp(&expected, &actual, sizeof(double)));
+
+		json_value_free(json);
+	}
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		CuAssertPtrEquals(tc, NULL, json_parse_string(invalid[i]));
+	}
+
+	// Input needn't be terminated
+	json = json_parse_stringn_with_flags("[12.5]", 5, JSONParseDefault);
+	CuAssertPtrEquals(tc, NULL, json);
+	json = json_parse_stringn_with_flags("12.5]", 4, JSONParseDefault);
+	CuAssertDblEquals(tc, 12.5, json_value_get_number(json), 0);
+	json_value_free(json);
+}
+
+void Test_json_trusted(CuTest * tc) {
+	const char * duplicate = "{\"a\" : 1, \"b\" : 2, \"a\" : 3}";
+	JSON_Value * json;
+	JSON_Object * o;
+
+	CuAssertPtrEquals(tc, NULL, json_parse_stringn_with_flags(duplicate, strlen(duplicate), JSONParseArena));
+
+	// Trusted input isn't checked -- both members are kept, the first wins
+	json = json_parse_stringn_with_flags(duplicate, strlen(duplicate), JSONParseArena | JSONParseTrusted);
+	CuAssertPtrNotNull(tc, json);
+
+	o = json_value_get_object(json);
+	CuAssertIntEquals(tc, 3, (int) json_object_get_count(o));
+	CuAssertDblEquals(tc, 1, json_object_get_number(o, "a"), 0);
+	CuAssertDblEquals(tc, 2, json_object_get_number(o, "b"), 0);
+
+	json_value_free(json);
+}
+
+static int test_filter(const char * key, size_t key_len, void * context) {
+	(*(int *) context)++;
+
+	if (key_len == 1 && key[0] == 'a') {
+		return JSONKeyKeep;
+	}
+
+	if (key_len == 3 && memcmp(key, "raw", 3) == 0) {
+		return JSONKeyKeepAll;
+	}
+
+	return JSONKeySkip;
+}
+
+
+void Test_json_filter(CuTest * tc) {
+	const char * source = "{\"skip\" : {\"a\" : [1, \"]}\\\"\", {\"x\" : null}]}, \"a\" : {\"a\" : 1, \"b\" : 2, \"\\u0062\" : 3}, "
+		"\"raw\" : {\"b\" : {\"c\" : true}}, \"n\" : -1.5e3, \"s\" : \"x\", \"list\" : [[], {}]}";
+	const char * invalid[] = {
+		"{\"skip\" : [1, 2}, \"a\" : 1}",	// Mismatched brackets
+		"{\"skip\" : , \"a\" : 1}",			// Missing value
+		"{\"skip\" : \"open, \"a\" : 1}",	// Unterminated string
+		"{\"skip\" : [[1]}",				// Unterminated object
+	};
+	JSON_Value * json;
+	JSON_Object * o;
+	int calls = 0;
+	size_t i;
+
+	json = json_parse_stringn_filtered(source, strlen(source), JSONParseArena, test_filter, &calls);
+	CuAssertPtrNotNull(tc, json);
+
+	o = json_value_get_object(json);
+	CuAssertIntEquals(tc, 2, (int) json_object_get_count(o));
+
+	// Nested objects are filtered too (escaped keys are decoded first)
+	CuAssertIntEquals(tc, 1, (int) json_object_get_count(json_object_get_object(o, "a")));
+	CuAssertDblEquals(tc, 1, json_object_dotget_number(o, "a.a"), 0);
+
+	// ...except below a key kept in full
+	CuAssertIntEquals(tc, 1, json_object_dotget_boolean(o, "raw.b.c"));
+
+	// Skipped values aren't looked at
+	CuAssertIntEquals(tc, 9, calls);
+
+	json_value_free(json);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		CuAssertPtrEquals(tc, NULL, json_parse_stringn_filtered(invalid[i], strlen(invalid[i]), JSONParseArena, test_filter, &calls));
+	}
+}
+
+void Test_json_comments(CuTest * tc) {
+	const char * source = "// Settings\n/* start */ {\"a\" /* name */ : [1, /* [\"x\"} */ 2] // \"c\" : 3\n, "
+		"\"url\" : \"http://x/*y*/\", \"skip\" : {\"b\" : /* } */ [3] //\n}, \"n\" : 4 /**/}// end";
+	const char * invalid[] = {
+		"{\"a\" : 1 /* unterminated }",
+		"{\"a\" : / 1}",
+		"{\"skip\" : [1 / 2], \"a\" : 1}",
+		"{\"skip\" : [1 /* ] */, \"a\" : 1}",
+	};
+	JSON_Value * json;
+	JSON_Object * o;
+	int calls = 0;
+	size_t i;
+
+	// Strict parsing rejects comments
+	CuAssertPtrEquals(tc, NULL, json_parse_string(source));
+
+	json = json_parse_stringn_with_flags(source, strlen(source), JSONParseComments);
+	CuAssertPtrNotNull(tc, json);
+	o = json_value_get_object(json);
+	CuAssertIntEquals(tc, 4, (int) json_object_get_count(o));
+	CuAssertIntEquals(tc, 2, (int) json_array_get_count(json_object_get_array(o, "a")));
+	CuAssertStrEquals(tc, "http://x/*y*/", json_object_get_string(o, "url"));
+	CuAssertDblEquals(tc, 4, json_object_get_number(o, "n"), 0);
+	json_value_free(json);
+
+	json = json_parse_string_with_comments(source);
+	CuAssertPtrNotNull(tc, json);
+	CuAssertDblEquals(tc, 4, json_object_get_number(json_object(json), "n"), 0);
+	json_value_free(json);
+
+	// Skipped values can contain comments too
+	json = json_parse_stringn_filtered(source, strlen(source), JSONParseArena | JSONParseComments, test_filter, &calls);
+	CuAssertPtrNotNull(tc, json);
+	CuAssertIntEquals(tc, 1, (int) json_object_get_count(json_object(json)));
+	json_value_free(json);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		CuAssertPtrEquals(tc, NULL, json_parse_stringn_with_flags(invalid[i], strlen(invalid[i]), JSONParseComments));
+		CuAssertPtrEquals(tc, NULL, json_parse_stringn_filtered(invalid[i], strlen(invalid[i]), JSONParseComments, test_filter, &calls));
+	}
+}
 #endif
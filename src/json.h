@@ -46,6 +46,7 @@
 #ifndef JSON_DRYDOCK_H
 #define JSON_DRYDOCK_H
 
+#include "file.h"
 #include "parson.h"
 
 #ifdef TEST
@@ -63,4 +64,13 @@ JSON_Value * json_from_string(const char * string);
 JSON_Value * json_from_file(const char * fname);
 
 
+/// Load JSON from file, parsing in place in a private writable mapping so
+/// that strings aren't copied.  `map` must stay open until the JSON_Value
+/// has been freed, and then closed with `file_map_close()`.  `flags` are
+/// additional `json_parse_flags_t` (e.g. `JSONParseTrusted`).  If `filter`
+/// isn't NULL, only the object members it keeps are built (see
+/// `json_parse_stringn_filtered()`).
+JSON_Value * json_from_file_in_situ(const char * fname, file_map * map, int flags, JSON_Key_Filter filter, void * context);
+
+
 #endif
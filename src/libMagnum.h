@@ -73,21 +73,231 @@
 #ifndef LIBMAGNUM_MAGNUM_H
 #define LIBMAGNUM_MAGNUM_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 /// From d_string.h:
 typedef struct DString DString;
 
 // From parson.h
 typedef struct json_value_t  JSON_Value;
 
+// From tape.h
+typedef struct json_tape json_tape;
+
+// From stream.h
+typedef struct json_stream json_stream;
+
 
 typedef struct closure closure;
 
+
+/// Set of object keys that templates can look up (see `magnum_keys_new()`)
+typedef struct magnum_keys magnum_keys;
+
+
+/// Types of data value (the same values as parson's `JSON_Value_Type`)
+enum magnum_value_types {
+	MAGNUM_VALUE_NONE = -1,				//!< Not a value (e.g. a member that wasn't found)
+	MAGNUM_VALUE_NULL = 1,
+	MAGNUM_VALUE_STRING,
+	MAGNUM_VALUE_NUMBER,
+	MAGNUM_VALUE_OBJECT,
+	MAGNUM_VALUE_ARRAY,
+	MAGNUM_VALUE_BOOLEAN,
+};
+
+
+/// A data value, as identified by a `magnum_provider`.  What the fields mean
+/// is up to the provider (e.g. `ptr` could point to a struct, and `index`
+/// select one of its fields).  A NULL `ptr` means there is no value.
+typedef struct magnum_value {
+	const void *	ptr;
+	size_t			index;
+} magnum_value;
+
+
+/// Callbacks that let templates be rendered from data held in any form (e.g.
+/// native structs), without building a JSON tree first.  `context` is passed
+/// through unchanged, and values passed to the callbacks were returned by
+/// the same provider (never with a NULL `ptr`).
+typedef struct magnum_provider {
+	/// Type of `value` -- one of `magnum_value_types`
+	int (*type)(void * context, magnum_value value);
+
+	/// Member of `object` named by the `len` bytes of `name` (never containing
+	/// `.`), or a value with NULL `ptr` if `object` isn't an object or has no
+	/// such member
+	magnum_value (*member)(void * context, magnum_value object, const char * name, size_t len);
+
+	/// Contents of a string (not necessarily NUL-terminated), with its length in `len`
+	const char * (*string)(void * context, magnum_value value, size_t * len);
+
+	/// Value of a number
+	double (*number)(void * context, magnum_value value);
+
+	/// Value of a boolean (non-zero for true)
+	int (*boolean)(void * context, magnum_value value);
+
+	/// First element of an array, or member of an object (NULL `ptr` if empty)
+	magnum_value (*first)(void * context, magnum_value container);
+
+	/// Element or member after `item` (which was returned by `first()` or
+	/// `next()` for `container`), or a value with NULL `ptr` after the last
+	magnum_value (*next)(void * context, magnum_value container, magnum_value item);
+
+	/// Name of member `item` of `object` (as returned by `first()` or
+	/// `next()`), not necessarily NUL-terminated, with its length in `len`
+	const char * (*name)(void * context, magnum_value object, magnum_value item, size_t * len);
+} magnum_provider;
+
+
+/// How `{{name}}` tags are escaped (`{{{name}}}` and `{{&name}}` are never
+/// escaped)
+enum magnum_escape_modes {
+	MAGNUM_ESCAPE_HTML = 0,				//!< `<`, `>`, `&`, `"` (default)
+	MAGNUM_ESCAPE_NONE,					//!< No escaping
+	MAGNUM_ESCAPE_XML_ATTRIBUTE,		//!< `<`, `>`, `&`, `"`, `'`, tab, CR, LF
+	MAGNUM_ESCAPE_JSON,					//!< Contents of a JSON string (without the quotes)
+	MAGNUM_ESCAPE_URL,					//!< Percent-encode all but RFC 3986 unreserved characters
+	MAGNUM_ESCAPE_CSV,					//!< CSV field, quoted only when necessary
+	MAGNUM_ESCAPE_CUSTOM,				//!< Use `escape_table` (HTML escaping if it is NULL)
+};
+
+
+/// How numbers are formatted
+enum magnum_number_formats {
+	MAGNUM_NUMBER_LEGACY = 0,			//!< 6 decimals above 1, 15 otherwise, trailing zeros removed (default)
+	MAGNUM_NUMBER_SHORTEST,				//!< Shortest string that round trips to the same value
+	MAGNUM_NUMBER_FIXED,				//!< Exactly `number_decimals` decimal places
+};
+
+
+/// How numbers are formatted in `{{$name}}` (raw JSON) output
+enum magnum_raw_number_formats {
+	MAGNUM_RAW_NUMBER_PRECISE = 0,		//!< 17 significant digits, as `%1.17g` (default)
+	MAGNUM_RAW_NUMBER_SHORTEST,			//!< Shortest string that round trips to the same value
+};
+
+
+/// Running estimate of a template's output size, kept by the caller between
+/// renders of the same template.  Zero-initialize before the first render.
+/// Every render that uses an estimate updates it, so an estimate must not be
+/// used by more than one render at a time -- give each thread its own.
+typedef struct magnum_estimate {
+	size_t					output;			//!< Expected bytes of output
+	size_t					renders;		//!< Number of renders recorded so far
+} magnum_estimate;
+
+
+/// Record the size of a finished render in `estimate` (called automatically
+/// when `estimate` is set in `magnum_options`)
+void magnum_estimate_update(magnum_estimate * estimate, size_t output);
+
+
+/// Settings for a single render.  Zero-initialize for the default behavior:
+///
+///		magnum_options options = {0};
+///
+/// Options are only read, so they can be shared by renders on different
+/// threads -- unless `estimate` is set, since the estimate is written to.
+typedef struct magnum_options {
+	int						escape_mode;	//!< One of `magnum_escape_modes`
+	const char * const *	escape_table;	//!< 256 replacement strings, indexed by byte, for `MAGNUM_ESCAPE_CUSTOM` -- NULL entries are copied as is
+	int						number_format;	//!< One of `magnum_number_formats`
+	int						number_decimals;	//!< Decimal places for `MAGNUM_NUMBER_FIXED` (0-20)
+	int						raw_number_format;	//!< One of `magnum_raw_number_formats`
+	magnum_estimate *		estimate;		//!< If not NULL, `out` is presized from this estimate, which is then updated with the size of this render (not used when streaming output to a file).  Not safe to share between threads.
+} magnum_options;
+
+
 /// Given a source string, populate it using data from a JSON value.
 /// The resulting text will be appended to `out`.
 /// Pass NULL as `load_p` to use the default load_partial function.
 int magnum_populate_from_json(DString * source, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **));
 
 
+/// Given a source string, populate it using data from a JSON value and the
+/// specified options (NULL for the defaults).
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_from_json_with_options(DString * source, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using data from a JSON value and the
+/// specified options (NULL for the defaults).
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_json(const char * source, size_t source_len, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_json()`, but using data from a read-only
+/// tape (see `json_tape_new()`), which is faster to search and iterate.
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_tape(const char * source, size_t source_len, const json_tape * tape, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_json()`, but the data is reached through
+/// `provider` (which is passed `context`), starting from `root`.
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_provider(const char * source, size_t source_len, const magnum_provider * provider, void * context, magnum_value root, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_json()`, but with `count` roots (at least
+/// one, and fewer than 256).  Names that aren't found within the current
+/// sections are looked up in each root in turn, from `roots[count - 1]` back
+/// to `roots[0]` -- e.g. shared configuration in `roots[0]`, and the data for
+/// a single request in `roots[1]` to override it.  `{{.}}` outside of any
+/// section is the last root.  The roots are never copied or modified, so a
+/// shared root can be used by several renders at once (e.g. on different
+/// threads).
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_json_layers(const char * source, size_t source_len, JSON_Value * const * roots, size_t count, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_json_layers()`, but the roots are reached
+/// through `provider` (which is passed `context`).
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_provider_layers(const char * source, size_t source_len, const magnum_provider * provider, void * context, const magnum_value * roots, size_t count, DString * out, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_json()`, but using data from a top-level
+/// JSON array that is read from `stream` (see `json_stream_new()`) as it is
+/// rendered.  The first top-level `{{#.}}` section parses each element in
+/// turn, renders its body, and frees it, so memory use is proportional to a
+/// single element.  The array can only be iterated once -- a later top-level
+/// `{{#.}}` or `{{^.}}` stops rendering with an error -- and other references
+/// to the root see no data.  If `flush` isn't NULL, output is written to it
+/// (and removed from `out`) as elements are finished.
+/// The resulting text will be appended to `out`.
+/// Pass NULL as `load_p` to use the default load_partial function.
+int magnum_populate_buffer_from_stream(const char * source, size_t source_len, json_stream * stream, DString * out, FILE * flush, const char * search_directory, int (*load_p)(char *, DString *, closure *, char **), const magnum_options * options);
+
+
+/// Given a source buffer of `source_len` bytes, populate it using data from a
+/// JSON buffer of `json_len` bytes.  Neither needs to be NUL-terminated, so
+/// they can be slices of larger buffers, memory mapped files, etc.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_string(const char * source, size_t source_len, const char * json, size_t json_len, DString * out, const char * search_directory, const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_string()`, but the data is a MessagePack
+/// buffer of `data_len` bytes (see `json_tape_from_msgpack()`).
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_msgpack(const char * source, size_t source_len, const char * data, size_t data_len, DString * out, const char * search_directory, const magnum_options * options);
+
+
+/// As `magnum_populate_buffer_from_string()`, but the data is a CBOR buffer of
+/// `data_len` bytes (see `json_tape_from_cbor()`).
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_cbor(const char * source, size_t source_len, const char * data, size_t data_len, DString * out, const char * search_directory, const magnum_options * options);
+
+
 /// Given a source string, populate it using data from a JSON string.
 /// The resulting text will be appended to `out`.
 int magnum_populate_from_string(DString * source, const char * string, DString * out, const char * search_directory);
@@ -103,6 +313,28 @@ int magnum_populate_from_string_custom_partial(DString * source, const char * st
 int magnum_populate_from_file(DString * source, const char * fname, DString * out, const char * search_directory);
 
 
+/// Create an empty set of keys.  Add the templates that will be rendered with
+/// `magnum_keys_add_template()`, then parse the data with
+/// `json_parse_stringn_filtered()`, passing `magnum_keys_filter` and the set,
+/// to build only the parts of the JSON document that those templates can use.
+magnum_keys * magnum_keys_new(void);
+
+
+/// Add the keys used by the template in `source` (and by any partials it
+/// loads from `search_directory`).  Returns 0 on success, or -1 if the
+/// template couldn't be fully scanned.
+int magnum_keys_add_template(magnum_keys * keys, const char * source, size_t source_len, const char * search_directory);
+
+
+/// `JSON_Key_Filter` for `json_parse_stringn_filtered()` -- `context` is a
+/// `magnum_keys *`
+int magnum_keys_filter(const char * key, size_t key_len, void * context);
+
+
+/// Free a set of keys
+void magnum_keys_free(magnum_keys * keys);
+
+
 /// Simplified method to allow use without any other included files.
 /// Useful if you have no other need for parson or d_string
 int magnum_populate_char_only(const char * source, const char * string, char ** out, const char * search_directory);
@@ -66,10 +66,18 @@
 #include <string.h>
 
 #include "d_string.h"
+#include "decode.h"
+#include "escape.h"
 #include "file.h"
 #include "json.h"
 #include "libMagnum.h"
+#include "number.h"
 #include "parson.h"
+#include "provider.h"
+#include "scanner.h"
+#include "serialize.h"
+#include "stream.h"
+#include "tape.h"
 
 
 #ifdef TEST
@@ -79,7 +87,7 @@
 
 #define kMaxKeyLength			1024
 #define kMaxDepth				256
-#define kMaxDelimiterLength		16
+#define kFlushThreshold			(64 * 1024)
 
 #if !defined(MAX)
 	#define MAX(A,B) ((A) >= (B) ? (A) : (B))
@@ -92,19 +100,32 @@
 
 /// Track JSON data and pointer to current object
 struct closure {
-	JSON_Value 	*	root;		//!< Root data value
+	const magnum_provider *	provider;	//!< Access to the data
+	void *				context;	//!< Passed to `provider`
+	json_stream *		stream;		//!< Root array, read one element at a time by `{{#.}}`
+	JSON_Value *		streamed;	//!< Current element of `stream`
+	int					stream_used;	//!< `stream` has been (at least partly) read
+	int					stream_reused;	//!< The root was used again after `stream` was read -- stops rendering
+	FILE *				flush;		//!< Write output here as each streamed element is finished
 	int					depth;		//!< Depth in stack
+	int					base;		//!< Depth of the innermost root (`stack[0...base]` hold the roots)
 	DString 	*		out;		//!< Output destination
 
 	const char 	*	directory;	//!< Initial search directory for partials
 
+	int					escape_mode;	//!< How `{{name}}` is escaped
+	const char * const * escape_table;	//!< Replacements for MAGNUM_ESCAPE_CUSTOM
+	int					number_format;	//!< How numbers are formatted
+	int					number_decimals;	//!< Decimal places for MAGNUM_NUMBER_FIXED
+	int					raw_number_format;	//!< How numbers are formatted by `{{$name}}`
+	magnum_estimate *	estimate;	//!< Presize `out` from (and update) this estimate
+
 	int (*load_partial)(char *, DString *, struct closure *, char **);
 
 	struct {
-		JSON_Value *	container;
-		JSON_Value *	val;
-		int				index;
-		int				count;
+		magnum_value	container;		//!< Array being iterated (NULL `ptr` if none)
+		magnum_value	val;
+		int				streamed;		//!< Iterating over `stream`
 	} stack[kMaxDepth];
 };
 
@@ -125,68 +146,101 @@ static char * my_strdup(const char * source) {
 }
 
 
+/// Type of `v`, which may be missing
+static int value_type(struct closure * c, magnum_value v) {
+	return v.ptr ? c->provider->type(c->context, v) : MAGNUM_VALUE_NONE;
+}
+
+
+/// Value at dotted path `name` (e.g. `a.b.c`) within `object`
+static magnum_value dotget(struct closure * c, magnum_value object, const char * name) {
+	const char * dot;
+
+	while (object.ptr && ((dot = strchr(name, '.')) != NULL)) {
+		object = c->provider->member(c->context, object, name, dot - name);
+		name = dot + 1;
+	}
+
+	if (object.ptr == NULL) {
+		return object;
+	}
+
+	return c->provider->member(c->context, object, name, strlen(name));
+}
+
+
 // Resolve `name` to find the proper value
-static JSON_Value * find(struct closure * c, const char * name) {
-	JSON_Object * o;
-	JSON_Value * v = NULL;
+static magnum_value find(struct closure * c, const char * name) {
+	magnum_value v;
 	int i;
 
 	if (name[0] == '.' && name[1] == '\0') {
 		// {{.}} means we use the current value
-		v = c->stack[c->depth].val;
-	} else {
-		// Break name into key/value
-
-		// Iterate
-		i = c->depth;
-		v = c->stack[i].val;
-		o = json_value_get_object(v);
-
-		while (i > 0 && !(json_object_dothas_value(o, name))) {
-			i--;
-			v = c->stack[i].val;
+		return c->stack[c->depth].val;
+	}
 
-			if (v) {
-				o = json_value_get_object(v);
-			}
-		}
+	// Search from the innermost context outward
+	for (i = c->depth; i > 0; i--) {
+		v = dotget(c, c->stack[i].val, name);
 
-		// Not found
-		if (i < 0) {
-			return NULL;
+		if (v.ptr) {
+			return v;
 		}
-
-		v = json_object_dotget_value(o, name);
 	}
 
-	return v;
+	return dotget(c, c->stack[0].val, name);
 }
 
 
 // Indent each line of partial
+//
+// Each line ending (`\n`, `\r\n`, or `\r`) is followed by `indent`.  The
+// text is shifted in place, working back from the end, so nothing is
+// allocated beyond growing `text` once.
 void indent_text(DString * text, const char * indent, size_t indent_len) {
-	if (indent && indent_len) {
-		DString * replace = d_string_new("");
-		d_string_append_c_array(replace, indent, indent_len);
+	size_t len = text->currentStringLength;
+	size_t count = 0;
+	size_t added;
+	char next = '\0';
+	char * s, * dest;
+	size_t i;
+
+	if ((indent == NULL) || (indent_len == 0)) {
+		return;
+	}
+
+	s = text->str;
+
+	for (i = 0; i < len; i++) {
+		if ((s[i] == '\n') || ((s[i] == '\r') && ((i + 1 == len) || (s[i + 1] != '\n')))) {
+			count++;
+		}
+	}
 
-		// Preserve Windows line endings
-		d_string_replace_text_in_range(text, 0, -1, "\r\n", "!!MAGNUMWINDOWSLINEENDING!!");
+	if (count == 0) {
+		return;
+	}
 
-		// Mac Classic line endings
-		d_string_prepend(replace, "\r");
-		d_string_replace_text_in_range(text, 0, -1, "\r", replace->str);
+	added = count * indent_len;
+	d_string_reserve(text, added);
+	s = text->str;
+	dest = s + len + added;
+	*dest = '\0';
 
-		// Unix line endings
-		d_string_erase(replace, 0, 1);
-		d_string_prepend(replace, "\n");
-		d_string_replace_text_in_range(text, 0, -1, "\n", replace->str);
+	// Stop once everything left is already in place
+	for (i = len; count > 0; next = s[i]) {
+		i--;
 
-		// Windows line endings
-		d_string_prepend(replace, "\r");
-		d_string_replace_text_in_range(text, 0, -1, "!!MAGNUMWINDOWSLINEENDING!!", replace->str);
+		if ((s[i] == '\n') || ((s[i] == '\r') && (next != '\n'))) {
+			dest -= indent_len;
+			memcpy(dest, indent, indent_len);
+			count--;
+		}
 
-		d_string_free(replace, true);
+		*--dest = s[i];
 	}
+
+	text->currentStringLength = len + added;
 }
 
 
@@ -225,6 +279,7 @@ static int load_partial(char * name, DString * partial, struct closure * c, char
 	free(partial->str);
 	partial->str = load->str;
 	partial->currentStringLength = load->currentStringLength;
+	partial->currentStringBufferSize = load->currentStringBufferSize;
 
 	d_string_free(load, false);
 
@@ -232,245 +287,174 @@ static int load_partial(char * name, DString * partial, struct closure * c, char
 }
 
 
-// Print raw JSON
-static int print_raw(const char * name, struct closure * closure) {
-	JSON_Value * v = find(closure, name);
-
-	if (v) {
-		char * string = json_serialize_to_string(v);
-		char * c = string;
-
-		if (*c == '"') {
-			c++;
-
-			string[strlen(string) - 1] = '\0';
-		}
-
-		while (*c) {
-			switch (*c) {
-				case '\"':
-					d_string_append_c(closure->out, '\\');
-					d_string_append_c(closure->out, '\"');
-					break;
-
-				case '\\':
-					if (*++c == '/') {
-
-					} else {
-						d_string_append_c(closure->out, '\\');
-					}
-
-				default:
-					d_string_append_c(closure->out, *c);
-					break;
-			}
-
-			if (*c) {
-				c++;
-			}
-		}
+/// Append `v` to `out` as compact JSON, in a single pass.  Quotes are
+/// escaped (`\"`) so that the result can be embedded in a quoted string, and
+/// a top-level string is printed without quotes.  `format` is one of the
+/// `magnum_raw_number_formats`.
+static void print_raw_value(DString * out, const magnum_provider * provider, void * context, magnum_value v, int format) {
+	const char * s;
+	size_t len;
 
-		free(string);
+	if (v.ptr && (provider->type(context, v) == MAGNUM_VALUE_STRING)) {
+		s = provider->string(context, v, &len);
+		escape_append(out, s, len, MAGNUM_ESCAPE_JSON, NULL);
+	} else if (format == MAGNUM_RAW_NUMBER_SHORTEST) {
+		serialize_value(out, provider, context, v, "\\\"");
+	} else {
+		serialize_value_precise(out, provider, context, v, "\\\"");
 	}
-
-	return 0;
 }
 
 
-// Formatting routines from https://stackoverflow.com/questions/277772/avoid-trailing-zeroes-in-printf
-
-void morphNumericString (char * s, int n) {
-	char * p;
-	int count;
-
-	p = strchr (s, '.');			// Find decimal point, if any.
+// Print raw JSON
+static int print_raw(const char * name, struct closure * closure) {
+	print_raw_value(closure->out, closure->provider, closure->context, find(closure, name), closure->raw_number_format);
 
-	if (p != NULL) {
-		count = n;					// Adjust for more or less decimals.
+	return 0;
+}
 
-		while (count >= 0) {		// Maximum decimals allowed.
-			count--;
 
-			if (*p == '\0') {		// If there's less than desired.
-				break;
-			}
+#ifdef TEST
+void Test_print_raw(CuTest * tc) {
+	DString * out = d_string_new("");
+	JSON_Value * v = json_parse_string("{\"a/b\" : [1, 2.5, -1e-7, true, false, null, {}, []], \"s\" : \"q\\\"b\\\\s\\/\\n\\u0001\\t\xc3\xa9\"}");
 
-			p++;					// Next character.
-		}
+	print_raw_value(out, &json_value_provider, NULL, json_value_provider_root(v), MAGNUM_RAW_NUMBER_PRECISE);
+	CuAssertStrEquals(tc, "{\\\"a/b\\\":[1,2.5,-9.9999999999999995e-08,true,false,null,{},[]],\\\"s\\\":\\\"q\\\"b\\\\s/\\n\\u0001\\t\xc3\xa9\\\"}", out->str);
+	d_string_erase(out, 0, -1);
 
-		*p-- = '\0';				// Truncate string.
+	// Shortest numbers are opt-in
+	print_raw_value(out, &json_value_provider, NULL, json_value_provider_root(v), MAGNUM_RAW_NUMBER_SHORTEST);
+	CuAssertStrEquals(tc, "{\\\"a/b\\\":[1,2.5,-1e-7,true,false,null,{},[]],\\\"s\\\":\\\"q\\\"b\\\\s/\\n\\u0001\\t\xc3\xa9\\\"}", out->str);
+	d_string_erase(out, 0, -1);
 
-		while (*p == '0') {			// Remove trailing zeros.
-			*p-- = '\0';
-		}
+	// Top level strings are not quoted
+	print_raw_value(out, &json_value_provider, NULL, json_value_provider_root(json_object_get_value(json_object(v), "s")), MAGNUM_RAW_NUMBER_PRECISE);
+	CuAssertStrEquals(tc, "q\\\"b\\\\s/\\n\\u0001\\t\xc3\xa9", out->str);
 
-		if (*p == '.') {			// If all decimals were zeros, remove ".".
-			*p = '\0';
-		}
-	}
+	json_value_free(v);
+	d_string_free(out, true);
 }
+#endif
 
 
-/// Round to this many decimal places
-void nDecimals (char * s, double d, int n) {
-	int sz;
-	double d2;
+/// Replace designated range in source with value of `name`
+static int print(const char * name, struct closure * c, int escape) {
+	magnum_value v = find(c, name);
+	const char * s;
+	size_t len;
 
-	// Allow for negative.
+	switch (value_type(c, v)) {
+		case MAGNUM_VALUE_STRING:
+			s = c->provider->string(c->context, v, &len);
 
-	d2 = (d >= 0) ? d : -d;
-	sz = (d >= 0) ? 0 : 1;
+			if (escape) {
+				escape_append(c->out, s, len, c->escape_mode, c->escape_table);
+			} else {
+				d_string_append_c_array(c->out, s, len);
+			}
 
-	// Add one for each whole digit (0.xx special case).
+			break;
 
-	if (d2 < 1) {
-		sz++;
-	}
+		case MAGNUM_VALUE_NUMBER:
+			number_append(c->out, c->provider->number(c->context, v), c->number_format, c->number_decimals);
+			break;
 
-	while (d2 >= 1) {
-		d2 /= 10.0;
-		sz++;
+		default:
+			break;
 	}
 
-	// Adjust for decimal point and fractionals.
-
-	sz += 1 + n;
-
-	// Create format string then use it.
-
-	sprintf (s, "%*.*f", sz, n, d);
+	return 0;
 }
 
 
-/// Clean up double numbers for printing -- should be reasonable for "normal" numbers,
-/// but obviously some scientific uses may have difficulty
-void print_double(DString * out, double value) {
-	char buf[50];
-
-	if (value > 1.0 ) {
-		// "Big" numbers use max of 10 decimals
-
-		// First, trim to 10 decimals -- TODO: Should this be fixed decimal place?  Total number of digits?
-		nDecimals(buf, value, 6);
+/// Write finished output to `flush` -- everything but trailing spaces and tabs,
+/// which a standalone tag could still remove
+static void flush_output(struct closure * c) {
+	size_t len = c->out->currentStringLength;
 
-		// Clean up
-		morphNumericString(buf, 6);
-	} else {
-		// "Small" numbers use more
+	if ((c->flush == NULL) || (len < kFlushThreshold)) {
+		return;
+	}
 
-		nDecimals(buf, value, 15);
-		morphNumericString(buf, 15);
+	while (len && ((c->out->str[len - 1] == ' ') || (c->out->str[len - 1] == '\t'))) {
+		len--;
 	}
 
-	// Append it
-	d_string_append(out, buf);
+	fwrite(c->out->str, 1, len, c->flush);
+	d_string_erase(c->out, 0, len);
 }
 
 
-#ifdef TEST
-void Test_print_double(CuTest * tc) {
-	DString * out = d_string_new("");
-	double d = 1234567890123456;
-
-	print_double(out, d);
-	CuAssertStrEquals(tc, "1234567890123456", out->str);
-	d_string_erase(out, 0, -1);
-
-	d = 3.1415926535897932384626433832795028841971693993751058209749445923;
-	print_double(out, d);
-	CuAssertStrEquals(tc, "3.141593", out->str);
-	d_string_erase(out, 0, -1);
+/// Start iterating over the streamed root array
+static int stream_enter(struct closure * c) {
+	JSON_Value * v = json_stream_next(c->stream);
 
+	if (v == NULL) {
+		return json_stream_error(c->stream) ? -1 : 0;
+	}
 
-	d = 0.000004999000004999;
-	print_double(out, d);
-	CuAssertStrEquals(tc, "0.000004999000005", out->str);
-	d_string_erase(out, 0, -1);
+	if (c->depth + 1 == kMaxDepth) {
+		json_value_free(v);
+		return -1;
+	}
 
-	d = 0.000004999000000000;
-	print_double(out, d);
-	CuAssertStrEquals(tc, "0.000004999", out->str);
-	d_string_erase(out, 0, -1);
+	c->depth++;
+	c->stack[c->depth].container = json_value_provider_root(NULL);
+	c->stack[c->depth].val = json_value_provider_root(v);
+	c->stack[c->depth].streamed = 1;
+	c->streamed = v;
 
-	d_string_free(out, true);
+	return 1;
 }
-#endif
 
 
-/// Replace designated range in source with value of `name`
-static int print(const char * name, struct closure * c, int escape) {
-	JSON_Value * v = find(c, name);
-	const char * s;
-
-	if (v) {
-		switch (json_value_get_type(v)) {
-			case JSONString:
-				if (escape) {
-					s = json_value_get_string(v);
-
-					do {
-						switch (*s) {
-							case '>':
-								d_string_append_c_array(c->out, "&gt;", 4);
-								break;
-
-							case '<':
-								d_string_append_c_array(c->out, "&lt;", 4);
-								break;
-
-							case '&':
-								d_string_append_c_array(c->out, "&amp;", 5);
-								break;
-
-							case '\"':
-								d_string_append_c_array(c->out, "&quot;", 6);
-								break;
-
-							case '\0':
-								// Empty string
-								s--;
-								break;
-
-							default:
-								d_string_append_c(c->out, *s);
-								break;
-						}
-					} while (*++s);
-				} else {
-					d_string_append(c->out, json_value_get_string(v));
-				}
+/// Replace the current element of the streamed root array with the next one
+static int stream_next(struct closure * c) {
+	json_value_free(c->streamed);
+	c->streamed = NULL;
+	c->stack[c->depth].val = json_value_provider_root(NULL);
 
-				break;
+	flush_output(c);
 
-			case JSONNumber:
-				print_double(c->out, json_value_get_number(v));
-				break;
+	c->streamed = json_stream_next(c->stream);
 
-			default:
-				break;
-		}
+	if (c->streamed == NULL) {
+		return json_stream_error(c->stream) ? -1 : 0;
 	}
 
-	return 0;
+	c->stack[c->depth].val = json_value_provider_root(c->streamed);
+
+	return 1;
 }
 
 
 // Iterate to next instance of array
 static int json_next(struct closure * c) {
-	if (c->depth <= 0) {
+	magnum_value v;
+
+	if (c->depth <= c->base) {
 		return -1;
 	}
 
-	c->stack[c->depth].index++;
+	if (c->stack[c->depth].streamed) {
+		return stream_next(c);
+	}
+
+	if (c->stack[c->depth].container.ptr == NULL) {
+		// Not an array
+		return 0;
+	}
 
-	if (c->stack[c->depth].index >= c->stack[c->depth].count) {
+	v = c->provider->next(c->context, c->stack[c->depth].container, c->stack[c->depth].val);
+
+	if (v.ptr == NULL) {
 		// Last one
 		return 0;
 	}
 
 	// Move to next item in array
-	JSON_Array * a = json_value_get_array(c->stack[c->depth].container);
-	c->stack[c->depth].val = json_array_get_value(a, c->stack[c->depth].index);
+	c->stack[c->depth].val = v;
 
 	return 1;
 }
@@ -478,10 +462,16 @@ static int json_next(struct closure * c) {
 
 // Move up one level in the object hierarchy
 static int json_leave(struct closure * c) {
-	if (c->depth <= 0) {
+	if (c->depth <= c->base) {
 		return -1;
 	}
 
+	if (c->stack[c->depth].streamed) {
+		json_value_free(c->streamed);
+		c->streamed = NULL;
+		c->stack[c->depth].streamed = 0;
+	}
+
 	c->depth--;
 
 	return 0;
@@ -489,81 +479,76 @@ static int json_leave(struct closure * c) {
 
 
 static int json_enter(const char * name, struct closure * c) {
-	JSON_Value * v = find(c, name);
-	JSON_Array * a;
+	magnum_value v, container = {NULL, 0};
 
-	if (c->depth == kMaxDepth) {
-		return -1;
-	}
+	if (c->stream && (c->depth == c->base) && (strcmp(name, ".") == 0)) {
+		// The root array is iterated as it is read, so it can only be used once
+		if (c->stream_used) {
+			c->stream_reused = 1;
+			return -1;
+		}
 
-	if (v == NULL) {
-		return 0;
+		c->stream_used = 1;
+
+		return stream_enter(c);
 	}
 
-	c->depth++;
+	v = find(c, name);
+
+	if (c->depth + 1 == kMaxDepth) {
+		return -1;
+	}
 
-	switch (json_value_get_type(v)) {
-		case JSONArray:
-			a = json_value_get_array(v);
-			c->stack[c->depth].count = json_array_get_count(a);
+	switch (value_type(c, v)) {
+		case MAGNUM_VALUE_ARRAY:
+			container = v;
+			v = c->provider->first(c->context, container);
 
-			if (c->stack[c->depth].count == 0) {
+			if (v.ptr == NULL) {
 				// Nothing to do
-				c->depth--;
 				return 0;
 			}
 
-			c->stack[c->depth].container = v;
-			c->stack[c->depth].val = json_array_get_value(a, 0);
-			c->stack[c->depth].index = 0;
 			break;
 
-		case JSONBoolean:
-			if (!json_value_get_boolean(v)) {
-				c->depth--;
+		case MAGNUM_VALUE_BOOLEAN:
+			if (!c->provider->boolean(c->context, v)) {
 				return 0;
 			}
 
-			c->stack[c->depth].count = 1;
-			c->stack[c->depth].container = NULL;
-			c->stack[c->depth].val = v;
-			c->stack[c->depth].index = 0;
 			break;
 
-		case JSONNumber:
-			if (!json_value_get_number(v)) {
-				c->depth--;
+		case MAGNUM_VALUE_NUMBER:
+			if (!c->provider->number(c->context, v)) {
 				return 0;
 			}
 
-			c->stack[c->depth].count = 1;
-			c->stack[c->depth].container = NULL;
-			c->stack[c->depth].val = v;
-			c->stack[c->depth].index = 0;
 			break;
 
-		case JSONString:
-		case JSONObject:
-			c->stack[c->depth].count = 1;
-			c->stack[c->depth].container = NULL;
-			c->stack[c->depth].val = v;
-			c->stack[c->depth].index = 0;
+		case MAGNUM_VALUE_STRING:
+		case MAGNUM_VALUE_OBJECT:
 			break;
 
 		default:
-			c->depth--;
 			return 0;
 	}
 
+	c->depth++;
+	c->stack[c->depth].container = container;
+	c->stack[c->depth].val = v;
+	c->stack[c->depth].streamed = 0;
+
 	return 1;
 }
 
 
-static int parse(DString * source, const char * opener, const char * closer, struct closure * closure, const char * search_directory) {
+static int parse(const char * source, size_t source_len, const char * opener, const char * closer, struct closure * closure, const char * search_directory) {
 	if (source == NULL) {
 		return -1;
 	}
 
+	const char * source_end = source + source_len;
+
 	int rc = 0;
 
 	const char * start, * stop, * key;
@@ -572,7 +557,7 @@ static int parse(DString * source, const char * opener, const char * closer, str
 	struct {
 		const char *	key;
 		size_t			key_len;
-		const char  *	again;
+		size_t			again;
 		int 			entered;
 		int				visible;
 	} stack[kMaxDepth];
@@ -582,20 +567,12 @@ static int parse(DString * source, const char * opener, const char * closer, str
 
 	char c;
 
-	char op[kMaxDelimiterLength + 1] = {0};
-	char cl[kMaxDelimiterLength + 1] = {0};
-
-	strncpy(op, opener, MIN(kMaxDelimiterLength, strlen(opener)));
-	strncpy(cl, closer, MIN(kMaxDelimiterLength, strlen(opener)));
-
-	size_t open_len = strlen(op);
-	size_t close_len = strlen(cl);
+	scanner_index index;
+	size_t t;
 
 	char key_name[kMaxKeyLength + 1];
 	size_t key_len;
 
-	size_t l;
-
 	DString * partial;
 	char * dir;
 	const char * indent;
@@ -603,50 +580,46 @@ static int parse(DString * source, const char * opener, const char * closer, str
 
 	int standalone;
 
-	// Find first tag
-	start = strstr(source->str, op);
-	stop = source->str;
+	// Find all tags in one pass
+	scanner_index_tags(&index, source, source_len, opener, closer);
+
+	stop = source;
+
+	for (t = 0; t < index.count; t++) {
+		start = source + index.tags[t].start;
 
-	while (start) {
 		// Copy anything before tag
 		if (visible) {
 			d_string_append_c_array(closure->out, stop, start - stop);
 		}
 
-		// Find end of tag
-		stop = strstr(start + open_len, cl);
-
-		if (stop == NULL) {
-			// No end to this possible tag
-			return -1;
-		}
-
 		// Is this a "standalone" tag? (e.g. on a line by itself)
 		standalone = 0;
 		key = start;
 
-		while ((key > source->str) &&
+		while ((key > source) &&
 				((*(key - 1) == ' ') || (*(key - 1) == '\t'))) {
 			key--;
 		}
 
-		if ((key == source->str) ||
+		if ((key == source) ||
 				((*(key - 1) == '\n') || (*(key - 1) == '\r'))) {
 			// Check after tag
-			key = stop + close_len;
+			key = source + index.tags[t].end;
 
-			while ((*key == ' ') || (*key == '\t')) {
+			while ((key < source_end) && ((*key == ' ') || (*key == '\t'))) {
 				key++;
 			}
 
-			if ((*key == '\n') || (*key == '\r') || (*key == '\0')) {
+			if ((key == source_end) || (*key == '\n') || (*key == '\r') || (*key == '\0')) {
 				standalone = 1;
 			}
 		}
 
-		// Get key from contents of tag
-		key = start + open_len;
-		key_len = stop - key;
+		// Get key from contents of tag (triple mustache closers were
+		// validated by the scanner)
+		key = source + index.tags[t].key;
+		key_len = index.tags[t].key_len;
 
 		c = *key;
 
@@ -657,24 +630,6 @@ static int parse(DString * source, const char * opener, const char * closer, str
 				break;
 
 			case '{':
-
-				// Ensure proper {{{foo}}} config
-				for (l = 0; cl[l] == '}'; l++);
-
-				if (cl[l]) {
-					if (!key_len || key[key_len - 1] != '}') {
-						return -1;
-					}
-
-					key_len--;
-				} else {
-					if (stop[l] != '}') {
-						return -1;
-					}
-
-					stop++;
-				}
-
 				c = '&';
 
 			case '#':
@@ -702,7 +657,8 @@ static int parse(DString * source, const char * opener, const char * closer, str
 				}
 
 				if (key_len > kMaxKeyLength) {
-					return -1;
+					rc = -1;
+					goto exit;
 				}
 
 				memcpy(key_name, key, key_len);
@@ -719,51 +675,7 @@ static int parse(DString * source, const char * opener, const char * closer, str
 				break;
 
 			case '=':
-
-				// Set Delimiter
-				if (key_len < 5 || key[key_len - 1] != '=') {
-					return -1;
-				}
-
-				key++;
-				key_len -= 2;
-
-				for (l = 0; l < key_len && isspace(key[l]); l++);
-
-				key += l;
-				key_len -= l;
-
-				for (l = 0; l < key_len && !isspace(key[l]); l++);
-
-				if (l == key_len) {
-					return -1;
-				}
-
-				strncpy(op, key, MIN(kMaxDelimiterLength, l));
-				op[MIN(kMaxDelimiterLength, l)] = '\0';
-
-				while (l < key_len && isspace(key[l])) {
-					l++;
-				}
-
-				while (isspace(key[key_len - 1])) {
-					key_len--;
-				}
-
-				if (l == key_len) {
-					return -1;
-				}
-
-				open_len = strlen(op);
-
-				strncpy(cl, key + l, MIN(kMaxDelimiterLength, key_len - l));
-				cl[MIN(kMaxDelimiterLength, key_len - l)] = '\0';
-
-				// Adjust stop for change in closer length
-				stop += close_len;
-				close_len = strlen(cl);
-				stop -= close_len;
-
+				// Set Delimiter -- handled by the scanner
 				break;
 
 			case '^':
@@ -771,7 +683,8 @@ static int parse(DString * source, const char * opener, const char * closer, str
 
 				// Begin section
 				if (depth == kMaxDepth) {
-					return -1;
+					rc = -1;
+					goto exit;
 				}
 
 				rc = visible;
@@ -779,13 +692,16 @@ static int parse(DString * source, const char * opener, const char * closer, str
 				if (visible) {
 					if ((rc = json_enter(key_name, closure)) < 0) {
 						// Error
+						if (closure->stream_reused) {
+							goto exit;
+						}
 					}
 				}
 
 				// Leave breadcrumbs so we can return
 				stack[depth].key = key;
 				stack[depth].key_len = key_len;
-				stack[depth].again = stop;
+				stack[depth].again = t;
 				stack[depth].entered = rc;
 				stack[depth].visible = visible;
 
@@ -804,17 +720,19 @@ static int parse(DString * source, const char * opener, const char * closer, str
 						(key_len != stack[depth].key_len) ||
 						(memcmp(stack[depth].key, key, key_len))) {
 					// Doesn't match breadcrumb
-					return -1;
+					rc = -1;
+					goto exit;
 				}
 
-				rc = visible && (stack[depth].entered ? json_next(closure) : 0);
+				rc = (visible && stack[depth].entered) ? json_next(closure) : 0;
 
 				if (rc < 0) {
-					return rc;
+					goto exit;
 				}
 
 				if (rc) {
-					stop = stack[depth++].again;
+					// Start over after the opening tag
+					t = stack[depth++].again;
 				} else {
 					visible = stack[depth].visible;
 
@@ -841,7 +759,7 @@ static int parse(DString * source, const char * opener, const char * closer, str
 						indent = start;
 						indent_len = 0;
 
-						while ((indent > source->str) &&
+						while ((indent > source) &&
 								((*(indent - 1) == ' ') || (*(indent - 1) == '\t'))) {
 							indent--;
 							indent_len++;
@@ -851,7 +769,14 @@ static int parse(DString * source, const char * opener, const char * closer, str
 					}
 
 					if (rc == 0) {
-						rc = parse(partial, "{{", "}}", closure, dir);
+						rc = parse(partial->str, partial->currentStringLength, "{{", "}}", closure, dir);
+
+						if ((rc < 0) && closure->stream_reused) {
+							// Other errors only skip the partial
+							free(dir);
+							d_string_free(partial, true);
+							goto exit;
+						}
 					} else if (rc == -2) {
 						// If rc == -2, don't parse the partial, but just insert the resulting text
 						d_string_append_c_array(closure->out, partial->str, partial->currentStringLength);
@@ -883,10 +808,8 @@ static int parse(DString * source, const char * opener, const char * closer, str
 				break;
 		}
 
-		// Find next tag
-		stop += close_len;
-		start = strstr(stop, op);
-
+		// Continue after tag
+		stop = source + index.tags[t].end;
 
 		if (standalone) {
 			// Trim leading whitespace
@@ -899,27 +822,39 @@ static int parse(DString * source, const char * opener, const char * closer, str
 			}
 
 			// Trim trailing space
-			while ((*stop == ' ') || (*stop == '\t')) {
+			while ((stop < source_end) && ((*stop == ' ') || (*stop == '\t'))) {
 				stop++;
 			}
 
-			if (*stop == '\r') {
+			if ((stop < source_end) && (*stop == '\r')) {
 				stop++;
 			}
 
-			if (*stop == '\n') {
+			if ((stop < source_end) && (*stop == '\n')) {
 				stop++;
 			}
 		}
 	}
 
+	if (index.error) {
+		// Copy anything before invalid tag
+		if (visible) {
+			d_string_append_c_array(closure->out, stop, index.error_offset - (stop - source));
+		}
+
+		rc = -1;
+		goto exit;
+	}
+
 	// Copy anything after last tag
 	if (visible && stop) {
-		if (stop - source->str < source->currentStringLength) {
-			d_string_append_c_array(closure->out, stop, source->currentStringLength - (stop - source->str));
+		if (stop < source + source_len) {
+			d_string_append_c_array(closure->out, stop, (size_t) (source + source_len - stop));
 		}
 	}
 
+exit:
+	scanner_index_free(&index);
 
 	return rc;
 }
@@ -928,106 +863,587 @@ static int parse(DString * source, const char * opener, const char * closer, str
 /// Given a source string, populate it using data from a JSON value.
 /// The resulting text will be appended to `out`.
 int magnum_populate_from_json(DString * source, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **)) {
-	int rc;
+	return magnum_populate_from_json_with_options(source, json, out, search_directory, load_p, NULL);
+}
 
-	struct closure c;
 
-	c.root = json;
-	c.depth = 0;
-	c.out = out;
-	c.directory = search_directory;
-	c.stack[0].container = NULL;
-	c.stack[0].val = json;
-	c.stack[0].index = 0;
-	c.stack[0].count = 1;
+/// Given a source string, populate it using data from a JSON value and the
+/// specified options (NULL for the defaults).
+/// The resulting text will be appended to `out`.
+int magnum_populate_from_json_with_options(DString * source, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	if (source == NULL) {
+		return -1;
+	}
+
+	return magnum_populate_buffer_from_json(source->str, source->currentStringLength, json, out, search_directory, load_p, options);
+}
+
+
+/// Set up closure for a render
+static void closure_init(struct closure * c, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	c->provider = &json_value_provider;
+	c->context = NULL;
+	c->stream = NULL;
+	c->streamed = NULL;
+	c->stream_used = 0;
+	c->stream_reused = 0;
+	c->flush = NULL;
+	c->depth = 0;
+	c->base = 0;
+	c->out = out;
+	c->directory = search_directory;
+	c->escape_mode = options ? options->escape_mode : MAGNUM_ESCAPE_HTML;
+	c->escape_table = options ? options->escape_table : NULL;
+	c->number_format = options ? options->number_format : MAGNUM_NUMBER_LEGACY;
+	c->number_decimals = options ? options->number_decimals : 0;
+	c->raw_number_format = options ? options->raw_number_format : MAGNUM_RAW_NUMBER_PRECISE;
+	c->estimate = options ? options->estimate : NULL;
+	c->stack[0].container = json_value_provider_root(NULL);
+	c->stack[0].val = json_value_provider_root(NULL);
+	c->stack[0].streamed = 0;
 
 	if (load_p) {
-		c.load_partial = load_p;
+		c->load_partial = load_p;
 	} else {
-		c.load_partial = &load_partial;
+		c->load_partial = &load_partial;
 	}
+}
 
-	rc = parse(source, "{{", "}}", &c, search_directory);
 
-	if (rc < 0) {
-		fprintf(stderr, "Error parsing Mustache templates\n");
+/// Use `count` roots, which must be filled in as `stack[0...count - 1].val`
+static int closure_layers(struct closure * c, size_t count) {
+	size_t i;
+
+	// Leave room for sections
+	if ((count == 0) || (count >= kMaxDepth)) {
+		return -1;
 	}
 
-	return rc;
-}
+	for (i = 0; i < count; i++) {
+		c->stack[i] = c->stack[0];
+	}
 
+	c->depth = (int) count - 1;
+	c->base = c->depth;
 
-/// Given a source string, populate it using data from a JSON string.
-/// The resulting text will be appended to `out`.
-int magnum_populate_from_string(DString * source, const char * string, DString * out, const char * search_directory) {
-	JSON_Value * v = json_parse_string(string);
+	return 0;
+}
 
-	int rc = magnum_populate_from_json(source, v, out, search_directory, NULL);
 
-	json_value_free(v);
+/// Record the size of a finished render.  A larger render replaces the
+/// estimate outright, while smaller ones only pull it down gradually, so that
+/// an occasional small render doesn't cause the next large one to regrow the
+/// buffer.
+void magnum_estimate_update(magnum_estimate * estimate, size_t output) {
+	if ((estimate->renders == 0) || (output >= estimate->output)) {
+		estimate->output = output;
+	} else {
+		estimate->output -= (estimate->output - output) / 4;
+	}
 
-	return rc;
+	estimate->renders++;
 }
 
 
+/// Render template with the data in closure
+static int render(const char * source, size_t source_len, struct closure * c, const char * search_directory) {
+	// Output that is flushed as it goes never holds the whole render
+	magnum_estimate * estimate = c->flush ? NULL : c->estimate;
+	size_t start = c->out->currentStringLength;
+	int rc;
 
-/// Given a source string, populate it using data from a JSON string, using a custom load_partial routine
-/// The resulting text will be appended to `out`.
-int magnum_populate_from_string_custom_partial(DString * source, const char * string, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **)) {
-	JSON_Value * v = json_parse_string(string);
+	if (estimate && estimate->renders) {
+		// A little slack so that a slightly larger render doesn't double the buffer
+		d_string_reserve(c->out, estimate->output + estimate->output / 16);
+	}
 
-	int rc = magnum_populate_from_json(source, v, out, search_directory, load_p);
+	rc = parse(source, source_len, "{{", "}}", c, search_directory);
 
-	json_value_free(v);
+	if (rc < 0) {
+		fprintf(stderr, "Error parsing Mustache templates\n");
+	} else if (estimate) {
+		magnum_estimate_update(estimate, c->out->currentStringLength - start);
+	}
 
 	return rc;
 }
 
 
-/// Given a source string, populate it using data from a JSON file.
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using data from a JSON value and the
+/// specified options (NULL for the defaults).
 /// The resulting text will be appended to `out`.
-int magnum_populate_from_file(DString * source, const char * fname, DString * out, const char * search_directory) {
-	JSON_Value * v = json_parse_file(fname);
-
-	int rc = magnum_populate_from_json(source, v, out, search_directory, NULL);
+int magnum_populate_buffer_from_json(const char * source, size_t source_len, JSON_Value * json, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
 
-	json_value_free(v);
+	closure_init(&c, out, search_directory, load_p, options);
+	c.stack[0].val = json_value_provider_root(json);
 
-	return rc;
+	return render(source, source_len, &c, search_directory);
 }
 
 
-/// Simplified method to allow use without any other included files.
-/// Useful if you have no other need for parson or d_string
-int magnum_populate_char_only(const char * source, const char * string, char ** out, const char * search_directory) {
-	JSON_Value * v = json_parse_string(string);
-
-	DString * d_source = d_string_new("");
-	free(d_source->str);
-	d_source->str = (char *) source;
-	d_source->currentStringLength = strlen(source);
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using data from a tape and the specified
+/// options (NULL for the defaults).
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_tape(const char * source, size_t source_len, const json_tape * tape, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
 
-	DString * temp = d_string_new("");
+	closure_init(&c, out, search_directory, load_p, options);
+	c.provider = &json_tape_provider;
+	c.context = (void *) tape;
+	c.stack[0].val = json_tape_provider_root(tape);		// If NULL, render as with NULL JSON
 
-	int rc = magnum_populate_from_json(d_source, v, temp, search_directory, NULL);
+	return render(source, source_len, &c, search_directory);
+}
 
-	json_value_free(v);
 
-	*out = temp->str;
-	d_string_free(temp, false);
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using data reached through `provider`.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_provider(const char * source, size_t source_len, const magnum_provider * provider, void * context, magnum_value root, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
 
-	d_string_free(d_source, false);
+	closure_init(&c, out, search_directory, load_p, options);
+	c.provider = provider;
+	c.context = context;
+	c.stack[0].val = root;
 
-	return rc;
+	return render(source, source_len, &c, search_directory);
 }
 
 
-#ifdef TEST
-void Test_magnum(CuTest * tc) {
-	DString * source = d_string_new("");
-	DString * out = d_string_new("");
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using data from `count` JSON roots, searched
+/// from the last to the first.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_json_layers(const char * source, size_t source_len, JSON_Value * const * roots, size_t count, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
+	size_t i;
 
-	// Basic flat test
+	closure_init(&c, out, search_directory, load_p, options);
+
+	if (closure_layers(&c, count) < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		c.stack[i].val = json_value_provider_root(roots[i]);
+	}
+
+	return render(source, source_len, &c, search_directory);
+}
+
+
+/// Given a source buffer of `source_len` bytes (not necessarily
+/// NUL-terminated), populate it using `count` roots reached through
+/// `provider`, searched from the last to the first.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_provider_layers(const char * source, size_t source_len, const magnum_provider * provider, void * context, const magnum_value * roots, size_t count, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
+	size_t i;
+
+	closure_init(&c, out, search_directory, load_p, options);
+	c.provider = provider;
+	c.context = context;
+
+	if (closure_layers(&c, count) < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		c.stack[i].val = roots[i];
+	}
+
+	return render(source, source_len, &c, search_directory);
+}
+
+
+/// Given a source buffer, populate it using data from a top-level JSON array
+/// that is read (and rendered) one element at a time.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_stream(const char * source, size_t source_len, json_stream * stream, DString * out, FILE * flush, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **), const magnum_options * options) {
+	struct closure c;
+	int rc;
+
+	closure_init(&c, out, search_directory, load_p, options);
+	c.stream = stream;
+	c.flush = flush;
+
+	rc = render(source, source_len, &c, search_directory);
+
+	// Rendering stopped partway through an element
+	json_value_free(c.streamed);
+
+	return rc;
+}
+
+
+/// Given a source buffer of `source_len` bytes, populate it using data from a
+/// JSON buffer of `json_len` bytes.  Neither needs to be NUL-terminated.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_string(const char * source, size_t source_len, const char * json, size_t json_len, DString * out, const char * search_directory, const magnum_options * options) {
+	JSON_Value * v = json_parse_stringn_with_flags(json, json_len, JSONParseArena);
+
+	int rc = magnum_populate_buffer_from_json(source, source_len, v, out, search_directory, NULL, options);
+
+	json_value_free(v);
+
+	return rc;
+}
+
+
+/// Given a source buffer of `source_len` bytes, populate it using data from a
+/// MessagePack buffer of `data_len` bytes.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_msgpack(const char * source, size_t source_len, const char * data, size_t data_len, DString * out, const char * search_directory, const magnum_options * options) {
+	json_tape * tape = json_tape_from_msgpack(data, data_len);
+
+	int rc = magnum_populate_buffer_from_tape(source, source_len, tape, out, search_directory, NULL, options);
+
+	json_tape_free(tape);
+
+	return rc;
+}
+
+
+/// Given a source buffer of `source_len` bytes, populate it using data from a
+/// CBOR buffer of `data_len` bytes.
+/// The resulting text will be appended to `out`.
+int magnum_populate_buffer_from_cbor(const char * source, size_t source_len, const char * data, size_t data_len, DString * out, const char * search_directory, const magnum_options * options) {
+	json_tape * tape = json_tape_from_cbor(data, data_len);
+
+	int rc = magnum_populate_buffer_from_tape(source, source_len, tape, out, search_directory, NULL, options);
+
+	json_tape_free(tape);
+
+	return rc;
+}
+
+
+/// Given a source string, populate it using data from a JSON string.
+/// The resulting text will be appended to `out`.
+int magnum_populate_from_string(DString * source, const char * string, DString * out, const char * search_directory) {
+	JSON_Value * v = string ? json_parse_stringn_with_flags(string, strlen(string), JSONParseArena) : NULL;
+
+	int rc = magnum_populate_from_json(source, v, out, search_directory, NULL);
+
+	json_value_free(v);
+
+	return rc;
+}
+
+
+
+/// Given a source string, populate it using data from a JSON string, using a custom load_partial routine
+/// The resulting text will be appended to `out`.
+int magnum_populate_from_string_custom_partial(DString * source, const char * string, DString * out, const char * search_directory, int (*load_p)(char *, DString *, struct closure *, char **)) {
+	JSON_Value * v = string ? json_parse_stringn_with_flags(string, strlen(string), JSONParseArena) : NULL;
+
+	int rc = magnum_populate_from_json(source, v, out, search_directory, load_p);
+
+	json_value_free(v);
+
+	return rc;
+}
+
+
+/// Given a source string, populate it using data from a JSON file.
+/// The resulting text will be appended to `out`.
+int magnum_populate_from_file(DString * source, const char * fname, DString * out, const char * search_directory) {
+	JSON_Value * v = json_parse_file(fname);
+
+	int rc = magnum_populate_from_json(source, v, out, search_directory, NULL);
+
+	json_value_free(v);
+
+	return rc;
+}
+
+
+/// Simplified method to allow use without any other included files.
+/// Useful if you have no other need for parson or d_string
+int magnum_populate_char_only(const char * source, const char * string, char ** out, const char * search_directory) {
+	DString * temp = d_string_new("");
+
+	int rc = magnum_populate_buffer_from_string(source, strlen(source), string, strlen(string), temp, search_directory, NULL);
+
+	*out = temp->str;
+	d_string_free(temp, false);
+
+	return rc;
+}
+
+
+/// Object keys that templates can look up
+struct magnum_keys {
+	struct {
+		char *		name;
+		size_t		len;
+		int			keep;		//!< `JSONKeyKeep`, or `JSONKeyKeepAll` if printed as raw JSON
+	} * keys;					//!< Sorted by name
+	size_t			count;
+	size_t			capacity;
+
+	char 	**		partials;	//!< Paths of partials already scanned
+	size_t			partial_count;
+
+	int				all;		//!< A template prints the whole context (`{{$.}}`)
+};
+
+
+magnum_keys * magnum_keys_new(void) {
+	return calloc(1, sizeof(magnum_keys));
+}
+
+
+void magnum_keys_free(magnum_keys * keys) {
+	size_t i;
+
+	if (keys == NULL) {
+		return;
+	}
+
+	for (i = 0; i < keys->count; i++) {
+		free(keys->keys[i].name);
+	}
+
+	for (i = 0; i < keys->partial_count; i++) {
+		free(keys->partials[i]);
+	}
+
+	free(keys->keys);
+	free(keys->partials);
+	free(keys);
+}
+
+
+/// Compare `name` to entry `i`, in the order used to sort the keys
+static int keys_compare(const magnum_keys * keys, size_t i, const char * name, size_t len) {
+	int rc = memcmp(name, keys->keys[i].name, MIN(len, keys->keys[i].len));
+
+	if (rc) {
+		return rc;
+	}
+
+	return (len > keys->keys[i].len) - (len < keys->keys[i].len);
+}
+
+
+/// Binary search for `name` -- returns its index, or where it would be inserted
+static size_t keys_search(const magnum_keys * keys, const char * name, size_t len, int * found) {
+	size_t low = 0, high = keys->count, mid;
+	int rc;
+
+	*found = 0;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		rc = keys_compare(keys, mid, name, len);
+
+		if (rc == 0) {
+			*found = 1;
+			return mid;
+		}
+
+		if (rc < 0) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+
+	return low;
+}
+
+
+/// Add a single key, keeping the list sorted
+static void keys_add(magnum_keys * keys, const char * name, size_t len, int keep) {
+	int found;
+	size_t i = keys_search(keys, name, len, &found);
+
+	if (found) {
+		keys->keys[i].keep = MAX(keys->keys[i].keep, keep);
+		return;
+	}
+
+	if (keys->count == keys->capacity) {
+		keys->capacity = keys->capacity ? keys->capacity * 2 : 16;
+		keys->keys = realloc(keys->keys, keys->capacity * sizeof(keys->keys[0]));
+	}
+
+	memmove(&keys->keys[i + 1], &keys->keys[i], (keys->count - i) * sizeof(keys->keys[0]));
+	keys->keys[i].name = malloc(len + 1);
+	memcpy(keys->keys[i].name, name, len);
+	keys->keys[i].name[len] = '\0';
+	keys->keys[i].len = len;
+	keys->keys[i].keep = keep;
+	keys->count++;
+}
+
+
+/// Add the keys that looking up `name` can touch: every component of a dotted
+/// name (lookups search each enclosing context), and the name as a whole
+static void keys_add_name(magnum_keys * keys, const char * name, int keep) {
+	const char * dot;
+
+	if (strcmp(name, ".") == 0) {
+		if (keep == JSONKeyKeepAll) {
+			keys->all = 1;
+		}
+
+		return;
+	}
+
+	keys_add(keys, name, strlen(name), keep);
+
+	while ((dot = strchr(name, '.'))) {
+		keys_add(keys, name, dot - name, JSONKeyKeep);
+		name = dot + 1;
+	}
+
+	keys_add(keys, name, strlen(name), keep);
+}
+
+
+/// Scan a template (and its partials) for the names it uses
+static int keys_scan(magnum_keys * keys, const char * source, size_t source_len, const char * search_directory, const char * directory) {
+	scanner_index index;
+	char key_name[kMaxKeyLength + 1];
+	const char * key;
+	size_t key_len, t, i;
+	char * target, * dir;
+	DString * partial;
+	int rc = 0;
+	char c;
+
+	scanner_index_tags(&index, source, source_len, "{{", "}}");
+
+	for (t = 0; t < index.count; t++) {
+		key = source + index.tags[t].key;
+		key_len = index.tags[t].key_len;
+		c = key_len ? *key : '\0';
+
+		switch (c) {
+			case '!':
+			case '=':
+			case '/':
+				continue;
+
+			case '{':
+			case '#':
+			case '&':
+			case '^':
+			case '>':
+			case ':':
+			case '$':
+				key++;
+				key_len--;
+				break;
+		}
+
+		while (key_len && isspace(key[0])) {
+			key++;
+			key_len--;
+		}
+
+		while (key_len && isspace(key[key_len - 1])) {
+			key_len--;
+		}
+
+		if (key_len == 0 || key_len > kMaxKeyLength) {
+			continue;
+		}
+
+		memcpy(key_name, key, key_len);
+		key_name[key_len] = '\0';
+
+		if (c != '>') {
+			keys_add_name(keys, key_name, (c == '$') ? JSONKeyKeepAll : JSONKeyKeep);
+			continue;
+		}
+
+		// Partials are found the same way as by `load_partial()`
+		if (search_directory == NULL) {
+			continue;
+		}
+
+		target = path_from_dir_base(search_directory, key_name);
+		partial = scan_file(target);
+
+		if ((partial == NULL) && directory) {
+			free(target);
+			target = path_from_dir_base(directory, key_name);
+			partial = scan_file(target);
+		}
+
+		if (partial == NULL) {
+			free(target);
+			continue;
+		}
+
+		// Each partial only needs to be scanned once (they can be recursive)
+		for (i = 0; i < keys->partial_count; i++) {
+			if (strcmp(keys->partials[i], target) == 0) {
+				break;
+			}
+		}
+
+		if (i == keys->partial_count) {
+			keys->partials = realloc(keys->partials, (keys->partial_count + 1) * sizeof(char *));
+			keys->partials[keys->partial_count++] = target;
+
+			split_path_file(&dir, NULL, target);
+			rc |= keys_scan(keys, partial->str, partial->currentStringLength, dir, directory);
+			free(dir);
+		} else {
+			free(target);
+		}
+
+		d_string_free(partial, true);
+	}
+
+	if (index.error) {
+		rc = -1;
+	}
+
+	scanner_index_free(&index);
+
+	return rc;
+}
+
+
+int magnum_keys_add_template(magnum_keys * keys, const char * source, size_t source_len, const char * search_directory) {
+	if ((keys == NULL) || (source == NULL)) {
+		return -1;
+	}
+
+	return keys_scan(keys, source, source_len, search_directory, search_directory);
+}
+
+
+int magnum_keys_filter(const char * key, size_t key_len, void * context) {
+	const magnum_keys * keys = context;
+	size_t i;
+	int found;
+
+	if (keys->all) {
+		return JSONKeyKeepAll;
+	}
+
+	i = keys_search(keys, key, key_len, &found);
+
+	return found ? keys->keys[i].keep : JSONKeySkip;
+}
+
+
+#ifdef TEST
+void Test_magnum(CuTest * tc) {
+	DString * source = d_string_new("");
+	DString * out = d_string_new("");
+
+	// Basic flat test
 	d_string_erase(source, 0, -1);
 	d_string_erase(out, 0, -1);
 	d_string_append(source, "A\n\n{{ foo }}\n\n{{bar}}\n\nB\n");
@@ -1131,6 +1547,591 @@ void Test_magnum(CuTest * tc) {
 
 	magnum_populate_char_only(tpl, ctx, &char_out, NULL);
 	CuAssertStrEquals(tc, "A\n\none\n\n42\n\nB\n", char_out);
+	free(char_out);
+}
+
+
+/// Broken partials, without reading files
+static int test_load_partial(char * name, DString * partial, struct closure * c, char ** search_directory) {
+	(void) c;
+	(void) search_directory;
+
+	if (strcmp(name, "unclosed") == 0) {
+		d_string_append(partial, "{{#open}}x");
+	} else if (strcmp(name, "mismatched") == 0) {
+		d_string_append(partial, "x{{/other}}");
+	} else {
+		d_string_append(partial, "{{#b}}{{/b}}{{/b}}");
+	}
+
+	return 0;
+}
+
+
+void Test_magnum_partial_errors(CuTest * tc) {
+	const char * templates[] = {
+		"a{{>unclosed}}b",
+		"a{{>mismatched}}b",
+		"a{{>extra}}b",
+	};
+	const char * expected[] = {"axb", "axb", "ab"};
+	JSON_Value * v = json_parse_string("{\"open\" : true, \"b\" : true}");
+	DString * out = d_string_new("");
+	size_t i;
+
+	// Rendering continues after a partial that can't be parsed
+	for (i = 0; i < sizeof(templates) / sizeof(templates[0]); i++) {
+		d_string_erase(out, 0, -1);
+		magnum_populate_buffer_from_json(templates[i], strlen(templates[i]), v, out, NULL, test_load_partial, NULL);
+		CuAssertStrEquals(tc, expected[i], out->str);
+	}
+
+	json_value_free(v);
+	d_string_free(out, true);
+}
+
+
+void Test_magnum_escape_modes(CuTest * tc) {
+	DString * source = d_string_new("{\"name\": \"{{name}}\", \"raw\": \"{{{name}}}\"}");
+	DString * out = d_string_new("");
+	JSON_Value * v = json_parse_string("{ \"name\" : \"Tom & \\\"Jerry\\\"\\n\" }");
+	magnum_options options = {0};
+
+	// Default is HTML
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "{\"name\": \"Tom &amp; &quot;Jerry&quot;\n\", \"raw\": \"Tom & \"Jerry\"\n\"}", out->str);
+
+	d_string_erase(out, 0, -1);
+	options.escape_mode = MAGNUM_ESCAPE_JSON;
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "{\"name\": \"Tom & \\\"Jerry\\\"\\n\", \"raw\": \"Tom & \"Jerry\"\n\"}", out->str);
+
+	d_string_erase(out, 0, -1);
+	d_string_erase(source, 0, -1);
+	d_string_append(source, "https://example.com/?q={{name}}");
+	options.escape_mode = MAGNUM_ESCAPE_URL;
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "https://example.com/?q=Tom%20%26%20%22Jerry%22%0A", out->str);
+
+	json_value_free(v);
+	d_string_free(source, true);
+	d_string_free(out, true);
+}
+
+
+void Test_magnum_number_formats(CuTest * tc) {
+	DString * source = d_string_new("{{#.}}{{.}};{{/.}}");
+	DString * out = d_string_new("");
+	JSON_Value * v = json_parse_string("[2.5, 0.1, 3.14159265358979, 42, 1e-7]");
+	magnum_options options = {0};
+
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "2.5;0.1;3.141593;42;0.0000001;", out->str);
+
+	d_string_erase(out, 0, -1);
+	options.number_format = MAGNUM_NUMBER_SHORTEST;
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "2.5;0.1;3.14159265358979;42;1e-7;", out->str);
+
+	d_string_erase(out, 0, -1);
+	options.number_format = MAGNUM_NUMBER_FIXED;
+	options.number_decimals = 2;
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertStrEquals(tc, "2.50;0.10;3.14;42.00;0.00;", out->str);
+
+	json_value_free(v);
+	d_string_free(source, true);
+	d_string_free(out, true);
+}
+
+
+void Test_magnum_indent(CuTest * tc) {
+	DString * text = d_string_new("a\nb\r\nc\rd\n\n");
+
+	indent_text(text, "  \t", 3);
+	CuAssertStrEquals(tc, "a\n  \tb\r\n  \tc\r  \td\n  \t\n  \t", text->str);
+	CuAssertIntEquals(tc, 25, (int) text->currentStringLength);
+
+	// Ends with a Mac Classic line ending
+	d_string_erase(text, 0, -1);
+	d_string_append(text, "x\r");
+	indent_text(text, " ", 1);
+	CuAssertStrEquals(tc, "x\r ", text->str);
+
+	d_string_erase(text, 0, -1);
+	d_string_append(text, "no line endings");
+	indent_text(text, " ", 1);
+	CuAssertStrEquals(tc, "no line endings", text->str);
+
+	d_string_free(text, true);
+}
+
+
+void Test_magnum_estimate(CuTest * tc) {
+	DString * source = d_string_new("{{#.}}<li>{{.}}</li>{{/.}}");
+	DString * out;
+	JSON_Value * v = json_value_init_array();
+	magnum_estimate estimate = {0};
+	magnum_options options = {0};
+	size_t expected;
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		json_array_append_string(json_array(v), "item");
+	}
+
+	options.estimate = &estimate;
+
+	// First render only records the size
+	out = d_string_new("");
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	expected = out->currentStringLength;
+	CuAssertTrue(tc, expected > 1024);
+	CuAssertIntEquals(tc, 1, (int) estimate.renders);
+	CuAssertIntEquals(tc, (int) expected, (int) estimate.output);
+	d_string_free(out, true);
+
+	// Second render starts with a buffer large enough to hold the output
+	out = d_string_new("");
+	d_string_reserve(out, 0);
+	CuAssertIntEquals(tc, 1024, (int) out->currentStringBufferSize);
+	magnum_populate_from_json_with_options(source, v, out, NULL, NULL, &options);
+	CuAssertIntEquals(tc, (int) expected, (int) out->currentStringLength);
+	CuAssertIntEquals(tc, (int) (expected + expected / 16 + 1), (int) out->currentStringBufferSize);
+	CuAssertIntEquals(tc, 2, (int) estimate.renders);
+	d_string_free(out, true);
+
+	// Smaller renders decay the estimate gradually, larger ones replace it
+	magnum_estimate_update(&estimate, 0);
+	CuAssertIntEquals(tc, (int) (expected - expected / 4), (int) estimate.output);
+	magnum_estimate_update(&estimate, expected * 2);
+	CuAssertIntEquals(tc, (int) expected * 2, (int) estimate.output);
+
+	json_value_free(v);
+	d_string_free(source, true);
+}
+
+
+void Test_magnum_buffers(CuTest * tc) {
+	DString * out = d_string_new("");
+
+	// Neither buffer is NUL-terminated -- the template ends in the middle of
+	// standalone tag checks, and the data ends in the middle of a number
+	const char tpl[] = "Hi {{name}}!\n{{#list}}\n{{.}}\n{{/list}}XXXX{{name}}";
+	const char data[] = "{\"name\":\"Ann\",\"list\":[1,22]}99999";
+
+	magnum_populate_buffer_from_string(tpl, strlen(tpl) - 12, data, strlen(data) - 5, out, NULL, NULL);
+	CuAssertStrEquals(tc, "Hi Ann!\n1\n22\n", out->str);
+
+	// Data truncated in the middle of a number
+	d_string_erase(out, 0, -1);
+	magnum_populate_buffer_from_string("{{#list}}{{.}},{{/list}}", 24, "[12345]", 3, out, NULL, NULL);
+	CuAssertStrEquals(tc, "", out->str);
+
+	d_string_erase(out, 0, -1);
+	magnum_populate_buffer_from_string("{{.}}", 5, "12345", 3, out, NULL, NULL);
+	CuAssertStrEquals(tc, "123", out->str);
+
+	// Unterminated tag at end of buffer
+	d_string_erase(out, 0, -1);
+	CuAssertIntEquals(tc, -1, magnum_populate_buffer_from_string("a {{b}}", 6, "{}", 2, out, NULL, NULL));
+	CuAssertStrEquals(tc, "a ", out->str);
+
+	d_string_free(out, true);
+}
+
+
+void Test_magnum_tape(CuTest * tc) {
+	const char * data = "{\"name\" : \"A & B\", \"n\" : 2.5, \"zero\" : 0, \"no\" : false, \"yes\" : true, \"none\" : null, "
+						"\"empty\" : [], \"o\" : {\"p\" : {\"q\" : \"deep\"}, \"name\" : \"inner\"}, "
+						"\"list\" : [{\"id\" : 1, \"tags\" : [\"x\", \"y\"]}, {\"id\" : 2, \"name\" : \"own\"}, 3, \"s\"]}";
+	const char * templates[] = {
+		"{{name}} {{{name}}} {{&name}} {{n}} {{zero}} {{missing}}",
+		"{{#list}}[{{id}}:{{name}}:{{.}}{{#tags}}<{{.}}>{{/tags}}]{{/list}}",
+		"{{#o}}{{name}} {{p.q}} {{#p}}{{q}}/{{name}}{{/p}}{{/o}} {{o.p.q}} {{o.x.q}}",
+		"{{#no}}no{{/no}}{{^no}}!no{{/no}}{{#yes}}yes{{.}}{{/yes}}{{#zero}}zero{{/zero}}{{^zero}}!zero{{/zero}}",
+		"{{#none}}none{{/none}}{{^none}}!none{{/none}}{{#empty}}empty{{/empty}}{{^empty}}!empty{{/empty}}{{^missing}}!missing{{/missing}}",
+		"{{#n}}{{.}}{{/n}}{{#name}}{{.}}{{/name}}{{$o}} {{$list}} {{$name}} {{$none}}",
+	};
+	JSON_Value * json = json_parse_string(data);
+	json_tape * tape = json_tape_new(json);
+	DString * expected = d_string_new("");
+	DString * out = d_string_new("");
+	size_t i;
+
+	CuAssertPtrNotNull(tc, tape);
+
+	// Rendering from a tape matches rendering from the tree
+	for (i = 0; i < sizeof(templates) / sizeof(templates[0]); i++) {
+		d_string_erase(expected, 0, -1);
+		d_string_erase(out, 0, -1);
+
+		magnum_populate_buffer_from_json(templates[i], strlen(templates[i]), json, expected, NULL, NULL, NULL);
+		magnum_populate_buffer_from_tape(templates[i], strlen(templates[i]), tape, out, NULL, NULL, NULL);
+		CuAssertStrEquals(tc, expected->str, out->str);
+	}
+
+	d_string_erase(out, 0, -1);
+	magnum_populate_buffer_from_tape(templates[1], strlen(templates[1]), tape, out, NULL, NULL, NULL);
+	CuAssertStrEquals(tc, "[1:A &amp; B:<x><y>][2:own:][:A &amp; B:3][:A &amp; B:s]", out->str);
+
+	// No data
+	d_string_erase(out, 0, -1);
+	magnum_populate_buffer_from_tape(templates[0], strlen(templates[0]), NULL, out, NULL, NULL, NULL);
+	CuAssertStrEquals(tc, "     ", out->str);
+
+	json_tape_free(tape);
+	json_value_free(json);
+	d_string_free(expected, true);
+	d_string_free(out, true);
+}
+
+void Test_magnum_layers(CuTest * tc) {
+	DString * source = d_string_new("");
+	DString * out = d_string_new("");
+	JSON_Value * roots[2];
+	magnum_value values[2];
+	const char * tpl = "{{title}}|{{site}}|{{#nav}}{{.}}={{title}} {{/nav}}|{{#user}}{{name}}@{{site}}{{/user}}|{{#.}}{{title}}{{/.}}";
+	const char * deep = "{{#a}}{{#a}}{{#a}}{{#a}}{{#a}}{{#a}}{{#a}}{{#a}}";
+	int i;
+
+	roots[0] = json_parse_string("{\"site\" : \"Example\", \"title\" : \"Default\", \"nav\" : [\"a\", \"b\"], \"a\" : {\"a\" : 1}}");
+	roots[1] = json_parse_string("{\"title\" : \"Page\", \"user\" : {\"name\" : \"Ann\"}}");
+
+	// Request data overrides the shared configuration
+	CuAssertIntEquals(tc, 0, magnum_populate_buffer_from_json_layers(tpl, strlen(tpl), roots, 2, out, NULL, NULL, NULL));
+	CuAssertStrEquals(tc, "Page|Example|a=Page b=Page |Ann@Example|Page", out->str);
+
+	d_string_erase(out, 0, -1);
+	CuAssertIntEquals(tc, 0, magnum_populate_buffer_from_json_layers(tpl, strlen(tpl), roots, 1, out, NULL, NULL, NULL));
+	CuAssertStrEquals(tc, "Default|Example|a=Default b=Default ||Default", out->str);
+
+	// Roots are left alone, and can be used again
+	d_string_erase(out, 0, -1);
+	values[0] = json_value_provider_root(roots[1]);
+	values[1] = json_value_provider_root(roots[0]);
+	CuAssertIntEquals(tc, 0, magnum_populate_buffer_from_provider_layers(tpl, strlen(tpl), &json_value_provider, NULL, values, 2, out, NULL, NULL, NULL));
+	CuAssertStrEquals(tc, "Default|Example|a=Default b=Default |Ann@Example|Default", out->str);
+
+	// Closing past the roots, no roots, and sections nested too deeply
+	d_string_erase(out, 0, -1);
+	CuAssertTrue(tc, magnum_populate_buffer_from_json_layers("{{/title}}", 10, roots, 2, out, NULL, NULL, NULL) < 0);
+	CuAssertIntEquals(tc, -1, magnum_populate_buffer_from_json_layers(tpl, strlen(tpl), roots, 0, out, NULL, NULL, NULL));
+
+	for (i = 0; i < 40; i++) {
+		d_string_append(source, deep);
+	}
+
+	CuAssertTrue(tc, magnum_populate_buffer_from_json_layers(source->str, source->currentStringLength, roots, 2, out, NULL, NULL, NULL) < 0);
+
+	json_value_free(roots[0]);
+	json_value_free(roots[1]);
+	d_string_free(source, true);
+	d_string_free(out, true);
+}
+
+
+void Test_magnum_keys(CuTest * tc) {
+	const char * data = "{\"name\" : \"A & B\", \"unused\" : {\"name\" : \"x\", \"big\" : [1, 2, 3]}, "
+						"\"o\" : {\"p\" : {\"q\" : \"deep\", \"r\" : \"no\"}, \"name\" : \"inner\"}, "
+						"\"raw\" : {\"any\" : {\"thing\" : [true]}}, "
+						"\"list\" : [{\"id\" : 1, \"skip\" : 0}, {\"id\" : 2, \"name\" : \"own\"}]}";
+	const char * templates[] = {
+		"{{name}} {{o.p.q}} {{#list}}[{{id}}:{{name}}]{{/list}}",
+		"{{#o}}{{#p}}{{q}}/{{name}}{{/p}}{{/o}} {{$raw}} {{=<% %>=}}<%&missing%>",
+	};
+	JSON_Value * json = json_parse_string(data);
+	JSON_Value * selected;
+	JSON_Object * o;
+	magnum_keys * keys = magnum_keys_new();
+	DString * expected = d_string_new("");
+	DString * out = d_string_new("");
+	size_t i;
+
+	for (i = 0; i < sizeof(templates) / sizeof(templates[0]); i++) {
+		CuAssertIntEquals(tc, 0, magnum_keys_add_template(keys, templates[i], strlen(templates[i]), NULL));
+	}
+
+	selected = json_parse_stringn_filtered(data, strlen(data), JSONParseArena, magnum_keys_filter, keys);
+	CuAssertPtrNotNull(tc, selected);
+
+	// Only what the templates can reach is built
+	o = json_value_get_object(selected);
+	CuAssertPtrEquals(tc, NULL, json_object_get_value(o, "unused"));
+	CuAssertPtrEquals(tc, NULL, json_object_dotget_value(o, "o.p.r"));
+	CuAssertPtrEquals(tc, NULL, json_object_dotget_value(json_array_get_object(json_object_get_array(o, "list"), 0), "skip"));
+	CuAssertIntEquals(tc, 1, (int) json_array_get_count(json_object_dotget_array(o, "raw.any.thing")));
+
+	// ...which renders the same
+	for (i = 0; i < sizeof(templates) / sizeof(templates[0]); i++) {
+		d_string_erase(expected, 0, -1);
+		d_string_erase(out, 0, -1);
+
+		magnum_populate_buffer_from_json(templates[i], strlen(templates[i]), json, expected, NULL, NULL, NULL);
+		magnum_populate_buffer_from_json(templates[i], strlen(templates[i]), selected, out, NULL, NULL, NULL);
+		CuAssertStrEquals(tc, expected->str, out->str);
+	}
+
+	magnum_keys_free(keys);
+	json_value_free(selected);
+	json_value_free(json);
+	d_string_free(expected, true);
+	d_string_free(out, true);
+}
+
+void Test_magnum_stream(CuTest * tc) {
+	const char * data = "[{\"name\" : \"a\", \"tags\" : [1, 2]}, {\"name\" : \"b & c\"}, 3, false, []]";
+	const char * templates[] = {
+		"Head\n{{#.}}\n- {{name}}{{#tags}} {{.}}{{/tags}}{{^name}}{{.}}{{/name}}\n  {{/.}}\nTail {{name}}\n",
+		"{{#missing}}{{#.}}x{{/.}}{{/missing}}{{#.}}{{#.}}{{.}}{{/.}}{{/.}}",
+		"{{#.}}[{{$.}}]{{/.}}{{#.}}again{{/.}}",
+		"{{#.}}[{{$.}}]{{/.}}{{^.}}empty{{/.}}",
+	};
+	JSON_Value * json = json_parse_string(data);
+	DString * expected = d_string_new("");
+	DString * out = d_string_new("");
+	json_stream * stream;
+	FILE * f, * f2, * flush;
+	char * flushed;
+	size_t i;
+	long len;
+
+	f = tmpfile();
+	fputs(data, f);
+
+	// Iterating the stream matches iterating the parsed array
+	for (i = 0; i < 2; i++) {
+		rewind(f);
+		stream = json_stream_new(f, JSONParseArena);
+
+		d_string_erase(expected, 0, -1);
+		d_string_erase(out, 0, -1);
+
+		magnum_populate_buffer_from_json(templates[i], strlen(templates[i]), json, expected, NULL, NULL, NULL);
+		CuAssertIntEquals(tc, 0, magnum_populate_buffer_from_stream(templates[i], strlen(templates[i]), stream, out, NULL, NULL, NULL, NULL));
+		CuAssertStrEquals(tc, expected->str, out->str);
+
+		json_stream_free(stream);
+	}
+
+	// The array can only be iterated once -- using the root again is an error
+	for (i = 2; i < 4; i++) {
+		rewind(f);
+		stream = json_stream_new(f, JSONParseArena);
+		d_string_erase(out, 0, -1);
+
+		CuAssertIntEquals(tc, -1, magnum_populate_buffer_from_stream(templates[i], strlen(templates[i]), stream, out, NULL, NULL, NULL, NULL));
+		CuAssertStrEquals(tc, "[{\\\"name\\\":\\\"a\\\",\\\"tags\\\":[1,2]}][{\\\"name\\\":\\\"b & c\\\"}][3][false][[]]", out->str);
+
+		json_stream_free(stream);
+	}
+
+	// Invalid data stops rendering
+	f2 = tmpfile();
+	fputs("[1, 2", f2);
+	rewind(f2);
+	stream = json_stream_new(f2, JSONParseArena);
+	d_string_erase(out, 0, -1);
+
+	CuAssertIntEquals(tc, -1, magnum_populate_buffer_from_stream(templates[1], strlen(templates[1]), stream, out, NULL, NULL, NULL, NULL));
+	CuAssertStrEquals(tc, "12", out->str);
+
+	json_stream_free(stream);
+	fclose(f2);
+
+	// Output can be written as elements are finished
+	d_string_erase(expected, 0, -1);
+	d_string_erase(out, 0, -1);
+
+	for (i = 0; i < kFlushThreshold; i++) {
+		d_string_append_c(out, 'x');
+	}
+
+	d_string_append(out, "\n  ");
+	d_string_append(expected, out->str);
+	magnum_populate_buffer_from_json(templates[0], strlen(templates[0]), json, expected, NULL, NULL, NULL);
+
+	rewind(f);
+	stream = json_stream_new(f, JSONParseArena);
+	flush = tmpfile();
+
+	magnum_populate_buffer_from_stream(templates[0], strlen(templates[0]), stream, out, flush, NULL, NULL, NULL);
+
+	len = ftell(flush);
+	CuAssertTrue(tc, len >= kFlushThreshold);
+
+	flushed = malloc(len + 1);
+	rewind(flush);
+	CuAssertIntEquals(tc, (int) len, (int) fread(flushed, 1, len, flush));
+	flushed[len] = '\0';
+
+	// Flushed output, followed by what was left in `out`, is the whole thing
+	d_string_prepend(out, flushed);
+	CuAssertStrEquals(tc, expected->str, out->str);
+
+	free(flushed);
+
+	json_stream_free(stream);
+	fclose(flush);
+	fclose(f);
+	json_value_free(json);
+	d_string_free(expected, true);
+	d_string_free(out, true);
+}
+/// Data held in native structs, for `Test_magnum_provider()`
+typedef struct {
+	const char *	name;
+	double			price;
+	int				active;
+} test_item;
+
+typedef struct {
+	const char *		title;
+	const test_item *	items;
+	size_t				count;
+} test_catalog;
+
+/// What a `magnum_value` refers to (its `index`) -- `ptr` is the catalog or an item
+enum test_fields {
+	TEST_CATALOG,
+	TEST_TITLE,
+	TEST_ITEMS,
+	TEST_ITEM,
+	TEST_NAME,
+	TEST_PRICE,
+	TEST_ACTIVE,
+};
+
+static const char * test_field_names[] = {"", "title", "items", "", "name", "price", "active"};
+
+static magnum_value test_value(const void * ptr, size_t field) {
+	magnum_value v = {ptr, field};
+
+	return v;
+}
+
+static int test_type(void * context, magnum_value v) {
+	static const int types[] = {MAGNUM_VALUE_OBJECT, MAGNUM_VALUE_STRING, MAGNUM_VALUE_ARRAY, MAGNUM_VALUE_OBJECT, MAGNUM_VALUE_STRING, MAGNUM_VALUE_NUMBER, MAGNUM_VALUE_BOOLEAN};
+
+	(void) context;
+
+	return types[v.index];
+}
+
+static magnum_value test_member(void * context, magnum_value object, const char * name, size_t len) {
+	size_t first = (object.index == TEST_CATALOG) ? TEST_TITLE : TEST_NAME;
+	size_t last = (object.index == TEST_CATALOG) ? TEST_ITEMS : TEST_ACTIVE;
+	size_t i;
+
+	(void) context;
+
+	if ((object.index == TEST_CATALOG) || (object.index == TEST_ITEM)) {
+		for (i = first; i <= last; i++) {
+			if ((strlen(test_field_names[i]) == len) && (memcmp(test_field_names[i], name, len) == 0)) {
+				return test_value(object.ptr, i);
+			}
+		}
+	}
+
+	return test_value(NULL, 0);
+}
+
+static const char * test_string(void * context, magnum_value v, size_t * len) {
+	const char * s = (v.index == TEST_TITLE) ? ((const test_catalog *) v.ptr)->title : ((const test_item *) v.ptr)->name;
+
+	(void) context;
+
+	*len = strlen(s);
+
+	return s;
+}
+
+static double test_number(void * context, magnum_value v) {
+	(void) context;
+
+	return ((const test_item *) v.ptr)->price;
+}
+
+static int test_boolean(void * context, magnum_value v) {
+	(void) context;
+
+	return ((const test_item *) v.ptr)->active;
+}
+
+static magnum_value test_first(void * context, magnum_value container) {
+	const test_catalog * catalog = context;
+
+	switch (container.index) {
+		case TEST_CATALOG:
+			return test_value(container.ptr, TEST_TITLE);
+
+		case TEST_ITEMS:
+			return catalog->count ? test_value(catalog->items, TEST_ITEM) : test_value(NULL, 0);
+
+		default:
+			return test_value(container.ptr, TEST_NAME);
+	}
+}
+
+static magnum_value test_next(void * context, magnum_value container, magnum_value item) {
+	const test_catalog * catalog = context;
+	const test_item * next;
+
+	(void) container;
+
+	switch (item.index) {
+		case TEST_ITEM:
+			next = (const test_item *) item.ptr + 1;
+			return (next < catalog->items + catalog->count) ? test_value(next, TEST_ITEM) : test_value(NULL, 0);
+
+		case TEST_ITEMS:
+		case TEST_ACTIVE:
+			return test_value(NULL, 0);
+
+		default:
+			return test_value(item.ptr, item.index + 1);
+	}
+}
+
+static const char * test_name(void * context, magnum_value object, magnum_value item, size_t * len) {
+	(void) context;
+	(void) object;
+
+	*len = strlen(test_field_names[item.index]);
+
+	return test_field_names[item.index];
+}
+
+void Test_magnum_provider(CuTest * tc) {
+	const magnum_provider provider = {
+		test_type,
+		test_member,
+		test_string,
+		test_number,
+		test_boolean,
+		test_first,
+		test_next,
+		test_name,
+	};
+	const test_item items[] = {
+		{"Apple", 1.25, 1},
+		{"B & \"C\"", 20, 0},
+	};
+	const test_catalog catalog = {"Fruit", items, 2};
+	const char * json = "{\"title\" : \"Fruit\", \"items\" : [{\"name\" : \"Apple\", \"price\" : 1.25, \"active\" : true}, "
+		"{\"name\" : \"B & \\\"C\\\"\", \"price\" : 20, \"active\" : false}]}";
+	const char * source = "{{title}}\n{{#items}}\n- {{name}} {{price}}{{#active}} *{{/active}} ({{title}})\n{{/items}}"
+		"{{items.name}}{{missing}}{{#title}}{{.}}{{/title}}{{^missing}}!{{/missing}}\n{{$items}}";
+	DString * expected = d_string_new("");
+	DString * out = d_string_new("");
+	magnum_value root = {&catalog, TEST_CATALOG};
+
+	magnum_populate_buffer_from_string(source, strlen(source), json, strlen(json), expected, NULL, NULL);
+	CuAssertIntEquals(tc, 0, magnum_populate_buffer_from_provider(source, strlen(source), &provider, (void *) &catalog, root, out, NULL, NULL, NULL));
+	CuAssertStrEquals(tc, expected->str, out->str);
+
+	d_string_free(expected, true);
+	d_string_free(out, true);
 }
 #endif
 
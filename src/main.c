@@ -30,40 +30,308 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "d_string.h"
+#include "decode.h"
 #include "file.h"
 #include "json.h"
 #include "libMagnum.h"
+#include "stream.h"
+#include "tape.h"
+
+
+/// Collect the keys used by each template in `argv`
+static magnum_keys * keys_for_templates(char ** argv) {
+	magnum_keys * keys = magnum_keys_new();
+	file_map template;
+	char * dir, * file, * absolute;
+
+	while (*argv) {
+		absolute = absolute_path_for_argument(*argv);
+
+		split_path_file(&dir, &file, absolute);
+
+		if (file_map_open(&template, *argv) == 0) {
+			magnum_keys_add_template(keys, template.data, template.length, dir);
+
+			file_map_close(&template);
+		}
+
+		free(dir);
+		free(file);
+		free(absolute);
+		argv++;
+	}
+
+	return keys;
+}
+
+
+/// Decoder for binary data formats
+typedef json_tape * (*data_decoder)(const char * data, size_t len);
+
+
+/// Decoder for `fname`, based on its extension, or NULL for JSON
+static data_decoder decoder_for_file(const char * fname) {
+	const char * extension = strrchr(fname, '.');
+
+	if (extension == NULL) {
+		return NULL;
+	}
+
+	if ((strcmp(extension, ".msgpack") == 0) || (strcmp(extension, ".mpk") == 0)) {
+		return json_tape_from_msgpack;
+	}
+
+	if (strcmp(extension, ".cbor") == 0) {
+		return json_tape_from_cbor;
+	}
+
+	return NULL;
+}
+
+
+/// Load the data to render from `fname`.  A snapshot is used in place (and
+/// `snapshot` must be closed after the tape is freed), MessagePack and CBOR
+/// are decoded, and anything else is parsed as JSON.
+static json_tape * load_data(const char * fname, file_map * snapshot, int flags, magnum_keys * keys) {
+	data_decoder decoder = decoder_for_file(fname);
+	json_tape * tape;
+	JSON_Value * j;
+	file_map data;
+
+	if (file_map_open(snapshot, fname) == 0) {
+		if (json_tape_is_snapshot(snapshot->data, snapshot->length)) {
+			tape = json_tape_from_snapshot(snapshot->data, snapshot->length);
+
+			if (tape == NULL) {
+				fprintf(stderr, "Snapshot is damaged or out of date -- recreate it with --snapshot\n");
+				file_map_close(snapshot);
+			}
+
+			return tape;
+		}
+
+		if (decoder) {
+			tape = decoder(snapshot->data, snapshot->length);
+			file_map_close(snapshot);
+
+			if (tape == NULL) {
+				fprintf(stderr, "Invalid data...\n");
+			}
+
+			return tape;
+		}
+
+		file_map_close(snapshot);
+	} else if (decoder) {
+		fprintf(stderr, "Error reading file...\n");
+		return NULL;
+	}
+
+	j = json_from_file_in_situ(fname, &data, flags, keys ? magnum_keys_filter : NULL, keys);
+
+	if (j == NULL) {
+		return NULL;
+	}
+
+	// Render from a compact copy, and release the parsed tree
+	tape = json_tape_new(j);
+
+	json_value_free(j);
+	file_map_close(&data);
+
+	return tape;
+}
+
+
+/// Write the data in `fname` to `output` as a snapshot
+static int write_snapshot(const char * fname, const char * output, int flags) {
+	file_map snapshot;
+	json_tape * tape = load_data(fname, &snapshot, flags, NULL);
+	bool borrowed;
+	FILE * out;
+	int rc = -1;
+
+	if (tape == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	if ((out = fopen(output, "wb")) != NULL) {
+		rc = json_tape_write_snapshot(tape, out);
+
+		if (fclose(out)) {
+			rc = -1;
+		}
+	}
+
+	if (rc) {
+		fprintf(stderr, "Error writing snapshot...\n");
+	}
+
+	borrowed = tape->borrowed;
+	json_tape_free(tape);
+
+	if (borrowed) {
+		file_map_close(&snapshot);
+	}
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/// Render a single template from a JSON array read incrementally from
+/// `fname` ("-" for stdin)
+static int render_stream(const char * fname, const char * template_name, int flags) {
+	FILE * in = (strcmp(fname, "-") == 0) ? stdin : fopen(fname, "rb");
+	json_stream * stream;
+	file_map template;
+	DString * out;
+	char * dir, * file, * absolute;
+	int rc;
+
+	if (in == NULL) {
+		fprintf(stderr, "Error reading file...\n");
+		return EXIT_FAILURE;
+	}
+
+	if (file_map_open(&template, template_name)) {
+		fprintf(stderr, "Error reading template...\n");
+
+		if (in != stdin) {
+			fclose(in);
+		}
+
+		return EXIT_FAILURE;
+	}
+
+	stream = json_stream_new(in, flags | JSONParseArena);
+	out = d_string_new("");
+
+	absolute = absolute_path_for_argument(template_name);
+	split_path_file(&dir, &file, absolute);
+
+	// Output is written as each element is finished
+	rc = magnum_populate_buffer_from_stream(template.data, template.length, stream, out, stdout, dir, NULL, NULL);
+
+	fwrite(out->str, 1, out->currentStringLength, stdout);
+
+	if (json_stream_error(stream)) {
+		fprintf(stderr, "Invalid JSON...\n");
+		rc = -1;
+	}
+
+	free(dir);
+	free(file);
+	free(absolute);
+	d_string_free(out, true);
+	json_stream_free(stream);
+	file_map_close(&template);
+
+	if (in != stdin) {
+		fclose(in);
+	}
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
 
 int main( int argc, char ** argv ) {
-	if (argc > 2) {
+	int flags = JSONParseDefault;
+	int select = 0;
+	int stream = 0;
+	int snapshot = 0;
+	magnum_keys * keys = NULL;
+
+	argv++;
+	argc--;
+
+	// Options precede the data file
+	while (argc && (strncmp(*argv, "--", 2) == 0)) {
+		if (strcmp(*argv, "--trusted") == 0) {
+			// Data comes from a serializer that never repeats keys
+			flags |= JSONParseTrusted;
+		} else if (strcmp(*argv, "--jsonc") == 0) {
+			// Data may contain comments
+			flags |= JSONParseComments;
+		} else if (strcmp(*argv, "--stream") == 0) {
+			// Data is a top-level array, rendered as it is read
+			stream = 1;
+		} else if (strcmp(*argv, "--snapshot") == 0) {
+			// Save parsed data for later renders
+			snapshot = 1;
+		} else if (strcmp(*argv, "--select") == 0) {
+			// Only build the parts of the data that the templates use
+			select = 1;
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", *argv);
+			return EXIT_FAILURE;
+		}
+
 		argv++;
+		argc--;
+	}
+
+	if (stream) {
+		if (argc != 2) {
+			fprintf(stderr, "--stream renders a single template\n");
+			return EXIT_FAILURE;
+		}
+
+		if (flags & JSONParseComments) {
+			fprintf(stderr, "--stream can't be used with --jsonc\n");
+			return EXIT_FAILURE;
+		}
+
+		return render_stream(argv[0], argv[1], flags);
+	}
+
+	if (snapshot) {
+		if ((argc != 3) || (strcmp(argv[1], "-o") != 0)) {
+			fprintf(stderr, "Usage: magnum --snapshot data.json -o data.mgj\n");
+			return EXIT_FAILURE;
+		}
+
+		return write_snapshot(argv[0], argv[2], flags);
+	}
+
+	if (argc > 1) {
+		if (select) {
+			keys = keys_for_templates(argv + 1);
+		}
 
-		JSON_Value * j = json_from_file(*argv++);
-		DString * template;
+		file_map data;
+		json_tape * tape = load_data(*argv++, &data, flags, keys);
+		bool borrowed = tape && tape->borrowed;
+		file_map template;
 		DString * out = d_string_new("");
 
 		char * dir, * file, * absolute;
 
-		while (j && *argv) {
+		while (tape && *argv) {
 			absolute = absolute_path_for_argument(*argv);
 
 			split_path_file(&dir, &file, absolute);
 
-			template = scan_file(*argv++);
+			if (file_map_open(&template, *argv++) == 0) {
+				magnum_populate_buffer_from_tape(template.data, template.length, tape, out, dir, NULL, NULL);
 
-			magnum_populate_from_json(template, j, out, dir, NULL);
-
-			d_string_free(template, true);
+				file_map_close(&template);
+			}
 			free(dir);
 			free(file);
 			free(absolute);
 		}
 
-		fprintf(stdout, "%s", out->str);
+		fwrite(out->str, 1, out->currentStringLength, stdout);
 
 		d_string_free(out, true);
+		json_tape_free(tape);
+		magnum_keys_free(keys);
+
+		if (borrowed) {
+			file_map_close(&data);
+		}
 	}
 }
@@ -0,0 +1,678 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file number.c
+
+	@brief Format numbers for output.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d_string.h"
+#include "libMagnum.h"
+#include "number.h"
+
+
+/// Largest number of decimal places handled without sprintf()
+#define kFastDecimals		17
+
+/// Scaled values must be below this (2^52) so that floor() and the fractional
+/// part are exact
+#define kFastLimit			4503599627370496.0
+
+/// Integers up to 2^53 are exact, and are their own shortest representation
+#define kExactIntegerLimit	9007199254740992.0
+
+/// 2^64
+#define kUInt64Limit		18446744073709551616.0
+
+
+/// Powers of ten that are exactly representable as doubles
+static const double pow10_double[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+
+static const uint64_t pow10_int[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+	100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+	1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+	1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+	1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+
+/// Write digits of `n` to `buf`, returning the number written
+static size_t write_uint(char * buf, uint64_t n) {
+	char tmp[20];
+	size_t len = 0;
+	size_t i;
+
+	do {
+		tmp[len++] = '0' + (char)(n % 10);
+		n /= 10;
+	} while (n);
+
+	for (i = 0; i < len; i++) {
+		buf[i] = tmp[len - 1 - i];
+	}
+
+	return len;
+}
+
+
+/// Write `whole`.`frac` to `buf`, where `frac` has `decimals` digits.  If
+/// `trim`, trailing zeros (and the decimal point if nothing is left) are
+/// removed.
+static size_t write_decimal(char * buf, bool negative, uint64_t whole, uint64_t frac, int decimals, bool trim) {
+	char * p = buf;
+	int i;
+
+	if (negative) {
+		*p++ = '-';
+	}
+
+	p += write_uint(p, whole);
+
+	if (trim) {
+		while (decimals && (frac % 10 == 0)) {
+			frac /= 10;
+			decimals--;
+		}
+	}
+
+	if (decimals) {
+		*p++ = '.';
+
+		for (i = decimals - 1; i >= 0; i--) {
+			p[i] = '0' + (char)(frac % 10);
+			frac /= 10;
+		}
+
+		p += decimals;
+	}
+
+	*p = '\0';
+
+	return p - buf;
+}
+
+
+/// Remove trailing zeros after the decimal point (and the decimal point
+/// itself if nothing is left)
+static size_t trim_zeros(char * buf, size_t len) {
+	if (memchr(buf, '.', len) == NULL) {
+		return len;
+	}
+
+	while (buf[len - 1] == '0') {
+		len--;
+	}
+
+	if (buf[len - 1] == '.') {
+		len--;
+	}
+
+	buf[len] = '\0';
+
+	return len;
+}
+
+
+/// Round |value| * 10^decimals to the nearest integer, the same way printf()
+/// would.  Returns false if that can't be done exactly.
+static bool round_scaled(double value, int decimals, uint64_t * result) {
+	double scaled;
+	double whole;
+	double frac;
+
+	if (decimals > kFastDecimals) {
+		return false;
+	}
+
+	scaled = fabs(value) * pow10_double[decimals];
+
+	if (!(scaled < kFastLimit)) {
+		return false;
+	}
+
+	whole = floor(scaled);
+	frac = scaled - whole;
+
+	// `scaled` may differ from the exact product by half an ulp -- if that
+	// could change which way we round, let printf() decide
+	if (fabs(frac - 0.5) <= scaled * DBL_EPSILON) {
+		return false;
+	}
+
+	*result = (uint64_t) whole + (frac > 0.5);
+
+	return true;
+}
+
+
+/// Equivalent to `sprintf(buf, "%.*f", decimals, value)`, optionally
+/// removing trailing zeros
+static size_t format_decimal(char * buf, double value, int decimals, bool trim) {
+	double magnitude = fabs(value);
+	uint64_t scaled;
+	size_t len;
+
+	if ((magnitude < kUInt64Limit) && (magnitude == floor(magnitude))) {
+		// Integral values don't need any rounding
+		return write_decimal(buf, signbit(value), (uint64_t) magnitude, 0, decimals, trim);
+	}
+
+	if (round_scaled(value, decimals, &scaled)) {
+		return write_decimal(buf, signbit(value), scaled / pow10_int[decimals], scaled % pow10_int[decimals], decimals, trim);
+	}
+
+	len = sprintf(buf, "%.*f", decimals, value);
+
+	return trim ? trim_zeros(buf, len) : len;
+}
+
+
+size_t number_format_legacy(char * buf, double value) {
+	// "Big" numbers use 6 decimals, "small" numbers use more
+	return format_decimal(buf, value, (value > 1.0) ? 6 : 15, true);
+}
+
+
+size_t number_format_fixed(char * buf, double value, int decimals) {
+	if (decimals < 0) {
+		decimals = 0;
+	} else if (decimals > kNumberMaxDecimals) {
+		decimals = kNumberMaxDecimals;
+	}
+
+	return format_decimal(buf, value, decimals, false);
+}
+
+
+/// Write `k` significant `digits` with decimal exponent `n` (value is
+/// 0.digits * 10^n), using fixed notation for -6 < n <= 21
+static size_t write_digits(char * buf, bool negative, const char * digits, int k, int n) {
+	char * p = buf;
+
+	if (negative) {
+		*p++ = '-';
+	}
+
+	if (k <= n && n <= 21) {
+		// Integer, padded with zeros
+		memcpy(p, digits, k);
+		p += k;
+		memset(p, '0', n - k);
+		p += n - k;
+	} else if (0 < n && n <= 21) {
+		memcpy(p, digits, n);
+		p += n;
+		*p++ = '.';
+		memcpy(p, digits + n, k - n);
+		p += k - n;
+	} else if (-6 < n && n <= 0) {
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -n);
+		p += -n;
+		memcpy(p, digits, k);
+		p += k;
+	} else {
+		*p++ = digits[0];
+
+		if (k > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, k - 1);
+			p += k - 1;
+		}
+
+		p += sprintf(p, "e%+d", n - 1);
+	}
+
+	*p = '\0';
+
+	return p - buf;
+}
+
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 uint128;
+
+
+static uint128 pow10_int128(int k) {
+	return (k < 20) ? (uint128) pow10_int[k] : (uint128) pow10_int[19] * pow10_int[k - 19];
+}
+
+
+/// Range of integers [m_lo, m_hi] in the interval [lo, hi] / 2^shift scaled
+/// by 10^k.  Returns false if there are none.
+static bool interval_has_integer(uint128 lo, uint128 hi, int k, int shift, bool inclusive, uint128 * m_lo, uint128 * m_hi) {
+	uint128 p10 = pow10_int128(k);
+	uint128 l = lo * p10;
+	uint128 h = hi * p10;
+
+	*m_lo = (l + ((uint128) 1 << shift) - 1) >> shift;
+	*m_hi = h >> shift;
+
+	if (!inclusive && ((*m_lo << shift) == l)) {
+		(*m_lo)++;
+	}
+
+	if (!inclusive && ((*m_hi << shift) == h)) {
+		(*m_hi)--;
+	}
+
+	return *m_lo <= *m_hi;
+}
+
+
+/// Find the fewest decimal places `k` such that `m` / 10^k rounds to
+/// `magnitude` (and the closest such `m`), using exact integer arithmetic.
+/// Only handles values below 2^54 with up to 21 decimal places.
+static bool shortest_fixed(double magnitude, uint64_t * result, int * places) {
+	uint128 mid, lo, hi;
+	uint128 v, half, rem, m, m_lo, m_hi;
+	uint64_t mantissa;
+	bool inclusive;
+	int exponent;
+	int shift;
+	int first, last, k;
+
+	mantissa = (uint64_t) ldexp(frexp(magnitude, &exponent), 53);
+
+	// Value is 4 * mantissa / 2^shift, and the rounding interval extends to
+	// the midpoints between it and its neighbors
+	shift = 53 - exponent + 2;
+
+	if ((shift <= 0) || (shift >= 100)) {
+		return false;
+	}
+
+	mid = (uint128) mantissa << 2;
+	hi = mid + 2;
+	lo = mid - ((mantissa == (1ULL << 52)) ? 1 : 2);
+
+	// Round half to even means the interval ends are included for even mantissas
+	inclusive = (mantissa % 2 == 0);
+	half = (uint128) 1 << (shift - 1);
+
+	// If the interval contains an integer at k places, it does at k + 1 as
+	// well, so binary search for the first k that works
+	first = 0;
+	last = 22;
+
+	while (first < last) {
+		k = (first + last) / 2;
+
+		if (interval_has_integer(lo, hi, k, shift, inclusive, &m_lo, &m_hi)) {
+			last = k;
+		} else {
+			first = k + 1;
+		}
+	}
+
+	if (first > 21) {
+		return false;
+	}
+
+	k = first;
+	interval_has_integer(lo, hi, k, shift, inclusive, &m_lo, &m_hi);
+
+	// Closest candidate to the actual value
+	v = mid * pow10_int128(k);
+	m = v >> shift;
+	rem = v - (m << shift);
+
+	if ((rem > half) || ((rem == half) && (m & 1))) {
+		m++;
+	}
+
+	if (m < m_lo) {
+		m = m_lo;
+	} else if (m > m_hi) {
+		m = m_hi;
+	}
+
+	*result = (uint64_t) m;
+	*places = k;
+
+	return true;
+}
+
+#endif
+
+
+size_t number_format_shortest(char * buf, double value) {
+	double magnitude = fabs(value);
+	uint64_t digits_m;
+	char tmp[32];
+	char digits[20];
+	char * e;
+	int precision;
+	int k;
+	int n;
+
+	if (!isfinite(value)) {
+		return sprintf(buf, "%g", value);
+	}
+
+	if ((magnitude < kExactIntegerLimit) && (magnitude == floor(magnitude))) {
+		return write_decimal(buf, signbit(value), (uint64_t) magnitude, 0, 0, true);
+	}
+
+	#ifdef __SIZEOF_INT128__
+
+	if ((magnitude >= 1e-6) && shortest_fixed(magnitude, &digits_m, &k)) {
+		return write_decimal(buf, signbit(value), (k < 20) ? digits_m / pow10_int[k] : 0, (k < 20) ? digits_m % pow10_int[k] : digits_m, k, true);
+	}
+
+	#endif
+
+	// Any normal double that can be represented in 15 (DBL_DIG) significant
+	// digits is printed that way by "%.14e", so only 16 and 17 digits need to
+	// be checked.  Subnormals have less precision, so try everything.
+	for (precision = (magnitude < DBL_MIN) ? 1 : DBL_DIG; precision < 17; precision++) {
+		sprintf(tmp, "%.*e", precision - 1, magnitude);
+
+		if (strtod(tmp, NULL) == magnitude) {
+			break;
+		}
+	}
+
+	if (precision == 17) {
+		sprintf(tmp, "%.16e", magnitude);
+	}
+
+	// Collect significant digits and exponent from "d.ddde[+-]xx"
+	e = strchr(tmp, 'e');
+	digits[0] = tmp[0];
+	k = 1;
+
+	if (tmp[1] == '.') {
+		memcpy(digits + 1, tmp + 2, e - tmp - 2);
+		k += (int)(e - tmp - 2);
+	}
+
+	while (k > 1 && digits[k - 1] == '0') {
+		k--;
+	}
+
+	n = atoi(e + 1) + 1;
+
+	return write_digits(buf, signbit(value), digits, k, n);
+}
+
+
+void number_append(DString * out, double value, int format, int decimals) {
+	char buf[kNumberBufferSize];
+	size_t len;
+
+	switch (format) {
+		case MAGNUM_NUMBER_SHORTEST:
+			len = number_format_shortest(buf, value);
+			break;
+
+		case MAGNUM_NUMBER_FIXED:
+			len = number_format_fixed(buf, value, decimals);
+			break;
+
+		default:
+			len = number_format_legacy(buf, value);
+			break;
+	}
+
+	d_string_append_c_array(out, buf, len);
+}
+
+
+#ifdef TEST
+/// Simple deterministic pseudo-random numbers for tests
+static uint64_t next_random(uint64_t * state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+
+	return *state;
+}
+
+
+/// Random values with a mix of magnitudes and decimal places
+static double random_value(uint64_t * state) {
+	uint64_t r = next_random(state);
+	double d;
+
+	switch (r % 5) {
+		case 0:
+			// Prices
+			return (double)(int64_t)(r % 10000000 - 5000000) / 100.0;
+
+		case 1:
+			// Short decimals at various scales
+			return (double)(r % 100000) / pow10_double[(r >> 20) % 12];
+
+		case 2:
+			// Arbitrary bit patterns
+			memcpy(&d, &r, sizeof(d));
+			return isfinite(d) ? d : 1.0;
+
+		case 3:
+			// Near rounding boundaries
+			return ((double)(r % 2000000) + 0.5) / 1e6;
+
+		default:
+			// Uniform in [-1000, 1000)
+			return ((double)(r >> 11) / 9007199254740992.0) * 2000.0 - 1000.0;
+	}
+}
+
+
+/// Number of significant digits in a formatted number
+static int significant_digits(const char * s) {
+	char digits[kNumberBufferSize];
+	int k = 0;
+
+	for (; *s && *s != 'e'; s++) {
+		if (*s >= '0' && *s <= '9' && (k || *s != '0')) {
+			digits[k++] = *s;
+		}
+	}
+
+	while (k && digits[k - 1] == '0') {
+		k--;
+	}
+
+	return k ? k : 1;
+}
+
+
+void Test_number_legacy(CuTest * tc) {
+	char buf[kNumberBufferSize];
+	char expected[kNumberBufferSize];
+	uint64_t state = 88172645463325252ULL;
+	double d;
+	size_t len;
+	int i;
+
+	number_format_legacy(buf, 1234567890123456);
+	CuAssertStrEquals(tc, "1234567890123456", buf);
+
+	number_format_legacy(buf, 3.1415926535897932384626433832795028841971693993751058209749445923);
+	CuAssertStrEquals(tc, "3.141593", buf);
+
+	number_format_legacy(buf, 0.000004999000004999);
+	CuAssertStrEquals(tc, "0.000004999000005", buf);
+
+	number_format_legacy(buf, 0.000004999000000000);
+	CuAssertStrEquals(tc, "0.000004999", buf);
+
+	number_format_legacy(buf, -0.0);
+	CuAssertStrEquals(tc, "-0", buf);
+
+	number_format_legacy(buf, -1e-20);
+	CuAssertStrEquals(tc, "-0", buf);
+
+	number_format_legacy(buf, 2.0000005);
+	CuAssertStrEquals(tc, "2.000001", buf);
+
+	// Used to overflow the buffer
+	len = number_format_legacy(buf, 1e300);
+	CuAssertIntEquals(tc, 301, (int) len);
+
+	// Must match sprintf() followed by removing trailing zeros
+	for (i = 0; i < 100000; i++) {
+		d = random_value(&state);
+
+		len = sprintf(expected, "%.*f", (d > 1.0) ? 6 : 15, d);
+		trim_zeros(expected, len);
+
+		number_format_legacy(buf, d);
+		CuAssertStrEquals(tc, expected, buf);
+	}
+}
+
+
+void Test_number_fixed(CuTest * tc) {
+	char buf[kNumberBufferSize];
+	char expected[kNumberBufferSize];
+	uint64_t state = 2463534242ULL;
+	double d;
+	int decimals;
+	int i;
+
+	number_format_fixed(buf, 2.5, 2);
+	CuAssertStrEquals(tc, "2.50", buf);
+
+	number_format_fixed(buf, 1.005, 2);
+	CuAssertStrEquals(tc, "1.00", buf);
+
+	number_format_fixed(buf, 2.5, 0);
+	CuAssertStrEquals(tc, "2", buf);
+
+	number_format_fixed(buf, 3.5, 0);
+	CuAssertStrEquals(tc, "4", buf);
+
+	number_format_fixed(buf, -0.125, 2);
+	CuAssertStrEquals(tc, "-0.12", buf);
+
+	number_format_fixed(buf, 42, -3);
+	CuAssertStrEquals(tc, "42", buf);
+
+	for (i = 0; i < 100000; i++) {
+		d = random_value(&state);
+		decimals = (int)(next_random(&state) % (kNumberMaxDecimals + 1));
+
+		sprintf(expected, "%.*f", decimals, d);
+
+		number_format_fixed(buf, d, decimals);
+		CuAssertStrEquals(tc, expected, buf);
+	}
+}
+
+
+void Test_number_shortest(CuTest * tc) {
+	char buf[kNumberBufferSize];
+	char tmp[32];
+	uint64_t state = 1181783497276652981ULL;
+	double d;
+	int precision;
+	int i;
+
+	number_format_shortest(buf, 0.1);
+	CuAssertStrEquals(tc, "0.1", buf);
+
+	number_format_shortest(buf, 1.0 / 3.0);
+	CuAssertStrEquals(tc, "0.3333333333333333", buf);
+
+	number_format_shortest(buf, 19.99);
+	CuAssertStrEquals(tc, "19.99", buf);
+
+	number_format_shortest(buf, -1234567);
+	CuAssertStrEquals(tc, "-1234567", buf);
+
+	number_format_shortest(buf, 0.000001);
+	CuAssertStrEquals(tc, "0.000001", buf);
+
+	number_format_shortest(buf, 1e-7);
+	CuAssertStrEquals(tc, "1e-7", buf);
+
+	number_format_shortest(buf, 1.5e300);
+	CuAssertStrEquals(tc, "1.5e+300", buf);
+
+	number_format_shortest(buf, 1e21);
+	CuAssertStrEquals(tc, "1e+21", buf);
+
+	number_format_shortest(buf, 123456789012345680000.0);
+	CuAssertStrEquals(tc, "123456789012345680000", buf);
+
+	number_format_shortest(buf, 5e-324);
+	CuAssertStrEquals(tc, "5e-324", buf);
+
+	number_format_shortest(buf, DBL_MAX);
+	CuAssertStrEquals(tc, "1.7976931348623157e+308", buf);
+
+	number_format_shortest(buf, -0.0);
+	CuAssertStrEquals(tc, "-0", buf);
+
+	// Must round trip, with the fewest possible significant digits
+	for (i = 0; i < 20000; i++) {
+		d = random_value(&state);
+
+		number_format_shortest(buf, d);
+		CuAssertTrue(tc, strtod(buf, NULL) == d);
+
+		for (precision = 1; precision < 17; precision++) {
+			sprintf(tmp, "%.*e", precision - 1, d);
+
+			if (strtod(tmp, NULL) == d) {
+				break;
+			}
+		}
+
+		CuAssertIntEquals(tc, precision, significant_digits(buf));
+	}
+}
+#endif
@@ -0,0 +1,93 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file number.h
+
+	@brief Format numbers for output.
+
+	Integral values and values with a modest number of decimal places are
+	formatted with integer arithmetic; `sprintf()` is only used as a fallback
+	for cases (huge values, exact ties) where the fast path can't guarantee
+	the same result.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef NUMBER_MAGNUM_H
+#define NUMBER_MAGNUM_H
+
+#include <stddef.h>
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// From d_string.h:
+typedef struct DString DString;
+
+
+/// Large enough for any double in any supported format
+#define kNumberBufferSize	400
+
+/// Maximum number of decimal places for `MAGNUM_NUMBER_FIXED`
+#define kNumberMaxDecimals	20
+
+
+/// Legacy format -- 6 decimal places for values greater than 1, 15 otherwise,
+/// with trailing zeros removed.  Returns length of string written to `buf`.
+size_t number_format_legacy(char * buf, double value);
+
+
+/// Shortest string that parses back to exactly the same double.  Fixed
+/// notation is used for 1e-6 <= |value| < 1e21, exponential otherwise.
+/// Returns length of string written to `buf`.
+size_t number_format_shortest(char * buf, double value);
+
+
+/// Round to `decimals` places, keeping trailing zeros.  Returns length of
+/// string written to `buf`.
+size_t number_format_fixed(char * buf, double value, int decimals);
+
+
+/// Append `value` to `out` using the specified format (one of the
+/// `MAGNUM_NUMBER_*` values).  `decimals` is only used for
+/// `MAGNUM_NUMBER_FIXED`.
+void number_append(DString * out, double value, int format, int decimals);
+
+
+#endif
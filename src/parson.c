@@ -36,6 +36,19 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+
+/* Vectorized scanning -- SSE2 is part of the x86-64 baseline, AVX2 is chosen at runtime */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#ifdef __SSE2__
+#define PARSON_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#define PARSON_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
@@ -48,9 +61,17 @@
 #define NUM_BUF_SIZE 64 /* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's be paranoid and use 64 */
 
 #define SIZEOF_TOKEN(a)       (sizeof(a) - 1)
-#define SKIP_CHAR(str)        ((*str)++)
-#define SKIP_WHITESPACES(str) while (isspace((unsigned char)(**str))) { SKIP_CHAR(str); }
+#define CURRENT_CHAR(parser)  ((parser)->cursor < (parser)->end ? *(parser)->cursor : '\0')
+#define REMAINING(parser)     ((size_t)((parser)->end - (parser)->cursor))
+#define SKIP_CHAR(parser)     ((parser)->cursor++)
+#define SKIP_WHITESPACES(parser) skip_whitespaces(parser)
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
+#define MIN(a, b)             ((a) < (b) ? (a) : (b))
+
+#define ARENA_ALIGNMENT       8
+#define ARENA_ALIGN(n)        (((n) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_MIN_BLOCK_SIZE  4096
+#define ARENA_MAX_BLOCK_SIZE  (64 * 1024 * 1024)
 
 #undef malloc
 #undef free
@@ -68,6 +89,12 @@ static int parson_escape_slashes = 1;
 
 #define IS_CONT(b) (((unsigned char)(b) & 0xC0) == 0x80) /* is utf-8 continuation byte */
 
+/* Same set as isspace() in the C locale, without the function call */
+#define IS_SPACE(c) ((c) == ' ' || ((unsigned char)(c) - '\t') < 5)
+
+/* skip_quotes() results */
+#define STRING_ESCAPED 1 /* contains a backslash, so it has to be decoded */
+
 /* Type definitions */
 typedef union json_value_value {
     char        *string;
@@ -78,14 +105,38 @@ typedef union json_value_value {
     int          null;
 } JSON_Value_Value;
 
+/* Value flags */
+#define JSON_VALUE_IN_ARENA    1 /* allocated from a document arena, freed with it */
+#define JSON_VALUE_ARENA_ROOT  2 /* root of an arena document, owns the arena */
+
 struct json_value_t {
     JSON_Value      *parent;
     JSON_Value_Type  type;
+    int              flags;
     JSON_Value_Value value;
 };
 
+/* Bump allocator -- a list of blocks, current block first */
+typedef struct json_arena_block_t {
+    struct json_arena_block_t *next;
+    size_t                     used;
+    size_t                     size;
+} JSON_Arena_Block;
+
+typedef struct json_arena_t {
+    JSON_Arena_Block *blocks;
+    size_t            next_size;
+} JSON_Arena;
+
+/* Arena document -- the root value lives beside the arena that holds the rest of the tree */
+typedef struct json_document_t {
+    JSON_Arena arena;
+    JSON_Value root;
+} JSON_Document;
+
 struct json_object_t {
     JSON_Value  *wrapping_value;
+    JSON_Arena  *arena; /* NULL if heap allocated */
     char       **names;
     JSON_Value **values;
     size_t       count;
@@ -94,14 +145,26 @@ struct json_object_t {
 
 struct json_array_t {
     JSON_Value  *wrapping_value;
+    JSON_Arena  *arena; /* NULL if heap allocated */
     JSON_Value **items;
     size_t       count;
     size_t       capacity;
 };
 
+/* Parser state -- input doesn't need to be NUL-terminated */
+typedef struct json_parser_t {
+    const char *cursor;
+    const char *end;
+    JSON_Arena *arena; /* NULL to allocate from the heap */
+    int         in_situ; /* decode strings in place -- the input is writable */
+    int         trusted; /* skip duplicate key checks */
+    int         comments; /* skip comments along with whitespace */
+    JSON_Key_Filter filter; /* NULL to keep every object member */
+    void       *filter_context;
+} JSON_Parser;
+
 /* Various */
 static char * read_file(const char *filename);
-static void   remove_comments(char *string, const char *start_token, const char *end_token);
 static char * parson_strndup(const char *string, size_t n);
 static char * parson_strdup(const char *string);
 static int    hex_char_to_int(char c);
@@ -109,39 +172,59 @@ static int    parse_utf16_hex(const char *string, unsigned int *result);
 static int    num_bytes_in_utf8_sequence(unsigned char c);
 static int    verify_utf8_sequence(const unsigned char *string, int *len);
 static int    is_valid_utf8(const char *string, size_t string_len);
-static int    is_decimal(const char *string, size_t length);
+static const char * skip_ascii(const char *string, const char *end);
+static size_t parse_number(const char *string, const char *end, double *number);
+
+/* Arena */
+static void   arena_init(JSON_Arena *arena, size_t size_hint);
+static void * arena_alloc(JSON_Arena *arena, size_t size);
+static void   arena_trim(JSON_Arena *arena, void *ptr, size_t size, size_t new_size);
+static void   arena_free(JSON_Arena *arena);
+static void * json_alloc(JSON_Arena *arena, size_t size);
+static void   json_dealloc(JSON_Arena *arena, void *ptr);
+static char * json_strndup(JSON_Arena *arena, const char *string, size_t n);
 
 /* JSON Object */
-static JSON_Object * json_object_init(JSON_Value *wrapping_value);
+static JSON_Object * json_object_init(JSON_Value *wrapping_value, JSON_Arena *arena);
 static JSON_Status   json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
 static JSON_Status   json_object_addn(JSON_Object *object, const char *name, size_t name_len, JSON_Value *value);
+static JSON_Status   json_object_append_owned(JSON_Object *object, char *name, JSON_Value *value);
 static JSON_Status   json_object_resize(JSON_Object *object, size_t new_capacity);
-static JSON_Value  * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len);
 static JSON_Status   json_object_remove_internal(JSON_Object *object, const char *name, int free_value);
 static JSON_Status   json_object_dotremove_internal(JSON_Object *object, const char *name, int free_value);
 static void          json_object_free(JSON_Object *object);
 
 /* JSON Array */
-static JSON_Array * json_array_init(JSON_Value *wrapping_value);
+static JSON_Array * json_array_init(JSON_Value *wrapping_value, JSON_Arena *arena);
 static JSON_Status  json_array_add(JSON_Array *array, JSON_Value *value);
 static JSON_Status  json_array_resize(JSON_Array *array, size_t new_capacity);
 static void         json_array_free(JSON_Array *array);
 
 /* JSON Value */
+static JSON_Value * json_value_new(JSON_Arena *arena, JSON_Value_Type type);
 static JSON_Value * json_value_init_string_no_copy(char *string);
+static JSON_Value * json_document_adopt_root(JSON_Document *document, JSON_Value *value);
 
 /* Parser */
-static JSON_Status  skip_quotes(const char **string);
-static int          parse_utf16(const char **unprocessed, char **processed);
-static char *       process_string(const char *input, size_t len);
-static char *       get_quoted_string(const char **string);
-static JSON_Value * parse_object_value(const char **string, size_t nesting);
-static JSON_Value * parse_array_value(const char **string, size_t nesting);
-static JSON_Value * parse_string_value(const char **string);
-static JSON_Value * parse_boolean_value(const char **string);
-static JSON_Value * parse_number_value(const char **string);
-static JSON_Value * parse_null_value(const char **string);
-static JSON_Value * parse_value(const char **string, size_t nesting);
+static void         skip_whitespaces(JSON_Parser *parser);
+static void         skip_comments(JSON_Parser *parser);
+static const char * scan_string(const char *string, const char *end);
+static JSON_Status  skip_quotes(JSON_Parser *parser, int *string_flags);
+static int          parse_utf16(const char **unprocessed, const char *end, char **processed);
+static char *       decode_string(const char *input, size_t len, char *output);
+static char *       process_string(JSON_Arena *arena, const char *input, size_t len);
+static char *       get_quoted_string(JSON_Parser *parser);
+static JSON_Value * parse_object_value(JSON_Parser *parser, size_t nesting);
+static JSON_Value * parse_array_value(JSON_Parser *parser, size_t nesting);
+static JSON_Value * parse_string_value(JSON_Parser *parser);
+static JSON_Value * parse_boolean_value(JSON_Parser *parser);
+static JSON_Value * parse_number_value(JSON_Parser *parser);
+static JSON_Value * parse_null_value(JSON_Parser *parser);
+static JSON_Value * parse_value(JSON_Parser *parser, size_t nesting);
+static char *       get_object_key(JSON_Parser *parser, int *keep);
+static const char * scan_structural(const char *string, const char *end);
+static JSON_Status  skip_value(JSON_Parser *parser);
+static JSON_Value * parse_document(const char *string, size_t len, int flags, int in_situ, JSON_Key_Filter filter, void *context);
 
 /* Serialization */
 static int    json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf);
@@ -248,10 +331,68 @@ static int verify_utf8_sequence(const unsigned char *string, int *len) {
     return 1;
 }
 
+#ifdef PARSON_HAVE_AVX2
+__attribute__((target("avx2")))
+static const char * skip_ascii_avx2(const char *string, const char *end) {
+    while (end - string >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)string);
+        if (_mm256_movemask_epi8(block)) {
+            break;
+        }
+        string += 32;
+    }
+    return string;
+}
+
+static int cpu_has_avx2(void) {
+    /* Benign race -- every thread would store the same result */
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return avx2;
+}
+#endif
+
+/* Returns the start of the first block of [string, end) that isn't plain ASCII
+   (so that ASCII runs can be validated a block at a time), or a point near the end. */
+static const char * skip_ascii(const char *string, const char *end) {
+#ifdef PARSON_HAVE_AVX2
+    if (end - string >= 64 && cpu_has_avx2()) {
+        string = skip_ascii_avx2(string, end);
+    }
+#endif
+#ifdef PARSON_HAVE_SSE2
+    while (end - string >= 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)string))) {
+            break;
+        }
+        string += 16;
+    }
+#endif
+    return string;
+}
+
 static int is_valid_utf8(const char *string, size_t string_len) {
     int len = 0;
     const char *string_end =  string + string_len;
+    const char *block_end = string;
     while (string < string_end) {
+        if (string >= block_end) { /* skip ASCII in bulk, then check the next block bytewise */
+            string = skip_ascii(string, string_end);
+            block_end = string + 16;
+            if (string >= string_end) {
+                break;
+            }
+        }
+        if ((unsigned char)*string < 0x80) {
+            string++;
+            continue;
+        }
+        if (string_end - string < 4 && num_bytes_in_utf8_sequence((unsigned char)*string) > string_end - string) {
+            return 0; /* truncated sequence */
+        }
         if (!verify_utf8_sequence((const unsigned char*)string, &len)) {
             return 0;
         }
@@ -260,19 +401,122 @@ static int is_valid_utf8(const char *string, size_t string_len) {
     return 1;
 }
 
-static int is_decimal(const char *string, size_t length) {
-    if (length > 1 && string[0] == '0' && string[1] != '.') {
+/* Powers of ten that are exactly representable as a double */
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define IS_DIGIT(c)          ((unsigned char)((c) - '0') < 10)
+#define MAX_MANTISSA_DIGITS  19 /* always fits in a uint64_t */
+#define MAX_EXACT_MANTISSA   ((uint64_t)1 << 53)
+
+/* Parses a JSON number at the start of [string, end), returning its length,
+   or 0 if it isn't valid.  Integers and short decimals are converted directly
+   (exactly, as in Clinger's fast path), and everything else with strtod(). */
+static size_t parse_number(const char *string, const char *end, double *number) {
+    const char *cursor = string;
+    char buf[NUM_BUF_SIZE];
+    char *copy = buf, *copy_end = NULL;
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0, exponent_value = 0;
+    int negative = 0, negative_exponent = 0, exact = 1;
+    size_t len = 0;
+    if (cursor < end && *cursor == '-') {
+        negative = 1;
+        cursor++;
+    }
+    if (cursor == end || !IS_DIGIT(*cursor)) {
         return 0;
     }
-    if (length > 2 && !strncmp(string, "-0", 2) && string[2] != '.') {
+    if (*cursor == '0') { /* no leading zeros */
+        cursor++;
+    } else {
+        while (cursor < end && IS_DIGIT(*cursor)) {
+            if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*cursor - '0');
+                digits++;
+            } else {
+                exact = 0;
+            }
+            cursor++;
+        }
+    }
+    if (cursor < end && *cursor == '.') {
+        cursor++;
+        if (cursor == end || !IS_DIGIT(*cursor)) {
+            return 0;
+        }
+        while (cursor < end && IS_DIGIT(*cursor)) {
+            if (mantissa == 0 && *cursor == '0') { /* leading zeros only move the exponent */
+                exponent--;
+            } else if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (*cursor - '0');
+                digits++;
+                exponent--;
+            } else {
+                exact = 0;
+            }
+            cursor++;
+        }
+    }
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+        cursor++;
+        if (cursor < end && (*cursor == '+' || *cursor == '-')) {
+            negative_exponent = (*cursor == '-');
+            cursor++;
+        }
+        if (cursor == end || !IS_DIGIT(*cursor)) {
+            return 0;
+        }
+        while (cursor < end && IS_DIGIT(*cursor)) {
+            if (exponent_value < 100000) { /* far beyond the range of a double */
+                exponent_value = exponent_value * 10 + (*cursor - '0');
+            }
+            cursor++;
+        }
+        exponent += negative_exponent ? -exponent_value : exponent_value;
+    }
+    /* Reject anything that runs on (leading zeros, hex, "1.2.3", ...) */
+    if (cursor < end && (isalnum((unsigned char)*cursor) || *cursor == '.' || *cursor == '+' || *cursor == '-')) {
         return 0;
     }
-    while (length--) {
-        if (strchr("xX", string[length])) {
+    len = (size_t)(cursor - string);
+    if (exact && exponent == 0) {
+        *number = (double)mantissa; /* rounded correctly, even beyond 2^53 */
+        *number = negative ? -*number : *number;
+        return len;
+    }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    /* Both operands are exact, so the single rounding of * or / is correct */
+    if (exact && mantissa <= MAX_EXACT_MANTISSA && exponent >= -22 && exponent <= 22) {
+        if (exponent < 0) {
+            *number = (double)mantissa / exact_powers_of_ten[-exponent];
+        } else {
+            *number = (double)mantissa * exact_powers_of_ten[exponent];
+        }
+        *number = negative ? -*number : *number;
+        return len;
+    }
+#endif
+    /* strtod() needs a terminated string */
+    if (len >= NUM_BUF_SIZE) {
+        copy = (char*)parson_malloc(len + 1);
+        if (copy == NULL) {
             return 0;
         }
     }
-    return 1;
+    memcpy(copy, string, len);
+    copy[len] = '\0';
+    errno = 0;
+    *number = strtod(copy, &copy_end);
+    if (errno || copy_end != copy + len || IS_NUMBER_INVALID(*number)) {
+        len = 0;
+    }
+    if (copy != buf) {
+        parson_free(copy);
+    }
+    return len;
 }
 
 static char * read_file(const char * filename) {
@@ -308,48 +552,91 @@ static char * read_file(const char * filename) {
     return file_contents;
 }
 
-static void remove_comments(char *string, const char *start_token, const char *end_token) {
-    int in_string = 0, escaped = 0;
-    size_t i;
-    char *ptr = NULL, current_char;
-    size_t start_token_len = strlen(start_token);
-    size_t end_token_len = strlen(end_token);
-    if (start_token_len == 0 || end_token_len == 0) {
-        return;
+/* Arena */
+static void arena_init(JSON_Arena *arena, size_t size_hint) {
+    arena->blocks = NULL;
+    /* A parsed tree usually takes a small multiple of the text size */
+    arena->next_size = MAX(ARENA_MIN_BLOCK_SIZE, MIN(size_hint * 2, ARENA_MAX_BLOCK_SIZE));
+}
+
+static void * arena_alloc(JSON_Arena *arena, size_t size) {
+    const size_t header_size = ARENA_ALIGN(sizeof(JSON_Arena_Block));
+    JSON_Arena_Block *block = arena->blocks;
+    size_t block_size = 0;
+    size = ARENA_ALIGN(size);
+    if (block != NULL && block->size - block->used >= size) {
+        block->used += size;
+        return (char*)block + header_size + block->used - size;
     }
-    while ((current_char = *string) != '\0') {
-        if (current_char == '\\' && !escaped) {
-            escaped = 1;
-            string++;
-            continue;
-        } else if (current_char == '\"' && !escaped) {
-            in_string = !in_string;
-        } else if (!in_string && strncmp(string, start_token, start_token_len) == 0) {
-            for(i = 0; i < start_token_len; i++) {
-                string[i] = ' ';
-            }
-            string = string + start_token_len;
-            ptr = strstr(string, end_token);
-            if (!ptr) {
-                return;
-            }
-            for (i = 0; i < (ptr - string) + end_token_len; i++) {
-                string[i] = ' ';
-            }
-            string = ptr + end_token_len - 1;
-        }
-        escaped = 0;
-        string++;
+    block_size = MAX(arena->next_size, size);
+    block = (JSON_Arena_Block*)parson_malloc(header_size + block_size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->used = size;
+    block->size = block_size;
+    if (block_size > arena->next_size && arena->blocks != NULL) {
+        /* Oversized request -- keep filling the current block */
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+    } else {
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->next_size = MIN(block_size * 2, ARENA_MAX_BLOCK_SIZE);
+    }
+    return (char*)block + header_size;
+}
+
+/* Shrinks the most recent allocation in place, if it can */
+static void arena_trim(JSON_Arena *arena, void *ptr, size_t size, size_t new_size) {
+    const size_t header_size = ARENA_ALIGN(sizeof(JSON_Arena_Block));
+    JSON_Arena_Block *block = arena->blocks;
+    size = ARENA_ALIGN(size);
+    new_size = ARENA_ALIGN(new_size);
+    if (block != NULL && block->used >= size &&
+        (char*)ptr == (char*)block + header_size + block->used - size) {
+        block->used -= size - new_size;
+    }
+}
+
+static void arena_free(JSON_Arena *arena) {
+    JSON_Arena_Block *block = arena->blocks, *next = NULL;
+    while (block != NULL) {
+        next = block->next;
+        parson_free(block);
+        block = next;
     }
+    arena->blocks = NULL;
+}
+
+static void * json_alloc(JSON_Arena *arena, size_t size) {
+    return arena ? arena_alloc(arena, size) : parson_malloc(size);
+}
+
+static void json_dealloc(JSON_Arena *arena, void *ptr) {
+    if (arena == NULL) { /* arena memory is released with its document */
+        parson_free(ptr);
+    }
+}
+
+static char * json_strndup(JSON_Arena *arena, const char *string, size_t n) {
+    char *output_string = (char*)json_alloc(arena, n + 1);
+    if (!output_string) {
+        return NULL;
+    }
+    output_string[n] = '\0';
+    memcpy(output_string, string, n);
+    return output_string;
 }
 
 /* JSON Object */
-static JSON_Object * json_object_init(JSON_Value *wrapping_value) {
-    JSON_Object *new_obj = (JSON_Object*)parson_malloc(sizeof(JSON_Object));
+static JSON_Object * json_object_init(JSON_Value *wrapping_value, JSON_Arena *arena) {
+    JSON_Object *new_obj = (JSON_Object*)json_alloc(arena, sizeof(JSON_Object));
     if (new_obj == NULL) {
         return NULL;
     }
     new_obj->wrapping_value = wrapping_value;
+    new_obj->arena = arena;
     new_obj->names = (char**)NULL;
     new_obj->values = (JSON_Value**)NULL;
     new_obj->capacity = 0;
@@ -365,13 +652,27 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
 }
 
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len, JSON_Value *value) {
-    size_t index = 0;
+    char *name_copy = NULL;
     if (object == NULL || name == NULL || value == NULL) {
         return JSONFailure;
     }
     if (json_object_getn_value(object, name, name_len) != NULL) {
         return JSONFailure;
     }
+    name_copy = json_strndup(object->arena, name, name_len);
+    if (name_copy == NULL) {
+        return JSONFailure;
+    }
+    if (json_object_append_owned(object, name_copy, value) == JSONFailure) {
+        json_dealloc(object->arena, name_copy);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+/* Appends a key that's already been checked for uniqueness, taking ownership of name */
+static JSON_Status json_object_append_owned(JSON_Object *object, char *name, JSON_Value *value) {
+    size_t index = 0;
     if (object->count >= object->capacity) {
         size_t new_capacity = MAX(object->capacity * 2, STARTING_CAPACITY);
         if (json_object_resize(object, new_capacity) == JSONFailure) {
@@ -379,10 +680,7 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
         }
     }
     index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
-    if (object->names[index] == NULL) {
-        return JSONFailure;
-    }
+    object->names[index] = name;
     value->parent = json_object_get_wrapping_value(object);
     object->values[index] = value;
     object->count++;
@@ -398,28 +696,28 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
         new_capacity == 0) {
             return JSONFailure; /* Shouldn't happen */
     }
-    temp_names = (char**)parson_malloc(new_capacity * sizeof(char*));
+    temp_names = (char**)json_alloc(object->arena, new_capacity * sizeof(char*));
     if (temp_names == NULL) {
         return JSONFailure;
     }
-    temp_values = (JSON_Value**)parson_malloc(new_capacity * sizeof(JSON_Value*));
+    temp_values = (JSON_Value**)json_alloc(object->arena, new_capacity * sizeof(JSON_Value*));
     if (temp_values == NULL) {
-        parson_free(temp_names);
+        json_dealloc(object->arena, temp_names);
         return JSONFailure;
     }
     if (object->names != NULL && object->values != NULL && object->count > 0) {
         memcpy(temp_names, object->names, object->count * sizeof(char*));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value*));
     }
-    parson_free(object->names);
-    parson_free(object->values);
+    json_dealloc(object->arena, object->names);
+    json_dealloc(object->arena, object->values);
     object->names = temp_names;
     object->values = temp_values;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
-static JSON_Value * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len) {
+JSON_Value * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len) {
     size_t i, name_length;
     for (i = 0; i < json_object_get_count(object); i++) {
         name_length = strlen(object->names[i]);
@@ -435,7 +733,7 @@ static JSON_Value * json_object_getn_value(const JSON_Object *object, const char
 
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name, int free_value) {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL) {
+    if (object == NULL || object->arena != NULL || json_object_get_value(object, name) == NULL) {
         return JSONFailure;
     }
     last_item_index = json_object_get_count(object) - 1;
@@ -483,12 +781,13 @@ static void json_object_free(JSON_Object *object) {
 }
 
 /* JSON Array */
-static JSON_Array * json_array_init(JSON_Value *wrapping_value) {
-    JSON_Array *new_array = (JSON_Array*)parson_malloc(sizeof(JSON_Array));
+static JSON_Array * json_array_init(JSON_Value *wrapping_value, JSON_Arena *arena) {
+    JSON_Array *new_array = (JSON_Array*)json_alloc(arena, sizeof(JSON_Array));
     if (new_array == NULL) {
         return NULL;
     }
     new_array->wrapping_value = wrapping_value;
+    new_array->arena = arena;
     new_array->items = (JSON_Value**)NULL;
     new_array->capacity = 0;
     new_array->count = 0;
@@ -513,14 +812,14 @@ static JSON_Status json_array_resize(JSON_Array *array, size_t new_capacity) {
     if (new_capacity == 0) {
         return JSONFailure;
     }
-    new_items = (JSON_Value**)parson_malloc(new_capacity * sizeof(JSON_Value*));
+    new_items = (JSON_Value**)json_alloc(array->arena, new_capacity * sizeof(JSON_Value*));
     if (new_items == NULL) {
         return JSONFailure;
     }
     if (array->items != NULL && array->count > 0) {
         memcpy(new_items, array->items, array->count * sizeof(JSON_Value*));
     }
-    parson_free(array->items);
+    json_dealloc(array->arena, array->items);
     array->items = new_items;
     array->capacity = new_capacity;
     return JSONSuccess;
@@ -536,44 +835,178 @@ static void json_array_free(JSON_Array *array) {
 }
 
 /* JSON Value */
-static JSON_Value * json_value_init_string_no_copy(char *string) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+static JSON_Value * json_value_new(JSON_Arena *arena, JSON_Value_Type type) {
+    JSON_Value *new_value = (JSON_Value*)json_alloc(arena, sizeof(JSON_Value));
     if (!new_value) {
         return NULL;
     }
     new_value->parent = NULL;
-    new_value->type = JSONString;
+    new_value->type = type;
+    new_value->flags = arena ? JSON_VALUE_IN_ARENA : 0;
+    if (type == JSONObject) {
+        new_value->value.object = json_object_init(new_value, arena);
+        if (!new_value->value.object) {
+            json_dealloc(arena, new_value);
+            return NULL;
+        }
+    } else if (type == JSONArray) {
+        new_value->value.array = json_array_init(new_value, arena);
+        if (!new_value->value.array) {
+            json_dealloc(arena, new_value);
+            return NULL;
+        }
+    }
+    return new_value;
+}
+
+static JSON_Value * json_value_init_string_no_copy(char *string) {
+    JSON_Value *new_value = json_value_new(NULL, JSONString);
+    if (!new_value) {
+        return NULL;
+    }
     new_value->value.string = string;
     return new_value;
 }
 
+/* Moves a parsed root into its document, so that freeing the root releases the arena */
+static JSON_Value * json_document_adopt_root(JSON_Document *document, JSON_Value *value) {
+    JSON_Value *root = &document->root;
+    size_t i = 0;
+    *root = *value;
+    root->flags |= JSON_VALUE_ARENA_ROOT;
+    if (root->type == JSONObject) {
+        root->value.object->wrapping_value = root;
+        for (i = 0; i < root->value.object->count; i++) {
+            root->value.object->values[i]->parent = root;
+        }
+    } else if (root->type == JSONArray) {
+        root->value.array->wrapping_value = root;
+        for (i = 0; i < root->value.array->count; i++) {
+            root->value.array->items[i]->parent = root;
+        }
+    }
+    return root;
+}
+
 /* Parser */
-static JSON_Status skip_quotes(const char **string) {
-    if (**string != '\"') {
+static void skip_whitespaces(JSON_Parser *parser) {
+    const char *cursor = parser->cursor;
+    const char *end = parser->end;
+#ifdef PARSON_HAVE_SSE2
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i below_tab = _mm_set1_epi8('\t' - 1);
+    const __m128i above_cr = _mm_set1_epi8('\r' + 1);
+    __m128i block;
+    unsigned int mask;
+    /* Most runs are a single space or newline -- only indentation is worth a vector */
+    if (cursor + 1 < end && IS_SPACE(cursor[0]) && IS_SPACE(cursor[1])) {
+        while (end - cursor >= 16) {
+            block = _mm_loadu_si128((const __m128i *)cursor);
+            mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, space),
+                _mm_and_si128(_mm_cmpgt_epi8(block, below_tab), _mm_cmplt_epi8(block, above_cr))));
+            if (mask != 0xFFFF) {
+                parser->cursor = cursor + __builtin_ctz(~mask);
+                return;
+            }
+            cursor += 16;
+        }
+    }
+#endif
+    while (cursor < end && IS_SPACE(*cursor)) {
+        cursor++;
+    }
+    parser->cursor = cursor;
+    if (parser->comments && cursor < end && *cursor == '/') {
+        skip_comments(parser);
+    }
+}
+
+/* Skips comments (/ * * / and //) and the whitespace around them. An unterminated
+   comment runs to the end of the input */
+static void skip_comments(JSON_Parser *parser) {
+    const char *cursor = parser->cursor;
+    const char *end = parser->end;
+    while (end - cursor >= 2 && cursor[0] == '/' && (cursor[1] == '/' || cursor[1] == '*')) {
+        if (cursor[1] == '/') {
+            cursor = (const char*)memchr(cursor + 2, '\n', (size_t)(end - cursor - 2));
+            cursor = cursor ? cursor + 1 : end;
+        } else {
+            cursor += 2;
+            while ((cursor = (const char*)memchr(cursor, '*', (size_t)(end - cursor))) != NULL &&
+                   (cursor + 1 == end || cursor[1] != '/')) {
+                cursor++;
+            }
+            cursor = cursor ? cursor + 2 : end;
+        }
+        while (cursor < end && IS_SPACE(*cursor)) {
+            cursor++;
+        }
+    }
+    parser->cursor = cursor;
+}
+
+/* Returns the first quote, backslash or control character in [string, end), or end */
+static const char * scan_string(const char *string, const char *end) {
+#ifdef PARSON_HAVE_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x20);
+    __m128i block;
+    unsigned int mask;
+    while (end - string >= 16) {
+        block = _mm_loadu_si128((const __m128i *)string);
+        /* Signed compare -- bytes >= 0x80 are negative, so mask them back out */
+        mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+            _mm_andnot_si128(_mm_cmplt_epi8(block, _mm_setzero_si128()), _mm_cmplt_epi8(block, control))));
+        if (mask) {
+            return string + __builtin_ctz(mask);
+        }
+        string += 16;
+    }
+#endif
+    while (string < end && *string != '\"' && *string != '\\' && (unsigned char)*string >= 0x20) {
+        string++;
+    }
+    return string;
+}
+
+static JSON_Status skip_quotes(JSON_Parser *parser, int *string_flags) {
+    const char *cursor = NULL;
+    *string_flags = 0;
+    if (CURRENT_CHAR(parser) != '\"') {
         return JSONFailure;
     }
-    SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0') {
+    cursor = parser->cursor + 1;
+    for (;;) {
+        cursor = scan_string(cursor, parser->end);
+        if (cursor == parser->end) {
             return JSONFailure;
-        } else if (**string == '\\') {
-            SKIP_CHAR(string);
-            if (**string == '\0') {
+        } else if (*cursor == '\"') {
+            break;
+        } else if (*cursor == '\\') {
+            *string_flags |= STRING_ESCAPED;
+            if (parser->end - cursor < 2) {
                 return JSONFailure;
             }
+            cursor += 2;
+        } else {
+            return JSONFailure; /* control characters aren't allowed in a JSON string */
         }
-        SKIP_CHAR(string);
     }
-    SKIP_CHAR(string);
+    parser->cursor = cursor + 1;
     return JSONSuccess;
 }
 
-static int parse_utf16(const char **unprocessed, char **processed) {
+static int parse_utf16(const char **unprocessed, const char *end, char **processed) {
     unsigned int cp, lead, trail;
     int parse_succeeded = 0;
     char *processed_ptr = *processed;
     const char *unprocessed_ptr = *unprocessed;
     unprocessed_ptr++; /* skips u */
+    if (end - unprocessed_ptr < 4) {
+        return JSONFailure;
+    }
     parse_succeeded = parse_utf16_hex(unprocessed_ptr, &cp);
     if (!parse_succeeded) {
         return JSONFailure;
@@ -592,6 +1025,9 @@ static int parse_utf16(const char **unprocessed, char **processed) {
     } else if (cp >= 0xD800 && cp <= 0xDBFF) { /* lead surrogate (0xD800..0xDBFF) */
         lead = cp;
         unprocessed_ptr += 4; /* should always be within the buffer, otherwise previous sscanf would fail */
+        if (end - unprocessed_ptr < 6) {
+            return JSONFailure;
+        }
         if (*unprocessed_ptr++ != '\\' || *unprocessed_ptr++ != 'u') {
             return JSONFailure;
         }
@@ -615,19 +1051,23 @@ static int parse_utf16(const char **unprocessed, char **processed) {
 }
 
 
-/* Copies and processes passed string up to supplied length.
+/* Decodes passed string up to supplied length into output, which may be the
+   same as input (the output is never longer). Returns the end of the output,
+   which is NUL-terminated, or NULL on error.
 Example: "\u006Corem ipsum" -> lorem ipsum */
-static char* process_string(const char *input, size_t len) {
+static char * decode_string(const char *input, size_t len, char *output) {
     const char *input_ptr = input;
-    size_t initial_size = (len + 1) * sizeof(char);
-    size_t final_size = 0;
-    char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
-    output = (char*)parson_malloc(initial_size);
-    if (output == NULL) {
-        goto error;
-    }
-    output_ptr = output;
-    while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
+    const char *input_end = input + len;
+    const char *run_end = NULL;
+    char *output_ptr = output;
+    while (input_ptr < input_end) {
+        run_end = scan_string(input_ptr, input_end); /* copy everything up to the next escape at once */
+        if (run_end != input_ptr) {
+            memmove(output_ptr, input_ptr, run_end - input_ptr);
+            output_ptr += run_end - input_ptr;
+            input_ptr = run_end;
+            continue;
+        }
         if (*input_ptr == '\\') {
             input_ptr++;
             switch (*input_ptr) {
@@ -640,15 +1080,15 @@ static char* process_string(const char *input, size_t len) {
                 case 'r':  *output_ptr = '\r'; break;
                 case 't':  *output_ptr = '\t'; break;
                 case 'u':
-                    if (parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
-                        goto error;
+                    if (parse_utf16(&input_ptr, input + len, &output_ptr) == JSONFailure) {
+                        return NULL;
                     }
                     break;
                 default:
-                    goto error;
+                    return NULL;
             }
         } else if ((unsigned char)*input_ptr < 0x20) {
-            goto error; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
+            return NULL; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
         } else {
             *output_ptr = *input_ptr;
         }
@@ -656,141 +1096,331 @@ static char* process_string(const char *input, size_t len) {
         input_ptr++;
     }
     *output_ptr = '\0';
+    return output_ptr;
+}
+
+/* Copies and processes passed string up to supplied length. */
+static char* process_string(JSON_Arena *arena, const char *input, size_t len) {
+    size_t initial_size = (len + 1) * sizeof(char);
+    size_t final_size = 0;
+    char *output = NULL, *output_end = NULL, *resized_output = NULL;
+    output = (char*)json_alloc(arena, initial_size);
+    if (output == NULL) {
+        return NULL;
+    }
+    output_end = decode_string(input, len, output);
+    if (output_end == NULL) {
+        json_dealloc(arena, output);
+        return NULL;
+    }
     /* resize to new length */
-    final_size = (size_t)(output_ptr-output) + 1;
-    /* todo: don't resize if final_size == initial_size */
+    final_size = (size_t)(output_end - output) + 1;
+    if (arena != NULL) {
+        arena_trim(arena, output, initial_size, final_size);
+        return output;
+    }
+    if (final_size == initial_size) {
+        return output;
+    }
     resized_output = (char*)parson_malloc(final_size);
     if (resized_output == NULL) {
-        goto error;
+        parson_free(output);
+        return NULL;
     }
     memcpy(resized_output, output, final_size);
     parson_free(output);
     return resized_output;
-error:
-    parson_free(output);
-    return NULL;
 }
 
 /* Return processed contents of a string between quotes and
    skips passed argument to a matching quote. */
-static char * get_quoted_string(const char **string) {
-    const char *string_start = *string;
+static char * get_quoted_string(JSON_Parser *parser) {
+    const char *string_start = parser->cursor;
+    char *output = NULL;
     size_t string_len = 0;
-    JSON_Status status = skip_quotes(string);
+    int string_flags = 0;
+    JSON_Status status = skip_quotes(parser, &string_flags);
     if (status != JSONSuccess) {
         return NULL;
     }
-    string_len = *string - string_start - 2; /* length without quotes */
-    return process_string(string_start + 1, string_len);
+    string_len = parser->cursor - string_start - 2; /* length without quotes */
+    if (string_flags & STRING_ESCAPED) {
+        if (parser->in_situ) { /* the closing quote (at the latest) becomes the terminator */
+            output = (char*)string_start + 1;
+            return decode_string(output, string_len, output) ? output : NULL;
+        }
+        return process_string(parser->arena, string_start + 1, string_len);
+    }
+    /* Nothing to decode -- skip_quotes() already rejected control characters */
+    if (parser->in_situ) {
+        output = (char*)string_start + 1;
+        output[string_len] = '\0';
+        return output;
+    }
+    return json_strndup(parser->arena, string_start + 1, string_len);
+}
+
+/* Returns the key of the next object member, and sets *keep to the filter's decision
+   about it. If the member is dropped (JSONKeySkip) the key isn't copied, and NULL is
+   returned; otherwise NULL means an error */
+static char * get_object_key(JSON_Parser *parser, int *keep) {
+    const char *key_start = parser->cursor;
+    char *key = NULL;
+    int string_flags = 0;
+    *keep = JSONKeyKeep;
+    if (parser->filter == NULL) {
+        return get_quoted_string(parser);
+    }
+    if (skip_quotes(parser, &string_flags) != JSONSuccess) {
+        return NULL;
+    }
+    if (!(string_flags & STRING_ESCAPED)) { /* decide before copying anything */
+        *keep = parser->filter(key_start + 1, parser->cursor - key_start - 2, parser->filter_context);
+        if (*keep == JSONKeySkip) {
+            return NULL;
+        }
+    }
+    parser->cursor = key_start;
+    key = get_quoted_string(parser);
+    if (key != NULL && (string_flags & STRING_ESCAPED)) {
+        *keep = parser->filter(key, strlen(key), parser->filter_context);
+        if (*keep == JSONKeySkip) {
+            json_dealloc(parser->arena, key);
+            return NULL;
+        }
+    }
+    return key;
+}
+
+/* Returns the first quote, bracket or NUL in [string, end), or end */
+static const char * scan_structural(const char *string, const char *end) {
+#ifdef PARSON_HAVE_SSE2
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i nul = _mm_setzero_si128();
+    const __m128i open_array = _mm_set1_epi8('[');
+    const __m128i close_array = _mm_set1_epi8(']');
+    const __m128i open_object = _mm_set1_epi8('{');
+    const __m128i close_object = _mm_set1_epi8('}');
+    const __m128i slash = _mm_set1_epi8('/');
+    __m128i block;
+    unsigned int mask;
+    while (end - string >= 16) {
+        block = _mm_loadu_si128((const __m128i *)string);
+        mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, nul)),
+                         _mm_or_si128(_mm_cmpeq_epi8(block, open_array), _mm_cmpeq_epi8(block, close_array))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, open_object), _mm_cmpeq_epi8(block, close_object)),
+                         _mm_cmpeq_epi8(block, slash))));
+        if (mask) {
+            return string + __builtin_ctz(mask);
+        }
+        string += 16;
+    }
+#endif
+    while (string < end && *string != '\"' && *string != '\0' && *string != '/' &&
+           *string != '{' && *string != '}' && *string != '[' && *string != ']') {
+        string++;
+    }
+    return string;
+}
+
+/* Skips the next value without building it -- only strings and the nesting of
+   brackets are checked */
+static JSON_Status skip_value(JSON_Parser *parser) {
+    unsigned char is_object[MAX_NESTING / 8 + 1];
+    size_t depth = 0;
+    int string_flags = 0;
+    char c;
+    SKIP_WHITESPACES(parser);
+    c = CURRENT_CHAR(parser);
+    if (c != '{' && c != '[' && c != '\"' && c != 't' && c != 'f' && c != 'n' && c != '-' && !IS_DIGIT(c)) {
+        return JSONFailure;
+    }
+    for (;;) {
+        c = CURRENT_CHAR(parser);
+        switch (c) {
+            case '\"':
+                if (skip_quotes(parser, &string_flags) != JSONSuccess) {
+                    return JSONFailure;
+                }
+                continue;
+            case '{': case '[':
+                if (depth == MAX_NESTING) {
+                    return JSONFailure;
+                }
+                if (c == '{') {
+                    is_object[depth / 8] |= (unsigned char)(1 << (depth % 8));
+                } else {
+                    is_object[depth / 8] &= (unsigned char)~(1 << (depth % 8));
+                }
+                depth++;
+                break;
+            case '}': case ']':
+                if (depth == 0) {
+                    return JSONSuccess; /* end of the enclosing container */
+                }
+                depth--;
+                if ((c == '}') != ((is_object[depth / 8] >> (depth % 8)) & 1)) {
+                    return JSONFailure;
+                }
+                break;
+            case ',':
+                if (depth == 0) {
+                    return JSONSuccess;
+                }
+                break;
+            case '\0':
+                return JSONFailure;
+            case '/': /* only valid as the start of a comment */
+                if (!parser->comments) {
+                    return JSONFailure;
+                }
+                skip_comments(parser);
+                if (CURRENT_CHAR(parser) == '/') {
+                    return JSONFailure;
+                }
+                continue;
+            default:
+                if (depth > 0) { /* commas don't matter inside a container */
+                    parser->cursor = scan_structural(parser->cursor, parser->end);
+                    continue;
+                }
+                break;
+        }
+        SKIP_CHAR(parser);
+        if (depth == 0 && (c == '}' || c == ']')) {
+            return JSONSuccess;
+        }
+    }
 }
 
-static JSON_Value * parse_value(const char **string, size_t nesting) {
+static JSON_Value * parse_value(JSON_Parser *parser, size_t nesting) {
     if (nesting > MAX_NESTING) {
         return NULL;
     }
-    SKIP_WHITESPACES(string);
-    switch (**string) {
+    SKIP_WHITESPACES(parser);
+    switch (CURRENT_CHAR(parser)) {
         case '{':
-            return parse_object_value(string, nesting + 1);
+            return parse_object_value(parser, nesting + 1);
         case '[':
-            return parse_array_value(string, nesting + 1);
+            return parse_array_value(parser, nesting + 1);
         case '\"':
-            return parse_string_value(string);
+            return parse_string_value(parser);
         case 'f': case 't':
-            return parse_boolean_value(string);
+            return parse_boolean_value(parser);
         case '-':
         case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
-            return parse_number_value(string);
+            return parse_number_value(parser);
         case 'n':
-            return parse_null_value(string);
+            return parse_null_value(parser);
         default:
             return NULL;
     }
 }
 
-static JSON_Value * parse_object_value(const char **string, size_t nesting) {
+static JSON_Value * parse_object_value(JSON_Parser *parser, size_t nesting) {
     JSON_Value *output_value = NULL, *new_value = NULL;
     JSON_Object *output_object = NULL;
     char *new_key = NULL;
-    output_value = json_value_init_object();
+    JSON_Key_Filter filter = parser->filter;
+    int keep = JSONKeyKeep;
+    output_value = json_value_new(parser->arena, JSONObject);
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '{') {
+    if (CURRENT_CHAR(parser) != '{') {
         json_value_free(output_value);
         return NULL;
     }
     output_object = json_value_get_object(output_value);
-    SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == '}') { /* empty object */
-        SKIP_CHAR(string);
+    SKIP_CHAR(parser);
+    SKIP_WHITESPACES(parser);
+    if (CURRENT_CHAR(parser) == '}') { /* empty object */
+        SKIP_CHAR(parser);
         return output_value;
     }
-    while (**string != '\0') {
-        new_key = get_quoted_string(string);
-        if (new_key == NULL) {
+    while (CURRENT_CHAR(parser) != '\0') {
+        new_key = get_object_key(parser, &keep);
+        if (new_key == NULL && keep != JSONKeySkip) {
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_WHITESPACES(string);
-        if (**string != ':') {
-            parson_free(new_key);
+        SKIP_WHITESPACES(parser);
+        if (CURRENT_CHAR(parser) != ':') {
+            json_dealloc(parser->arena, new_key);
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_CHAR(string);
-        new_value = parse_value(string, nesting);
+        SKIP_CHAR(parser);
+        if (new_key == NULL) { /* filtered out */
+            if (skip_value(parser) != JSONSuccess) {
+                json_value_free(output_value);
+                return NULL;
+            }
+            SKIP_WHITESPACES(parser);
+            if (CURRENT_CHAR(parser) != ',') {
+                break;
+            }
+            SKIP_CHAR(parser);
+            SKIP_WHITESPACES(parser);
+            continue;
+        }
+        if (keep == JSONKeyKeepAll) {
+            parser->filter = NULL;
+        }
+        new_value = parse_value(parser, nesting);
+        parser->filter = filter;
         if (new_value == NULL) {
-            parson_free(new_key);
+            json_dealloc(parser->arena, new_key);
             json_value_free(output_value);
             return NULL;
         }
-        if (json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            parson_free(new_key);
+        if ((!parser->trusted && json_object_getn_value(output_object, new_key, strlen(new_key)) != NULL) ||
+            json_object_append_owned(output_object, new_key, new_value) == JSONFailure) {
+            json_dealloc(parser->arena, new_key);
             json_value_free(new_value);
             json_value_free(output_value);
             return NULL;
         }
-        parson_free(new_key);
-        SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        SKIP_WHITESPACES(parser);
+        if (CURRENT_CHAR(parser) != ',') {
             break;
         }
-        SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_CHAR(parser);
+        SKIP_WHITESPACES(parser);
     }
-    SKIP_WHITESPACES(string);
-    if (**string != '}' || /* Trim object after parsing is over */
-        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+    SKIP_WHITESPACES(parser);
+    if (CURRENT_CHAR(parser) != '}' || /* Trim object after parsing is over (pointless in an arena) */
+        (parser->arena == NULL &&
+         json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure)) {
             json_value_free(output_value);
             return NULL;
     }
-    SKIP_CHAR(string);
+    SKIP_CHAR(parser);
     return output_value;
 }
 
-static JSON_Value * parse_array_value(const char **string, size_t nesting) {
+static JSON_Value * parse_array_value(JSON_Parser *parser, size_t nesting) {
     JSON_Value *output_value = NULL, *new_array_value = NULL;
     JSON_Array *output_array = NULL;
-    output_value = json_value_init_array();
+    output_value = json_value_new(parser->arena, JSONArray);
     if (output_value == NULL) {
         return NULL;
     }
-    if (**string != '[') {
+    if (CURRENT_CHAR(parser) != '[') {
         json_value_free(output_value);
         return NULL;
     }
     output_array = json_value_get_array(output_value);
-    SKIP_CHAR(string);
-    SKIP_WHITESPACES(string);
-    if (**string == ']') { /* empty array */
-        SKIP_CHAR(string);
+    SKIP_CHAR(parser);
+    SKIP_WHITESPACES(parser);
+    if (CURRENT_CHAR(parser) == ']') { /* empty array */
+        SKIP_CHAR(parser);
         return output_value;
     }
-    while (**string != '\0') {
-        new_array_value = parse_value(string, nesting);
+    while (CURRENT_CHAR(parser) != '\0') {
+        new_array_value = parse_value(parser, nesting);
         if (new_array_value == NULL) {
             json_value_free(output_value);
             return NULL;
@@ -800,67 +1430,79 @@ static JSON_Value * parse_array_value(const char **string, size_t nesting) {
             json_value_free(output_value);
             return NULL;
         }
-        SKIP_WHITESPACES(string);
-        if (**string != ',') {
+        SKIP_WHITESPACES(parser);
+        if (CURRENT_CHAR(parser) != ',') {
             break;
         }
-        SKIP_CHAR(string);
-        SKIP_WHITESPACES(string);
+        SKIP_CHAR(parser);
+        SKIP_WHITESPACES(parser);
     }
-    SKIP_WHITESPACES(string);
-    if (**string != ']' || /* Trim array after parsing is over */
-        json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure) {
+    SKIP_WHITESPACES(parser);
+    if (CURRENT_CHAR(parser) != ']' || /* Trim array after parsing is over (pointless in an arena) */
+        (parser->arena == NULL &&
+         json_array_resize(output_array, json_array_get_count(output_array)) == JSONFailure)) {
             json_value_free(output_value);
             return NULL;
     }
-    SKIP_CHAR(string);
+    SKIP_CHAR(parser);
     return output_value;
 }
 
-static JSON_Value * parse_string_value(const char **string) {
+static JSON_Value * parse_string_value(JSON_Parser *parser) {
     JSON_Value *value = NULL;
-    char *new_string = get_quoted_string(string);
+    char *new_string = get_quoted_string(parser);
     if (new_string == NULL) {
         return NULL;
     }
-    value = json_value_init_string_no_copy(new_string);
+    value = json_value_new(parser->arena, JSONString);
     if (value == NULL) {
-        parson_free(new_string);
+        json_dealloc(parser->arena, new_string);
         return NULL;
     }
+    value->value.string = new_string;
     return value;
 }
 
-static JSON_Value * parse_boolean_value(const char **string) {
+static JSON_Value * parse_boolean_value(JSON_Parser *parser) {
     size_t true_token_size = SIZEOF_TOKEN("true");
     size_t false_token_size = SIZEOF_TOKEN("false");
-    if (strncmp("true", *string, true_token_size) == 0) {
-        *string += true_token_size;
-        return json_value_init_boolean(1);
-    } else if (strncmp("false", *string, false_token_size) == 0) {
-        *string += false_token_size;
-        return json_value_init_boolean(0);
+    JSON_Value *value = NULL;
+    int boolean = 0;
+    if (REMAINING(parser) >= true_token_size && strncmp("true", parser->cursor, true_token_size) == 0) {
+        parser->cursor += true_token_size;
+        boolean = 1;
+    } else if (REMAINING(parser) >= false_token_size && strncmp("false", parser->cursor, false_token_size) == 0) {
+        parser->cursor += false_token_size;
+    } else {
+        return NULL;
     }
-    return NULL;
+    value = json_value_new(parser->arena, JSONBoolean);
+    if (value != NULL) {
+        value->value.boolean = boolean;
+    }
+    return value;
 }
 
-static JSON_Value * parse_number_value(const char **string) {
-    char *end;
+static JSON_Value * parse_number_value(JSON_Parser *parser) {
     double number = 0;
-    errno = 0;
-    number = strtod(*string, &end);
-    if (errno || !is_decimal(*string, end - *string)) {
+    JSON_Value *value = NULL;
+    size_t len = parse_number(parser->cursor, parser->end, &number);
+    if (len == 0) {
         return NULL;
     }
-    *string = end;
-    return json_value_init_number(number);
+    parser->cursor += len;
+    value = json_value_new(parser->arena, JSONNumber);
+    if (value != NULL) {
+        value->value.number = number;
+    }
+    return value;
 }
 
-static JSON_Value * parse_null_value(const char **string) {
+static JSON_Value * parse_null_value(JSON_Parser *parser) {
     size_t token_size = SIZEOF_TOKEN("null");
-    if (strncmp("null", *string, token_size) == 0) {
-        *string += token_size;
-        return json_value_init_null();
+    if (REMAINING(parser) >= token_size && strncmp("null", parser->cursor, token_size) == 0) {
+        parser->cursor += token_size;
+        return json_value_new(parser->arena, JSONNull);
     }
     return NULL;
 }
@@ -1125,25 +1767,75 @@ JSON_Value * json_parse_string(const char *string) {
     if (string == NULL) {
         return NULL;
     }
-    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+    return json_parse_stringn(string, strlen(string));
+}
+
+JSON_Value * json_parse_stringn(const char *string, size_t len) {
+    return json_parse_stringn_with_flags(string, len, JSONParseDefault);
+}
+
+JSON_Value * json_parse_stringn_with_flags(const char *string, size_t len, int flags) {
+    return parse_document(string, len, flags, 0, NULL, NULL);
+}
+
+JSON_Value * json_parse_stringn_in_situ(char *string, size_t len, int flags) {
+    /* Strings aren't owned by their values, so the tree has to be freed as a whole */
+    return parse_document(string, len, flags | JSONParseArena, 1, NULL, NULL);
+}
+
+JSON_Value * json_parse_stringn_filtered(const char *string, size_t len, int flags, JSON_Key_Filter filter, void *context) {
+    return parse_document(string, len, flags, 0, filter, context);
+}
+
+JSON_Value * json_parse_stringn_in_situ_filtered(char *string, size_t len, int flags, JSON_Key_Filter filter, void *context) {
+    return parse_document(string, len, flags | JSONParseArena, 1, filter, context);
+}
+
+static JSON_Value * parse_document(const char *string, size_t len, int flags, int in_situ, JSON_Key_Filter filter, void *context) {
+    JSON_Parser parser;
+    JSON_Document *document = NULL;
+    JSON_Value *value = NULL;
+    if (string == NULL) {
+        return NULL;
+    }
+    if (len >= 3 && string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
         string = string + 3; /* Support for UTF-8 BOM */
+        len -= 3;
+    }
+    if (!is_valid_utf8(string, len)) { /* validated in bulk, so strings needn't be checked one by one */
+        return NULL;
+    }
+    parser.cursor = string;
+    parser.end = string + len;
+    parser.arena = NULL;
+    parser.in_situ = in_situ;
+    parser.trusted = (flags & JSONParseTrusted) != 0;
+    parser.comments = (flags & JSONParseComments) != 0;
+    parser.filter = filter;
+    parser.filter_context = context;
+    if (!(flags & JSONParseArena)) {
+        return parse_value(&parser, 0);
+    }
+    document = (JSON_Document*)parson_malloc(sizeof(JSON_Document));
+    if (document == NULL) {
+        return NULL;
+    }
+    arena_init(&document->arena, len);
+    parser.arena = &document->arena;
+    value = parse_value(&parser, 0);
+    if (value == NULL) {
+        arena_free(&document->arena);
+        parson_free(document);
+        return NULL;
     }
-    return parse_value((const char**)&string, 0);
+    return json_document_adopt_root(document, value);
 }
 
 JSON_Value * json_parse_string_with_comments(const char *string) {
-    JSON_Value *result = NULL;
-    char *string_mutable_copy = NULL, *string_mutable_copy_ptr = NULL;
-    string_mutable_copy = parson_strdup(string);
-    if (string_mutable_copy == NULL) {
+    if (string == NULL) {
         return NULL;
     }
-    remove_comments(string_mutable_copy, "/*", "*/");
-    remove_comments(string_mutable_copy, "//", "\n");
-    string_mutable_copy_ptr = string_mutable_copy;
-    result = parse_value((const char**)&string_mutable_copy_ptr, 0);
-    parson_free(string_mutable_copy);
-    return result;
+    return parse_document(string, strlen(string), JSONParseComments, 0, NULL, NULL);
 }
 
 /* JSON Object API */
@@ -1310,6 +2002,16 @@ JSON_Value * json_value_get_parent (const JSON_Value *value) {
 }
 
 void json_value_free(JSON_Value *value) {
+    JSON_Document *document = NULL;
+    if (value != NULL && (value->flags & JSON_VALUE_ARENA_ROOT)) {
+        document = (JSON_Document*)((char*)value - offsetof(JSON_Document, root));
+        arena_free(&document->arena);
+        parson_free(document);
+        return;
+    }
+    if (value != NULL && (value->flags & JSON_VALUE_IN_ARENA)) {
+        return; /* released along with its document */
+    }
     switch (json_value_get_type(value)) {
         case JSONObject:
             json_object_free(value->value.object);
@@ -1327,33 +2029,11 @@ void json_value_free(JSON_Value *value) {
 }
 
 JSON_Value * json_value_init_object(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
-        return NULL;
-    }
-    new_value->parent = NULL;
-    new_value->type = JSONObject;
-    new_value->value.object = json_object_init(new_value);
-    if (!new_value->value.object) {
-        parson_free(new_value);
-        return NULL;
-    }
-    return new_value;
+    return json_value_new(NULL, JSONObject);
 }
 
 JSON_Value * json_value_init_array(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
-        return NULL;
-    }
-    new_value->parent = NULL;
-    new_value->type = JSONArray;
-    new_value->value.array = json_array_init(new_value);
-    if (!new_value->value.array) {
-        parson_free(new_value);
-        return NULL;
-    }
-    return new_value;
+    return json_value_new(NULL, JSONArray);
 }
 
 JSON_Value * json_value_init_string(const char *string) {
@@ -1383,35 +2063,25 @@ JSON_Value * json_value_init_number(double number) {
     if (IS_NUMBER_INVALID(number)) {
         return NULL;
     }
-    new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    new_value = json_value_new(NULL, JSONNumber);
     if (new_value == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNumber;
     new_value->value.number = number;
     return new_value;
 }
 
 JSON_Value * json_value_init_boolean(int boolean) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = json_value_new(NULL, JSONBoolean);
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONBoolean;
     new_value->value.boolean = boolean ? 1 : 0;
     return new_value;
 }
 
 JSON_Value * json_value_init_null(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
-        return NULL;
-    }
-    new_value->parent = NULL;
-    new_value->type = JSONNull;
-    return new_value;
+    return json_value_new(NULL, JSONNull);
 }
 
 JSON_Value * json_value_deep_copy(const JSON_Value *value) {
@@ -1619,7 +2289,7 @@ void json_free_serialized_string(char *string) {
 
 JSON_Status json_array_remove(JSON_Array *array, size_t ix) {
     size_t to_move_bytes = 0;
-    if (array == NULL || ix >= json_array_get_count(array)) {
+    if (array == NULL || array->arena != NULL || ix >= json_array_get_count(array)) {
         return JSONFailure;
     }
     json_value_free(json_array_get_value(array, ix));
@@ -1630,7 +2300,8 @@ JSON_Status json_array_remove(JSON_Array *array, size_t ix) {
 }
 
 JSON_Status json_array_replace_value(JSON_Array *array, size_t ix, JSON_Value *value) {
-    if (array == NULL || value == NULL || value->parent != NULL || ix >= json_array_get_count(array)) {
+    if (array == NULL || array->arena != NULL || value == NULL || value->parent != NULL ||
+        ix >= json_array_get_count(array)) {
         return JSONFailure;
     }
     json_value_free(json_array_get_value(array, ix));
@@ -1689,7 +2360,7 @@ JSON_Status json_array_replace_null(JSON_Array *array, size_t i) {
 
 JSON_Status json_array_clear(JSON_Array *array) {
     size_t i = 0;
-    if (array == NULL) {
+    if (array == NULL || array->arena != NULL) {
         return JSONFailure;
     }
     for (i = 0; i < json_array_get_count(array); i++) {
@@ -1700,7 +2371,7 @@ JSON_Status json_array_clear(JSON_Array *array) {
 }
 
 JSON_Status json_array_append_value(JSON_Array *array, JSON_Value *value) {
-    if (array == NULL || value == NULL || value->parent != NULL) {
+    if (array == NULL || array->arena != NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
     return json_array_add(array, value);
@@ -1757,7 +2428,7 @@ JSON_Status json_array_append_null(JSON_Array *array) {
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value) {
     size_t i = 0;
     JSON_Value *old_value;
-    if (object == NULL || name == NULL || value == NULL || value->parent != NULL) {
+    if (object == NULL || object->arena != NULL || name == NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
     old_value = json_object_get_value(object, name);
@@ -1817,7 +2488,7 @@ JSON_Status json_object_dotset_value(JSON_Object *object, const char *name, JSON
     JSON_Object *temp_object = NULL, *new_object = NULL;
     JSON_Status status = JSONFailure;
     size_t name_len = 0;
-    if (object == NULL || name == NULL || value == NULL) {
+    if (object == NULL || object->arena != NULL || name == NULL || value == NULL) {
         return JSONFailure;
     }
     dot_pos = strchr(name, '.');
@@ -1911,7 +2582,7 @@ JSON_Status json_object_dotremove(JSON_Object *object, const char *name) {
 
 JSON_Status json_object_clear(JSON_Object *object) {
     size_t i = 0;
-    if (object == NULL) {
+    if (object == NULL || object->arena != NULL) {
         return JSONFailure;
     }
     for (i = 0; i < json_object_get_count(object); i++) {
@@ -76,6 +76,53 @@ JSON_Value * json_parse_file_with_comments(const char *filename);
 /*  Parses first JSON value in a string, returns NULL in case of error */
 JSON_Value * json_parse_string(const char *string);
 
+/*  Parses first JSON value in the first len bytes of a string, which doesn't
+    need to be null-terminated, returns NULL in case of error */
+JSON_Value * json_parse_stringn(const char *string, size_t len);
+
+/* Flags for json_parse_stringn_with_flags */
+enum json_parse_flags_t {
+    JSONParseDefault = 0,
+    /* Allocate the whole tree from a bump arena owned by the returned root. Freeing the root
+       releases every value at once (freeing any other value in the tree does nothing). The
+       tree is read-only: functions that would modify it return JSONFailure. The global
+       allocation functions are only used to obtain arena blocks. */
+    JSONParseArena   = 1,
+    /* Input is known not to repeat keys within an object, so don't check for duplicates
+       (which costs a lookup per key, quadratic in the width of the object). If a key is
+       repeated anyway, both members are kept and lookups find the first. */
+    JSONParseTrusted = 2,
+    /* Skip comments (/ * * / and //) wherever whitespace is allowed, as they are read --
+       the input isn't copied or scanned beforehand. */
+    JSONParseComments = 4
+};
+
+/*  Parses first JSON value in the first len bytes of a string using the specified
+    json_parse_flags_t, returns NULL in case of error */
+JSON_Value * json_parse_stringn_with_flags(const char *string, size_t len, int flags);
+
+/*  Parses first JSON value in the first len bytes of a writable string without copying
+    strings: each string value and key points into the buffer, where it is decoded in place
+    and NUL-terminated (overwriting its closing quote). The buffer must outlive the returned
+    value, and is left unusable as JSON. Implies JSONParseArena. Returns NULL in case of error */
+JSON_Value * json_parse_stringn_in_situ(char *string, size_t len, int flags);
+
+/* What to do with an object member, as decided by a JSON_Key_Filter */
+enum json_key_filter_result_t {
+    JSONKeySkip    = 0, /* skip the value without building it (only its nesting and strings are checked) */
+    JSONKeyKeep    = 1, /* build the value, filtering the members of any objects within it */
+    JSONKeyKeepAll = 2  /* build the value, and everything within it */
+};
+
+/* Called with the (decoded, not NUL-terminated) key of each object member as it is parsed,
+   returns a json_key_filter_result_t */
+typedef int (*JSON_Key_Filter)(const char *key, size_t key_len, void *context);
+
+/*  Same as json_parse_stringn_with_flags and json_parse_stringn_in_situ, but only builds
+    the object members that `filter` keeps. Array elements are always kept. */
+JSON_Value * json_parse_stringn_filtered(const char *string, size_t len, int flags, JSON_Key_Filter filter, void *context);
+JSON_Value * json_parse_stringn_in_situ_filtered(char *string, size_t len, int flags, JSON_Key_Filter filter, void *context);
+
 /*  Parses first JSON value in a string and ignores comments (/ * * / and //),
     returns NULL in case of error */
 JSON_Value * json_parse_string_with_comments(const char *string);
@@ -119,6 +166,9 @@ JSON_Array  * json_object_get_array  (const JSON_Object *object, const char *nam
 double        json_object_get_number (const JSON_Object *object, const char *name); /* returns 0 on fail */
 int           json_object_get_boolean(const JSON_Object *object, const char *name); /* returns -1 on fail */
 
+/* Gets value by the first name_len bytes of name, which doesn't need to be null-terminated. */
+JSON_Value  * json_object_getn_value (const JSON_Object *object, const char *name, size_t name_len);
+
 /* dotget functions enable addressing values with dot notation in nested objects,
  just like in structs or c++/java/c# objects (e.g. objectA.objectB.value).
  Because valid names in JSON can contain dots, some values may be inaccessible
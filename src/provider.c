@@ -0,0 +1,332 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file provider.c
+
+	@brief Data providers for parson values and tapes.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <string.h>
+
+#include "d_string.h"
+#include "provider.h"
+
+
+/// No value
+static magnum_value none(void) {
+	magnum_value v = {NULL, 0};
+
+	return v;
+}
+
+
+/// Value for `ptr`, with `index`
+static magnum_value value(const void * ptr, size_t index) {
+	magnum_value v = {ptr, index};
+
+	return v;
+}
+
+
+// Parson values -- `index` is the position of an element or member in its
+// container (only meaningful for values from `first()` and `next()`)
+
+static int parson_type(void * context, magnum_value v) {
+	(void) context;
+
+	return json_value_get_type(v.ptr);
+}
+
+
+static magnum_value parson_member(void * context, magnum_value object, const char * name, size_t len) {
+	(void) context;
+
+	return value(json_object_getn_value(json_value_get_object(object.ptr), name, len), 0);
+}
+
+
+static const char * parson_string(void * context, magnum_value v, size_t * len) {
+	const char * s = json_value_get_string(v.ptr);
+
+	(void) context;
+
+	*len = strlen(s);
+
+	return s;
+}
+
+
+static double parson_number(void * context, magnum_value v) {
+	(void) context;
+
+	return json_value_get_number(v.ptr);
+}
+
+
+static int parson_boolean(void * context, magnum_value v) {
+	(void) context;
+
+	return json_value_get_boolean(v.ptr) > 0;
+}
+
+
+/// Element or member `index` of `container`
+static magnum_value parson_child(magnum_value container, size_t index) {
+	JSON_Value * v = (JSON_Value *) container.ptr;
+
+	if (json_value_get_type(v) == JSONArray) {
+		return value(json_array_get_value(json_value_get_array(v), index), index);
+	}
+
+	return value(json_object_get_value_at(json_value_get_object(v), index), index);
+}
+
+
+static magnum_value parson_first(void * context, magnum_value container) {
+	(void) context;
+
+	return parson_child(container, 0);
+}
+
+
+static magnum_value parson_next(void * context, magnum_value container, magnum_value item) {
+	(void) context;
+
+	return parson_child(container, item.index + 1);
+}
+
+
+static const char * parson_name(void * context, magnum_value object, magnum_value item, size_t * len) {
+	const char * s = json_object_get_name(json_value_get_object(object.ptr), item.index);
+
+	(void) context;
+
+	*len = strlen(s);
+
+	return s;
+}
+
+
+const magnum_provider json_value_provider = {
+	parson_type,
+	parson_member,
+	parson_string,
+	parson_number,
+	parson_boolean,
+	parson_first,
+	parson_next,
+	parson_name,
+};
+
+
+magnum_value json_value_provider_root(JSON_Value * json) {
+	return value(json, 0);
+}
+
+
+// Tapes -- `ptr` is a `tape_node` within the tape
+
+static int tape_type(void * context, magnum_value v) {
+	(void) context;
+
+	return TAPE_TYPE((const tape_node *) v.ptr);
+}
+
+
+static magnum_value tape_member(void * context, magnum_value object, const char * name, size_t len) {
+	const json_tape * tape = context;
+	size_t node = json_tape_get_member(tape, (const tape_node *) object.ptr - tape->nodes, name, len);
+
+	return (node == kTapeNone) ? none() : value(&tape->nodes[node], 0);
+}
+
+
+static const char * tape_string(void * context, magnum_value v, size_t * len) {
+	const json_tape * tape = context;
+	const tape_node * n = v.ptr;
+
+	*len = n->value.string.length;
+
+	return tape->strings + n->value.string.offset;
+}
+
+
+static double tape_number(void * context, magnum_value v) {
+	(void) context;
+
+	return ((const tape_node *) v.ptr)->value.number;
+}
+
+
+static int tape_boolean(void * context, magnum_value v) {
+	(void) context;
+
+	return ((const tape_node *) v.ptr)->value.boolean;
+}
+
+
+static magnum_value tape_first(void * context, magnum_value container) {
+	const json_tape * tape = context;
+	const tape_node * n = container.ptr;
+	size_t node = n - tape->nodes;
+
+	// Children immediately follow their container
+	return (TAPE_NEXT(n) == node + 1) ? none() : value(n + 1, 0);
+}
+
+
+static magnum_value tape_next(void * context, magnum_value container, magnum_value item) {
+	const json_tape * tape = context;
+	size_t next = TAPE_NEXT((const tape_node *) item.ptr);
+
+	return (next < TAPE_NEXT((const tape_node *) container.ptr)) ? value(&tape->nodes[next], 0) : none();
+}
+
+
+static const char * tape_name(void * context, magnum_value object, magnum_value item, size_t * len) {
+	const json_tape * tape = context;
+	const tape_node * n = item.ptr;
+
+	(void) object;
+
+	*len = strlen(tape->strings + n->key);
+
+	return tape->strings + n->key;
+}
+
+
+const magnum_provider json_tape_provider = {
+	tape_type,
+	tape_member,
+	tape_string,
+	tape_number,
+	tape_boolean,
+	tape_first,
+	tape_next,
+	tape_name,
+};
+
+
+magnum_value json_tape_provider_root(const json_tape * tape) {
+	return tape ? value(tape->nodes, 0) : none();
+}
+
+
+#ifdef TEST
+/// Describe `v` (and its descendants) in `out`, using only `provider`
+static void describe(DString * out, const magnum_provider * provider, void * context, magnum_value v) {
+	magnum_value item;
+	const char * s;
+	size_t len;
+
+	switch (provider->type(context, v)) {
+		case MAGNUM_VALUE_ARRAY:
+		case MAGNUM_VALUE_OBJECT:
+			d_string_append_c(out, '(');
+
+			for (item = provider->first(context, v); item.ptr; item = provider->next(context, v, item)) {
+				if (provider->type(context, v) == MAGNUM_VALUE_OBJECT) {
+					s = provider->name(context, v, item, &len);
+					d_string_append_c_array(out, s, len);
+					d_string_append_c(out, '=');
+				}
+
+				describe(out, provider, context, item);
+				d_string_append_c(out, ' ');
+			}
+
+			d_string_append_c(out, ')');
+			break;
+
+		case MAGNUM_VALUE_STRING:
+			s = provider->string(context, v, &len);
+			d_string_append_c_array(out, s, len);
+			break;
+
+		case MAGNUM_VALUE_NUMBER:
+			d_string_append_printf(out, "%g", provider->number(context, v));
+			break;
+
+		case MAGNUM_VALUE_BOOLEAN:
+			d_string_append(out, provider->boolean(context, v) ? "true" : "false");
+			break;
+
+		case MAGNUM_VALUE_NULL:
+			d_string_append(out, "null");
+			break;
+	}
+}
+
+
+void Test_provider(CuTest * tc) {
+	const char * source = "{\"a\" : [1, \"two\", {\"b\" : true}], \"c\" : {\"d\" : {}}, \"e\" : [], \"f\" : false, \"g\" : null}";
+	const char * expected = "(a=(1 two (b=true ) ) c=(d=() ) e=() f=false g=null )";
+	JSON_Value * json = json_parse_string(source);
+	json_tape * tape = json_tape_new(json);
+	magnum_value root, v;
+	DString * out = d_string_new("");
+
+	describe(out, &json_value_provider, NULL, json_value_provider_root(json));
+	CuAssertStrEquals(tc, expected, out->str);
+
+	d_string_erase(out, 0, -1);
+	describe(out, &json_tape_provider, tape, json_tape_provider_root(tape));
+	CuAssertStrEquals(tc, expected, out->str);
+
+	// Members
+	root = json_value_provider_root(json);
+	v = json_value_provider.member(NULL, root, "cx", 1);
+	CuAssertIntEquals(tc, MAGNUM_VALUE_OBJECT, json_value_provider.type(NULL, v));
+	CuAssertPtrEquals(tc, NULL, (void *) json_value_provider.member(NULL, root, "x", 1).ptr);
+	CuAssertPtrEquals(tc, NULL, (void *) json_value_provider.member(NULL, json_value_provider.first(NULL, root), "x", 1).ptr);
+
+	root = json_tape_provider_root(tape);
+	v = json_tape_provider.member(tape, root, "cx", 1);
+	CuAssertIntEquals(tc, MAGNUM_VALUE_OBJECT, json_tape_provider.type(tape, v));
+	CuAssertPtrEquals(tc, NULL, (void *) json_tape_provider.member(tape, root, "x", 1).ptr);
+	CuAssertPtrEquals(tc, NULL, (void *) json_tape_provider.member(tape, json_tape_provider.first(tape, root), "x", 1).ptr);
+
+	CuAssertPtrEquals(tc, NULL, (void *) json_value_provider_root(NULL).ptr);
+	CuAssertPtrEquals(tc, NULL, (void *) json_tape_provider_root(NULL).ptr);
+
+	json_tape_free(tape);
+	json_value_free(json);
+	d_string_free(out, true);
+}
+#endif
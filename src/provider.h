@@ -0,0 +1,78 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file provider.h
+
+	@brief Data providers for parson values and tapes.
+
+	The renderer reaches its data only through a `magnum_provider`.  These are
+	the providers for the data representations built into magnum -- parson's
+	`JSON_Value` trees and read-only tapes.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef PROVIDER_MAGNUM_H
+#define PROVIDER_MAGNUM_H
+
+#include "libMagnum.h"
+#include "parson.h"
+#include "tape.h"
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// Provider for parson values -- `ptr` is a `JSON_Value *`, and `context` is
+/// not used
+extern const magnum_provider json_value_provider;
+
+
+/// Provider for a tape -- `context` is the `json_tape *`, and `ptr` a node
+extern const magnum_provider json_tape_provider;
+
+
+/// Value for the root of a parson tree (NULL `ptr` if `json` is NULL)
+magnum_value json_value_provider_root(JSON_Value * json);
+
+
+/// Value for the root of a tape (NULL `ptr` if `tape` is NULL)
+magnum_value json_tape_provider_root(const json_tape * tape);
+
+
+#endif
@@ -0,0 +1,506 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file scanner.c
+
+	@brief Locate every tag in a template in a single forward pass.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scanner.h"
+
+#ifdef SCANNER_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#ifdef SCANNER_HAVE_AVX2
+	#include <immintrin.h>
+#endif
+
+
+#define kTagIndexStartingSize	64
+
+
+#ifndef MIN
+	#define MIN(A,B) ((A) <= (B) ? (A) : (B))
+#endif
+
+
+const char * scanner_find_scalar(const char * str, const char * end, const char * delim, size_t delim_len) {
+	const char * last;
+
+	if ((delim_len == 0) || (end - str < (ptrdiff_t) delim_len)) {
+		return NULL;
+	}
+
+	// Last position where delimiter could start
+	last = end - delim_len;
+
+	while (str <= last) {
+		str = memchr(str, delim[0], last - str + 1);
+
+		if (str == NULL) {
+			return NULL;
+		}
+
+		if (memcmp(str + 1, delim + 1, delim_len - 1) == 0) {
+			return str;
+		}
+
+		str++;
+	}
+
+	return NULL;
+}
+
+
+/// Return the first candidate in `mask` (bit i set for `str` + i) where the
+/// rest of the delimiter matches
+static inline const char * verify_candidates(const char * str, uint64_t mask, const char * last, const char * delim, size_t delim_len, int * done) {
+	const char * candidate;
+
+	while (mask) {
+		candidate = str + __builtin_ctzll(mask);
+
+		if (candidate > last) {
+			*done = 1;
+			return NULL;
+		}
+
+		if (memcmp(candidate + 2, delim + 2, delim_len - 2) == 0) {
+			*done = 1;
+			return candidate;
+		}
+
+		mask &= mask - 1;
+	}
+
+	return NULL;
+}
+
+
+#ifdef SCANNER_HAVE_SSE2
+const char * scanner_find_sse2(const char * str, const char * end, const char * delim, size_t delim_len) {
+	const char * last = end - delim_len;
+	const __m128i first = _mm_set1_epi8(delim[0]);
+	const __m128i second = _mm_set1_epi8(delim[1]);
+	__m128i a, b, c, d;
+	uint64_t mask;
+	const char * found;
+	int done = 0;
+
+	if ((delim_len < 2) || (end - str < (ptrdiff_t) delim_len)) {
+		return scanner_find_scalar(str, end, delim, delim_len);
+	}
+
+	// Check 64 positions at a time for the first byte of the delimiter, and
+	// only then for the first two bytes.  The second load reads one byte past
+	// the block.
+	while (end - str >= 65) {
+		a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) str), first);
+		b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 16)), first);
+		c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 32)), first);
+		d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 48)), first);
+
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) {
+			a = _mm_and_si128(a, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 1)), second));
+			b = _mm_and_si128(b, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 17)), second));
+			c = _mm_and_si128(c, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 33)), second));
+			d = _mm_and_si128(d, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(str + 49)), second));
+
+			mask = (uint64_t)(unsigned int) _mm_movemask_epi8(a) |
+				   ((uint64_t)(unsigned int) _mm_movemask_epi8(b) << 16) |
+				   ((uint64_t)(unsigned int) _mm_movemask_epi8(c) << 32) |
+				   ((uint64_t)(unsigned int) _mm_movemask_epi8(d) << 48);
+
+			found = verify_candidates(str, mask, last, delim, delim_len, &done);
+
+			if (done) {
+				return found;
+			}
+		}
+
+		str += 64;
+	}
+
+	return scanner_find_scalar(str, end, delim, delim_len);
+}
+#endif
+
+
+#ifdef SCANNER_HAVE_AVX2
+__attribute__((target("avx2")))
+const char * scanner_find_avx2(const char * str, const char * end, const char * delim, size_t delim_len) {
+	const char * last = end - delim_len;
+	const __m256i first = _mm256_set1_epi8(delim[0]);
+	const __m256i second = _mm256_set1_epi8(delim[1]);
+	__m256i a, b;
+	uint64_t mask;
+	const char * found;
+	int done = 0;
+
+	if ((delim_len < 2) || (end - str < (ptrdiff_t) delim_len)) {
+		return scanner_find_scalar(str, end, delim, delim_len);
+	}
+
+	// Check 64 positions at a time for the first byte of the delimiter, and
+	// only then for the first two bytes.  The second load reads one byte past
+	// the block.
+	while (end - str >= 65) {
+		a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) str), first);
+		b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + 32)), first);
+
+		if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+			a = _mm256_and_si256(a, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + 1)), second));
+			b = _mm256_and_si256(b, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(str + 33)), second));
+
+			mask = (uint64_t)(unsigned int) _mm256_movemask_epi8(a) |
+				   ((uint64_t)(unsigned int) _mm256_movemask_epi8(b) << 32);
+
+			found = verify_candidates(str, mask, last, delim, delim_len, &done);
+
+			if (done) {
+				return found;
+			}
+		}
+
+		str += 64;
+	}
+
+	return scanner_find_scalar(str, end, delim, delim_len);
+}
+#endif
+
+
+static int cpu_has_avx2(void) {
+	#ifdef SCANNER_HAVE_AVX2
+	// Benign race -- every thread would store the same result
+	static int avx2 = -1;
+
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	return avx2;
+	#else
+	return 0;
+	#endif
+}
+
+
+const char * scanner_find(const char * str, const char * end, const char * delim, size_t delim_len) {
+	#ifdef SCANNER_HAVE_AVX2
+
+	if (cpu_has_avx2()) {
+		return scanner_find_avx2(str, end, delim, delim_len);
+	}
+
+	#endif
+
+	#ifdef SCANNER_HAVE_SSE2
+	return scanner_find_sse2(str, end, delim, delim_len);
+	#else
+	return scanner_find_scalar(str, end, delim, delim_len);
+	#endif
+}
+
+
+static void add_tag(scanner_index * index, size_t start, size_t key, size_t key_len, size_t end) {
+	if (index->count == index->allocated) {
+		index->allocated = index->allocated ? index->allocated * 2 : kTagIndexStartingSize;
+		index->tags = realloc(index->tags, index->allocated * sizeof(scanner_tag));
+	}
+
+	index->tags[index->count].start = start;
+	index->tags[index->count].key = key;
+	index->tags[index->count].key_len = key_len;
+	index->tags[index->count].end = end;
+
+	index->count++;
+}
+
+
+/// Parse new delimiters from contents of `{{=<% %>=}}` tag
+static int set_delimiters(const char * key, size_t key_len, char * op, char * cl) {
+	size_t l, n;
+
+	if (key_len < 5 || key[key_len - 1] != '=') {
+		return -1;
+	}
+
+	key++;
+	key_len -= 2;
+
+	for (l = 0; l < key_len && isspace(key[l]); l++);
+
+	key += l;
+	key_len -= l;
+
+	for (l = 0; l < key_len && !isspace(key[l]); l++);
+
+	if (l == key_len) {
+		return -1;
+	}
+
+	n = MIN(kMaxDelimiterLength, l);
+	memcpy(op, key, n);
+	op[n] = '\0';
+
+	while (l < key_len && isspace(key[l])) {
+		l++;
+	}
+
+	while (isspace(key[key_len - 1])) {
+		key_len--;
+	}
+
+	if (l == key_len) {
+		return -1;
+	}
+
+	n = MIN(kMaxDelimiterLength, key_len - l);
+	memcpy(cl, key + l, n);
+	cl[n] = '\0';
+
+	return 0;
+}
+
+
+int scanner_index_tags(scanner_index * index, const char * str, size_t len, const char * opener, const char * closer) {
+	const char * end = str + len;
+	const char * start;
+	const char * stop;
+	const char * key;
+	size_t key_len;
+	size_t open_len;
+	size_t close_len;
+	size_t l;
+
+	char op[kMaxDelimiterLength + 1] = {0};
+	char cl[kMaxDelimiterLength + 1] = {0};
+
+	index->tags = NULL;
+	index->count = 0;
+	index->allocated = 0;
+	index->error = 0;
+	index->error_offset = len;
+
+	open_len = MIN(kMaxDelimiterLength, strlen(opener));
+	memcpy(op, opener, open_len);
+	op[open_len] = '\0';
+
+	close_len = MIN(kMaxDelimiterLength, strlen(closer));
+	memcpy(cl, closer, close_len);
+	cl[close_len] = '\0';
+
+	start = scanner_find(str, end, op, open_len);
+
+	while (start) {
+		key = start + open_len;
+		stop = scanner_find(key, end, cl, close_len);
+
+		if (stop == NULL) {
+			// No end to this possible tag
+			break;
+		}
+
+		key_len = stop - key;
+
+		if (*key == '=') {
+			if (set_delimiters(key, key_len, op, cl)) {
+				break;
+			}
+
+			add_tag(index, start - str, key - str, key_len, stop + close_len - str);
+
+			stop += close_len;
+			open_len = strlen(op);
+			close_len = strlen(cl);
+		} else {
+			if (*key == '{') {
+				// Ensure proper {{{foo}}} config
+				for (l = 0; cl[l] == '}'; l++);
+
+				if (cl[l]) {
+					if (!key_len || key[key_len - 1] != '}') {
+						break;
+					}
+
+					key_len--;
+				} else {
+					if ((stop + l >= end) || (stop[l] != '}')) {
+						break;
+					}
+
+					stop++;
+				}
+			}
+
+			stop += close_len;
+
+			add_tag(index, start - str, key - str, key_len, stop - str);
+		}
+
+		start = scanner_find(stop, end, op, open_len);
+	}
+
+	if (start) {
+		index->error = 1;
+		index->error_offset = start - str;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void scanner_index_free(scanner_index * index) {
+	free(index->tags);
+
+	index->tags = NULL;
+	index->count = 0;
+	index->allocated = 0;
+}
+
+
+#ifdef TEST
+void Test_scanner_find(CuTest * tc) {
+	char buffer[300];
+	const char * delims[] = {"{{", "}}", "<%", "%>", "{{{", "[[[[", "x", "abcdefghijklmnopq"};
+	const char * found;
+	const char * expected;
+	size_t len, d, i, j;
+
+	// Compare against strstr() for delimiters at every position in buffers of
+	// every length, including near the end
+	for (d = 0; d < sizeof(delims) / sizeof(delims[0]); d++) {
+		len = strlen(delims[d]);
+
+		for (i = 0; i < 140; i++) {
+			for (j = 0; j < 160; j++) {
+				memset(buffer, '-', sizeof(buffer));
+
+				// Partial matches to be skipped
+				buffer[j / 2] = delims[d][0];
+				buffer[j / 3 + 1] = delims[d][0];
+
+				if (i + len <= j) {
+					memcpy(buffer + i, delims[d], len);
+				}
+
+				buffer[j] = '\0';
+
+				expected = strstr(buffer, delims[d]);
+
+				found = scanner_find_scalar(buffer, buffer + j, delims[d], len);
+				CuAssertPtrEquals(tc, (void *) expected, (void *) found);
+
+				found = scanner_find(buffer, buffer + j, delims[d], len);
+				CuAssertPtrEquals(tc, (void *) expected, (void *) found);
+
+				#ifdef SCANNER_HAVE_SSE2
+				found = scanner_find_sse2(buffer, buffer + j, delims[d], len);
+				CuAssertPtrEquals(tc, (void *) expected, (void *) found);
+				#endif
+
+				#ifdef SCANNER_HAVE_AVX2
+
+				if (cpu_has_avx2()) {
+					found = scanner_find_avx2(buffer, buffer + j, delims[d], len);
+					CuAssertPtrEquals(tc, (void *) expected, (void *) found);
+				}
+
+				#endif
+			}
+		}
+	}
+}
+
+
+void Test_scanner_index_tags(CuTest * tc) {
+	scanner_index index;
+	const char * text = "a {{b}} {{{c}}} {{=<% %>=}} <%{d}%> <%={{ }}=%> {{# e }}{{/ e }}";
+
+	CuAssertIntEquals(tc, 0, scanner_index_tags(&index, text, strlen(text), "{{", "}}"));
+	CuAssertIntEquals(tc, 7, (int) index.count);
+
+	CuAssertIntEquals(tc, 2, (int) index.tags[0].start);
+	CuAssertIntEquals(tc, 4, (int) index.tags[0].key);
+	CuAssertIntEquals(tc, 1, (int) index.tags[0].key_len);
+	CuAssertIntEquals(tc, 7, (int) index.tags[0].end);
+
+	// Triple mustache includes the leading '{' but not the trailing one
+	CuAssertIntEquals(tc, 8, (int) index.tags[1].start);
+	CuAssertIntEquals(tc, 2, (int) index.tags[1].key_len);
+	CuAssertIntEquals(tc, 15, (int) index.tags[1].end);
+
+	// Custom delimiters
+	CuAssertIntEquals(tc, 28, (int) index.tags[3].start);
+	CuAssertIntEquals(tc, 2, (int) index.tags[3].key_len);
+	CuAssertIntEquals(tc, 35, (int) index.tags[3].end);
+
+	CuAssertIntEquals(tc, 48, (int) index.tags[5].start);
+	CuAssertIntEquals(tc, 4, (int) index.tags[5].key_len);
+	CuAssertIntEquals(tc, (int) strlen(text), (int) index.tags[6].end);
+	scanner_index_free(&index);
+
+	// Unterminated tag
+	text = "a {{b}} {{c";
+	CuAssertIntEquals(tc, -1, scanner_index_tags(&index, text, strlen(text), "{{", "}}"));
+	CuAssertIntEquals(tc, 1, (int) index.count);
+	CuAssertIntEquals(tc, 8, (int) index.error_offset);
+	scanner_index_free(&index);
+
+	// Invalid triple mustache
+	text = "{{{c}}";
+	CuAssertIntEquals(tc, -1, scanner_index_tags(&index, text, strlen(text), "{{", "}}"));
+	CuAssertIntEquals(tc, 0, (int) index.count);
+	scanner_index_free(&index);
+
+	// Invalid delimiters
+	text = "{{=<%=}}";
+	CuAssertIntEquals(tc, -1, scanner_index_tags(&index, text, strlen(text), "{{", "}}"));
+	scanner_index_free(&index);
+}
+#endif
@@ -0,0 +1,123 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file scanner.h
+
+	@brief Locate every tag in a template in a single forward pass.
+
+	Delimiters are located with a vectorized filter on their first two bytes
+	(SSE2, when available) or `memchr()` on the first byte, and candidates are
+	then verified.  Set delimiter tags (`{{=<% %>=}}`) are handled by the
+	scanner itself, so the resulting index describes the whole template.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef SCANNER_MAGNUM_H
+#define SCANNER_MAGNUM_H
+
+#include <stddef.h>
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+// Vectorized scanners are only built for x86 with GCC/clang
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#ifdef __SSE2__
+		#define SCANNER_HAVE_SSE2	1
+	#endif
+
+	#define SCANNER_HAVE_AVX2	1
+#endif
+
+
+#define kMaxDelimiterLength		16
+
+
+/// A single tag
+typedef struct {
+	size_t			start;			//!< Offset of opening delimiter
+	size_t			key;			//!< Offset of tag contents (after opening delimiter)
+	size_t			key_len;		//!< Length of tag contents (for `{{{name}}}` excludes the final `}`)
+	size_t			end;			//!< Offset just past closing delimiter
+} scanner_tag;
+
+
+/// All tags in a template, in order
+typedef struct {
+	scanner_tag *	tags;
+	size_t			count;			//!< Number of valid tags
+	size_t			allocated;
+	int				error;			//!< Non-zero if scanning stopped at an invalid or unterminated tag
+	size_t			error_offset;	//!< Offset of the invalid tag
+} scanner_index;
+
+
+/// Returns pointer to first occurrence of `delim` in [str, end), or NULL
+const char * scanner_find_scalar(const char * str, const char * end, const char * delim, size_t delim_len);
+
+
+#ifdef SCANNER_HAVE_SSE2
+/// SSE2 version of `scanner_find()`
+const char * scanner_find_sse2(const char * str, const char * end, const char * delim, size_t delim_len);
+#endif
+
+#ifdef SCANNER_HAVE_AVX2
+/// AVX2 version of `scanner_find()` -- only call if CPU supports AVX2
+const char * scanner_find_avx2(const char * str, const char * end, const char * delim, size_t delim_len);
+#endif
+
+
+/// Returns pointer to first occurrence of `delim` in [str, end), or NULL,
+/// using the fastest method available on the current CPU
+const char * scanner_find(const char * str, const char * end, const char * delim, size_t delim_len);
+
+
+/// Find every tag in `len` bytes of `str`, starting with the specified
+/// delimiters.  Returns 0 on success, or -1 if an invalid tag was found (the
+/// index still includes all of the tags before it).  Free the index with
+/// `scanner_index_free()` in either case.
+int scanner_index_tags(scanner_index * index, const char * str, size_t len, const char * opener, const char * closer);
+
+
+/// Free memory used by index
+void scanner_index_free(scanner_index * index);
+
+
+#endif
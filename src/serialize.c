@@ -0,0 +1,310 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file serialize.c
+
+	@brief Serialize data as compact JSON in a single pass.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "d_string.h"
+#include "escape.h"
+#include "number.h"
+#include "provider.h"
+#include "serialize.h"
+
+
+/// Output in progress
+typedef struct {
+	DString *				out;
+	const magnum_provider *	provider;
+	void *					context;
+	const char *			quote;
+	size_t					quote_len;
+	int						precise;		//!< Print numbers with `%1.17g`
+	serialize_sink			sink;			//!< NULL to keep all of the output in `out`
+	void *					sink_context;
+	int						rc;				//!< First non-zero result from `sink`
+} serializer;
+
+
+/// Pass output to the sink (if any) once there is at least `threshold` bytes
+static void flush(serializer * s, size_t threshold) {
+	if (s->sink && (s->rc == 0) && s->out->currentStringLength && (s->out->currentStringLength >= threshold)) {
+		s->rc = s->sink(s->out->str, s->out->currentStringLength, s->sink_context);
+		d_string_erase(s->out, 0, -1);
+	}
+}
+
+
+/// Write a quoted string
+static void write_string(serializer * s, const char * str, size_t len) {
+	d_string_append_c_array(s->out, s->quote, s->quote_len);
+	escape_append(s->out, str, len, MAGNUM_ESCAPE_JSON, NULL);
+	d_string_append_c_array(s->out, s->quote, s->quote_len);
+}
+
+
+/// Write `v` and its descendants
+static void write_value(serializer * s, magnum_value v) {
+	const magnum_provider * provider = s->provider;
+	magnum_value item;
+	const char * str;
+	size_t len;
+	int comma = 0;
+	int type = v.ptr ? provider->type(s->context, v) : MAGNUM_VALUE_NONE;
+
+	switch (type) {
+		case MAGNUM_VALUE_ARRAY:
+		case MAGNUM_VALUE_OBJECT:
+			d_string_append_c(s->out, (type == MAGNUM_VALUE_ARRAY) ? '[' : '{');
+
+			for (item = provider->first(s->context, v); item.ptr && (s->rc == 0); item = provider->next(s->context, v, item)) {
+				if (comma) {
+					d_string_append_c(s->out, ',');
+				}
+
+				comma = 1;
+
+				if (type == MAGNUM_VALUE_OBJECT) {
+					str = provider->name(s->context, v, item, &len);
+					write_string(s, str, len);
+					d_string_append_c(s->out, ':');
+				}
+
+				write_value(s, item);
+				flush(s, kSerializeChunkSize);
+			}
+
+			d_string_append_c(s->out, (type == MAGNUM_VALUE_ARRAY) ? ']' : '}');
+			break;
+
+		case MAGNUM_VALUE_STRING:
+			str = provider->string(s->context, v, &len);
+			write_string(s, str, len);
+			break;
+
+		case MAGNUM_VALUE_NUMBER:
+			if (s->precise) {
+				d_string_append_printf(s->out, "%1.17g", provider->number(s->context, v));
+			} else {
+				number_append(s->out, provider->number(s->context, v), MAGNUM_NUMBER_SHORTEST, 0);
+			}
+
+			break;
+
+		case MAGNUM_VALUE_BOOLEAN:
+			if (provider->boolean(s->context, v)) {
+				d_string_append_c_array(s->out, "true", 4);
+			} else {
+				d_string_append_c_array(s->out, "false", 5);
+			}
+
+			break;
+
+		case MAGNUM_VALUE_NULL:
+			d_string_append_c_array(s->out, "null", 4);
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+static void serializer_init(serializer * s, DString * out, const magnum_provider * provider, void * context, const char * quote) {
+	s->out = out;
+	s->provider = provider;
+	s->context = context;
+	s->quote = quote ? quote : "\"";
+	s->quote_len = strlen(s->quote);
+	s->precise = 0;
+	s->sink = NULL;
+	s->sink_context = NULL;
+	s->rc = 0;
+}
+
+
+/// Append value to `out` as compact JSON
+void serialize_value(DString * out, const magnum_provider * provider, void * context, magnum_value v, const char * quote) {
+	serializer s;
+
+	serializer_init(&s, out, provider, context, quote);
+	write_value(&s, v);
+}
+
+
+/// Append value to `out` as compact JSON, with numbers printed using `%1.17g`
+void serialize_value_precise(DString * out, const magnum_provider * provider, void * context, magnum_value v, const char * quote) {
+	serializer s;
+
+	serializer_init(&s, out, provider, context, quote);
+	s.precise = 1;
+	write_value(&s, v);
+}
+
+
+/// Pass value to `sink` as compact JSON
+int serialize_value_to_sink(const magnum_provider * provider, void * context, magnum_value v, serialize_sink sink, void * sink_context) {
+	DString * out = d_string_new("");
+	serializer s;
+
+	serializer_init(&s, out, provider, context, NULL);
+	s.sink = sink;
+	s.sink_context = sink_context;
+
+	write_value(&s, v);
+	flush(&s, 1);
+
+	d_string_free(out, true);
+
+	return s.rc;
+}
+
+
+/// Append parson value to `out` as compact JSON
+void json_serialize_to_dstring(const JSON_Value * value, DString * out) {
+	// Values are only read
+	serialize_value(out, &json_value_provider, NULL, json_value_provider_root((JSON_Value *) value), NULL);
+}
+
+
+/// Pass parson value to `sink` as compact JSON
+int json_serialize_to_sink(const JSON_Value * value, serialize_sink sink, void * sink_context) {
+	return serialize_value_to_sink(&json_value_provider, NULL, json_value_provider_root((JSON_Value *) value), sink, sink_context);
+}
+
+
+/// Sink that writes to a file
+int serialize_sink_file(const char * bytes, size_t len, void * sink_context) {
+	return (fwrite(bytes, 1, len, (FILE *) sink_context) == len) ? 0 : -1;
+}
+
+
+#ifdef TEST
+/// Collect output, counting the pieces, and fail once `limit` are received
+typedef struct {
+	DString *	out;
+	int			calls;
+	int			limit;
+} test_sink_state;
+
+
+static int test_sink(const char * bytes, size_t len, void * sink_context) {
+	test_sink_state * state = sink_context;
+
+	if (++state->calls == state->limit) {
+		return 42;
+	}
+
+	d_string_append_c_array(state->out, bytes, len);
+
+	return 0;
+}
+
+
+void Test_serialize(CuTest * tc) {
+	const char * source = "{\"a/b\" : [1, 2.5, -1e-7, 0.1, 1e300, true, false, null, {}, []], \"s\" : \"q\\\"b\\\\s\\/\\n\\u0001\\t\xc3\xa9\", \"\" : {\"x\" : [[]]}}";
+	const char * expected = "{\"a/b\":[1,2.5,-1e-7,0.1,1e+300,true,false,null,{},[]],\"s\":\"q\\\"b\\\\s/\\n\\u0001\\t\xc3\xa9\",\"\":{\"x\":[[]]}}";
+	JSON_Value * json = json_parse_string(source);
+	JSON_Value * copy;
+	json_tape * tape = json_tape_new(json);
+	DString * out = d_string_new("");
+	test_sink_state state = {NULL, 0, 0};
+	JSON_Array * array;
+	int i;
+
+	json_serialize_to_dstring(json, out);
+	CuAssertStrEquals(tc, expected, out->str);
+
+	// Parses back to the same document
+	copy = json_parse_string(out->str);
+	CuAssertTrue(tc, json_value_equals(json, copy));
+	json_value_free(copy);
+
+	// Any provider, and other quotes
+	d_string_erase(out, 0, -1);
+	serialize_value(out, &json_tape_provider, tape, json_tape_provider_root(tape), NULL);
+	CuAssertStrEquals(tc, expected, out->str);
+
+	d_string_erase(out, 0, -1);
+	serialize_value(out, &json_value_provider, NULL, json_value_provider_root(json_object_get_value(json_object(json), "")), "'");
+	CuAssertStrEquals(tc, "{'x':[[]]}", out->str);
+
+	d_string_erase(out, 0, -1);
+	serialize_value_precise(out, &json_value_provider, NULL, json_value_provider_root(json_object_get_value(json_object(json), "a/b")), NULL);
+	CuAssertStrEquals(tc, "[1,2.5,-9.9999999999999995e-08,0.10000000000000001,1.0000000000000001e+300,true,false,null,{},[]]", out->str);
+
+	d_string_erase(out, 0, -1);
+	json_serialize_to_dstring(NULL, out);
+	CuAssertStrEquals(tc, "", out->str);
+
+	json_value_free(json);
+	json_tape_free(tape);
+
+	// Large documents reach sinks in pieces
+	json = json_value_init_array();
+	array = json_array(json);
+
+	for (i = 0; i < 20000; i++) {
+		json_array_append_string(array, "abcdefghijklmnopqrstuvwxyz");
+	}
+
+	d_string_erase(out, 0, -1);
+	json_serialize_to_dstring(json, out);
+
+	state.out = d_string_new("");
+	CuAssertIntEquals(tc, 0, json_serialize_to_sink(json, test_sink, &state));
+	CuAssertStrEquals(tc, out->str, state.out->str);
+	CuAssertTrue(tc, state.calls > 1);
+
+	// Sinks can stop serialization
+	d_string_erase(state.out, 0, -1);
+	state.calls = 0;
+	state.limit = 2;
+	CuAssertIntEquals(tc, 42, json_serialize_to_sink(json, test_sink, &state));
+	CuAssertIntEquals(tc, 2, state.calls);
+
+	d_string_free(state.out, true);
+	json_value_free(json);
+	d_string_free(out, true);
+}
+#endif
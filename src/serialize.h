@@ -0,0 +1,108 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file serialize.h
+
+	@brief Serialize data as compact JSON in a single pass.
+
+	parson's `json_serialize_to_string()` and `json_serialize_to_file()`
+	serialize each document twice -- once to measure it, and again to write
+	it.  These functions write directly into a `DString` that grows as needed
+	(or pass the output to a sink a chunk at a time), escape strings a run at
+	a time (see `escape.h`), and format numbers without `sprintf()` (see
+	`number.h`).  Any data that can be rendered can be serialized, through its
+	provider (see `magnum_provider`).
+
+	Numbers use their shortest exact representation (e.g. `0.1`, `1e-7`), and
+	`/` is not escaped.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef SERIALIZE_MAGNUM_H
+#define SERIALIZE_MAGNUM_H
+
+#include <stddef.h>
+
+#include "libMagnum.h"
+#include "parson.h"
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// Output is passed to sinks in pieces of about this many bytes
+#define kSerializeChunkSize	(64 * 1024)
+
+
+/// Receives the next `len` bytes of output.  Returns 0 to continue, anything
+/// else to stop.
+typedef int (*serialize_sink)(const char * bytes, size_t len, void * context);
+
+
+/// Append `v`, reached through `provider` (which is passed `context`), to
+/// `out` as compact JSON.  `quote` is used for the quotation marks around
+/// strings and member names (NULL for `"`).  Nothing is appended if `v` is
+/// missing.
+void serialize_value(DString * out, const magnum_provider * provider, void * context, magnum_value v, const char * quote);
+
+
+/// As `serialize_value()`, but numbers are printed with 17 significant
+/// digits (`%1.17g`) rather than in the shortest form
+void serialize_value_precise(DString * out, const magnum_provider * provider, void * context, magnum_value v, const char * quote);
+
+
+/// Pass `v`, reached through `provider`, to `sink` as compact JSON, a chunk
+/// at a time.  Returns 0, or the first non-zero result from `sink`.
+int serialize_value_to_sink(const magnum_provider * provider, void * context, magnum_value v, serialize_sink sink, void * sink_context);
+
+
+/// Append parson `value` to `out` as compact JSON
+void json_serialize_to_dstring(const JSON_Value * value, DString * out);
+
+
+/// Pass parson `value` to `sink` as compact JSON, a chunk at a time.  Returns
+/// 0, or the first non-zero result from `sink`.
+int json_serialize_to_sink(const JSON_Value * value, serialize_sink sink, void * sink_context);
+
+
+/// Sink that writes to a `FILE *` (`sink_context`).  Returns 0 on success.
+int serialize_sink_file(const char * bytes, size_t len, void * sink_context);
+
+
+#endif
@@ -0,0 +1,417 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file stream.c
+
+	@brief Read the elements of a top-level JSON array one at a time.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+
+
+#define kStreamChunkSize	(64 * 1024)
+
+
+/// Position in the array
+enum stream_states {
+	STREAM_START = 0,		//!< Before the opening bracket
+	STREAM_FIRST,			//!< Before the first element (or closing bracket)
+	STREAM_NEXT,			//!< After an element
+	STREAM_DONE,
+};
+
+
+json_stream * json_stream_new(FILE * in, int flags) {
+	json_stream * s = calloc(1, sizeof(json_stream));
+
+	if (s) {
+		s->in = in;
+		s->flags = flags;
+	}
+
+	return s;
+}
+
+
+void json_stream_free(json_stream * stream) {
+	if (stream) {
+		free(stream->buffer);
+		free(stream);
+	}
+}
+
+
+bool json_stream_error(const json_stream * stream) {
+	return stream->error;
+}
+
+
+/// Read another chunk, discarding consumed input.  Returns false at the end of
+/// the input.
+static bool refill(json_stream * s) {
+	size_t n;
+	char * buffer;
+
+	if (s->eof) {
+		return false;
+	}
+
+	// Keep only what hasn't been consumed yet
+	if (s->start) {
+		memmove(s->buffer, s->buffer + s->start, s->length - s->start);
+		s->length -= s->start;
+		s->start = 0;
+	}
+
+	if (s->capacity - s->length < kStreamChunkSize) {
+		buffer = realloc(s->buffer, s->capacity + kStreamChunkSize);
+
+		if (buffer == NULL) {
+			s->error = true;
+			return false;
+		}
+
+		s->buffer = buffer;
+		s->capacity += kStreamChunkSize;
+	}
+
+	n = fread(s->buffer + s->length, 1, s->capacity - s->length, s->in);
+	s->length += n;
+
+	if (n == 0) {
+		s->eof = true;
+
+		if (ferror(s->in)) {
+			s->error = true;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+/// Next non-whitespace character (not consumed), or EOF
+static int peek(json_stream * s) {
+	for (;;) {
+		while (s->start < s->length) {
+			if (!isspace((unsigned char) s->buffer[s->start])) {
+				return (unsigned char) s->buffer[s->start];
+			}
+
+			s->start++;
+		}
+
+		if (!refill(s)) {
+			return EOF;
+		}
+	}
+}
+
+
+/// Find the end of the element at `start`, reading more input as needed.
+/// Strings and brackets are tracked just well enough to find the end -- the
+/// element itself is checked when it is parsed.  Returns the length of the
+/// element, or 0 if the input ends first.
+static size_t measure_element(json_stream * s) {
+	size_t offset = 0, depth = 0;
+	bool in_string = false, escaped = false;
+	char c;
+
+	for (;;) {
+		for (; s->start + offset < s->length; offset++) {
+			c = s->buffer[s->start + offset];
+
+			if (in_string) {
+				if (escaped) {
+					escaped = false;
+				} else if (c == '\\') {
+					escaped = true;
+				} else if (c == '"') {
+					in_string = false;
+
+					if (depth == 0) {
+						return offset + 1;
+					}
+				}
+
+				continue;
+			}
+
+			switch (c) {
+				case '"':
+					in_string = true;
+					break;
+
+				case '[':
+				case '{':
+					depth++;
+					break;
+
+				case ']':
+				case '}':
+					if (depth == 0) {
+						// End of the array, after a scalar
+						return offset;
+					}
+
+					if (--depth == 0) {
+						return offset + 1;
+					}
+
+					break;
+
+				case ',':
+					if (depth == 0) {
+						return offset;
+					}
+
+					break;
+
+				default:
+					if ((depth == 0) && isspace((unsigned char) c)) {
+						return offset;
+					}
+
+					break;
+			}
+		}
+
+		// Offsets are relative to `start`, so they survive compaction
+		if (!refill(s)) {
+			// A scalar can end at the end of the input (the array can't)
+			return (!in_string && depth == 0) ? offset : 0;
+		}
+	}
+}
+
+
+JSON_Value * json_stream_next(json_stream * stream) {
+	JSON_Value * v;
+	size_t len;
+	int c;
+
+	if ((stream == NULL) || stream->error) {
+		return NULL;
+	}
+
+	switch (stream->state) {
+		case STREAM_START:
+			c = peek(stream);
+
+			// Skip UTF-8 BOM
+			if ((c == 0xEF) && (stream->length - stream->start >= 3) &&
+					(memcmp(stream->buffer + stream->start, "\xEF\xBB\xBF", 3) == 0)) {
+				stream->start += 3;
+				c = peek(stream);
+			}
+
+			if (c != '[') {
+				stream->error = true;
+				return NULL;
+			}
+
+			stream->start++;
+			stream->state = STREAM_FIRST;
+
+			if (peek(stream) == ']') {
+				stream->start++;
+				stream->state = STREAM_DONE;
+				return NULL;
+			}
+
+			break;
+
+		case STREAM_NEXT:
+			c = peek(stream);
+
+			if (c == ']') {
+				stream->start++;
+				stream->state = STREAM_DONE;
+				return NULL;
+			}
+
+			if (c != ',') {
+				stream->error = true;
+				return NULL;
+			}
+
+			stream->start++;
+			peek(stream);
+			break;
+
+		case STREAM_DONE:
+			return NULL;
+
+		default:
+			break;
+	}
+
+	len = measure_element(stream);
+
+	if (len == 0) {
+		stream->error = true;
+		return NULL;
+	}
+
+	v = json_parse_stringn_with_flags(stream->buffer + stream->start, len, stream->flags);
+	stream->start += len;
+	stream->state = STREAM_NEXT;
+
+	if (v == NULL) {
+		stream->error = true;
+	}
+
+	return v;
+}
+
+
+#ifdef TEST
+void Test_json_stream(CuTest * tc) {
+	const char * source = "\xEF\xBB\xBF [ {\"a\" : \"x]}\\\"\", \"b\" : [1, {}]},\n\t\"s\", -1.5e3 , true,null,[] ]  ";
+	const char * invalid[] = {
+		"{\"a\" : 1}",
+		"[1, 2",
+		"[1 2]",
+		"[1, {\"a\" : }]",
+		"[1, \"open]",
+		"[1,]",
+	};
+	json_stream * s;
+	JSON_Value * v;
+	FILE * f;
+	size_t i;
+	int count;
+
+	f = tmpfile();
+	fputs(source, f);
+	rewind(f);
+
+	s = json_stream_new(f, JSONParseArena);
+
+	v = json_stream_next(s);
+	CuAssertStrEquals(tc, "x]}\"", json_object_get_string(json_value_get_object(v), "a"));
+	json_value_free(v);
+
+	v = json_stream_next(s);
+	CuAssertStrEquals(tc, "s", json_value_get_string(v));
+	json_value_free(v);
+
+	v = json_stream_next(s);
+	CuAssertDblEquals(tc, -1500, json_value_get_number(v), 0);
+	json_value_free(v);
+
+	v = json_stream_next(s);
+	CuAssertIntEquals(tc, 1, json_value_get_boolean(v));
+	json_value_free(v);
+
+	v = json_stream_next(s);
+	CuAssertIntEquals(tc, JSONNull, json_value_get_type(v));
+	json_value_free(v);
+
+	v = json_stream_next(s);
+	CuAssertIntEquals(tc, JSONArray, json_value_get_type(v));
+	json_value_free(v);
+
+	CuAssertPtrEquals(tc, NULL, json_stream_next(s));
+	CuAssertPtrEquals(tc, NULL, json_stream_next(s));
+	CuAssertIntEquals(tc, false, json_stream_error(s));
+
+	json_stream_free(s);
+	fclose(f);
+
+	// Elements spanning many chunks
+	f = tmpfile();
+	fputs("[", f);
+
+	for (i = 0; i < 3 * kStreamChunkSize / 16; i++) {
+		fprintf(f, "%s\"%012lu\"", i ? "," : "", (unsigned long) i);
+	}
+
+	fputs(", [\"", f);
+
+	for (i = 0; i < 3 * kStreamChunkSize; i++) {
+		fputc('x', f);
+	}
+
+	fputs("\"]]", f);
+	rewind(f);
+
+	s = json_stream_new(f, JSONParseArena);
+	count = 0;
+
+	while ((v = json_stream_next(s))) {
+		count++;
+
+		if (json_value_get_type(v) == JSONArray) {
+			CuAssertIntEquals(tc, 3 * kStreamChunkSize, (int) strlen(json_array_get_string(json_value_get_array(v), 0)));
+		}
+
+		json_value_free(v);
+	}
+
+	CuAssertIntEquals(tc, 3 * kStreamChunkSize / 16 + 1, count);
+	CuAssertIntEquals(tc, false, json_stream_error(s));
+
+	json_stream_free(s);
+	fclose(f);
+
+	for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		f = tmpfile();
+		fputs(invalid[i], f);
+		rewind(f);
+
+		s = json_stream_new(f, JSONParseArena);
+
+		while ((v = json_stream_next(s))) {
+			json_value_free(v);
+		}
+
+		CuAssertIntEquals(tc, true, json_stream_error(s));
+
+		json_stream_free(s);
+		fclose(f);
+	}
+}
+#endif
@@ -0,0 +1,99 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file stream.h
+
+	@brief Read the elements of a top-level JSON array one at a time.
+
+	A stream reads a JSON array from a file (or stdin) in chunks, and parses
+	each element into its own value when it is requested.  Only the current
+	element (and the unread remainder of the current chunk) is held in
+	memory, so arbitrarily large arrays of records can be processed.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef STREAM_MAGNUM_H
+#define STREAM_MAGNUM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "parson.h"
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// Incremental reader for a top-level JSON array
+typedef struct json_stream {
+	FILE *			in;
+	int				flags;			//!< `json_parse_flags_t` for each element
+
+	char *			buffer;
+	size_t			length;			//!< Bytes in `buffer`
+	size_t			capacity;
+	size_t			start;			//!< Start of unconsumed input
+	bool			eof;
+
+	int				state;			//!< Where we are in the array
+	bool			error;			//!< Input wasn't a valid JSON array
+} json_stream;
+
+
+/// Create a stream reading from `in` (which isn't closed by the stream).
+/// `flags` are the `json_parse_flags_t` used to parse each element.
+json_stream * json_stream_new(FILE * in, int flags);
+
+
+/// Parse the next element of the array.  Returns NULL once the array is
+/// finished, or if the input is invalid (see `json_stream_error()`).  The
+/// value is independent of the stream, and must be freed with
+/// `json_value_free()`.
+JSON_Value * json_stream_next(json_stream * stream);
+
+
+/// Was the input invalid (or unreadable)?
+bool json_stream_error(const json_stream * stream);
+
+
+/// Free stream
+void json_stream_free(json_stream * stream);
+
+
+#endif
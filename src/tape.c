@@ -0,0 +1,758 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file tape.c
+
+	@brief Immutable, contiguous representation of a JSON document.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tape.h"
+
+
+#define kSnapshotVersion	2
+#define kSnapshotByteOrder	0x01020304
+#define kChecksumSeed		0xcbf29ce484222325ULL
+
+static const char kSnapshotMagic[4] = {'M', 'G', 'J', 'T'};
+
+#define kKeysInitialSize	64
+
+
+/// Start of a snapshot, which is followed by the nodes and then the string
+/// pool (padded to a multiple of 8 bytes)
+typedef struct {
+	char			magic[4];		//!< `kSnapshotMagic`
+	uint32_t		version;		//!< `kSnapshotVersion`
+	uint32_t		byte_order;		//!< `kSnapshotByteOrder`, as stored by the writer
+	uint32_t		node_size;		//!< `sizeof(tape_node)` for the writer
+	uint64_t		count;			//!< Number of nodes
+	uint64_t		strings_len;	//!< Length of string pool (without padding)
+	uint64_t		checksum;		//!< Checksum of nodes and string pool
+} snapshot_header;
+
+
+/// Open addressing hash table of member names in the string pool
+typedef struct {
+	uint32_t		offset;			//!< Offset of name plus one (0 for an empty slot)
+	uint32_t		hash;
+} tape_key_slot;
+
+struct tape_keys {
+	tape_key_slot *	slots;
+	size_t			size;			//!< Number of slots (a power of 2)
+	size_t			used;
+};
+
+
+/// Create an empty table of member names
+tape_keys * tape_keys_new(void) {
+	tape_keys * keys = malloc(sizeof(tape_keys));
+
+	if (keys) {
+		keys->slots = calloc(kKeysInitialSize, sizeof(tape_key_slot));
+		keys->size = kKeysInitialSize;
+		keys->used = 0;
+
+		if (keys->slots == NULL) {
+			free(keys);
+			return NULL;
+		}
+	}
+
+	return keys;
+}
+
+
+/// Free table of member names
+void tape_keys_free(tape_keys * keys) {
+	if (keys) {
+		free(keys->slots);
+		free(keys);
+	}
+}
+
+
+/// FNV-1a hash of `len` bytes
+static uint32_t hash_bytes(const char * s, size_t len) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char) s[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+
+/// Double the number of slots
+static bool grow_keys(tape_keys * keys) {
+	size_t size = keys->size * 2;
+	tape_key_slot * slots = calloc(size, sizeof(tape_key_slot));
+	size_t i, j;
+
+	if (slots == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < keys->size; i++) {
+		if (keys->slots[i].offset) {
+			for (j = keys->slots[i].hash & (size - 1); slots[j].offset; j = (j + 1) & (size - 1)) {
+			}
+
+			slots[j] = keys->slots[i];
+		}
+	}
+
+	free(keys->slots);
+	keys->slots = slots;
+	keys->size = size;
+
+	return true;
+}
+
+
+/// Share member names that were added before
+uint32_t tape_keys_intern(tape_keys * keys, json_tape * tape, uint32_t offset, size_t len) {
+	uint32_t hash;
+	size_t i;
+
+	// Names that can't be tracked are simply not shared
+	if ((keys == NULL) || ((keys->used + 1) * 2 > keys->size && !grow_keys(keys))) {
+		return offset;
+	}
+
+	hash = hash_bytes(tape->strings + offset, len);
+
+	for (i = hash & (keys->size - 1); keys->slots[i].offset; i = (i + 1) & (keys->size - 1)) {
+		const char * name = tape->strings + keys->slots[i].offset - 1;
+
+		if ((keys->slots[i].hash == hash) && (memcmp(name, tape->strings + offset, len) == 0) && (name[len] == '\0')) {
+			// Remove the new copy
+			tape->strings_len = offset;
+			return keys->slots[i].offset - 1;
+		}
+	}
+
+	keys->slots[i].offset = offset + 1;
+	keys->slots[i].hash = hash;
+	keys->used++;
+
+	return offset;
+}
+
+
+/// Count the nodes and string bytes needed for `v`
+static void measure(const JSON_Value * v, size_t * nodes, size_t * bytes) {
+	JSON_Object * object;
+	JSON_Array * array;
+	size_t i, count;
+
+	(*nodes)++;
+
+	switch (json_value_get_type(v)) {
+		case JSONObject:
+			object = json_value_get_object(v);
+			count = json_object_get_count(object);
+
+			for (i = 0; i < count; i++) {
+				*bytes += strlen(json_object_get_name(object, i)) + 1;
+				measure(json_object_get_value_at(object, i), nodes, bytes);
+			}
+
+			break;
+
+		case JSONArray:
+			array = json_value_get_array(v);
+			count = json_array_get_count(array);
+
+			for (i = 0; i < count; i++) {
+				measure(json_array_get_value(array, i), nodes, bytes);
+			}
+
+			break;
+
+		case JSONString:
+			*bytes += strlen(json_value_get_string(v)) + 1;
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+/// Copy string into the pool, returning its offset
+static uint32_t store_string(json_tape * tape, const char * s, size_t len) {
+	uint32_t offset = (uint32_t) tape->strings_len;
+
+	memcpy(tape->strings + offset, s, len);
+	tape->strings[offset + len] = '\0';
+	tape->strings_len += len + 1;
+
+	return offset;
+}
+
+
+/// Append `v` (and its descendants) to the tape
+static void fill(json_tape * tape, tape_keys * keys, const JSON_Value * v, const char * key) {
+	size_t index = tape->count++;
+	tape_node * node = &tape->nodes[index];
+	int type = json_value_get_type(v);
+	JSON_Object * object;
+	JSON_Array * array;
+	const char * s;
+	size_t i, count, len;
+
+	node->tag = TAPE_TAG(type, 0);
+	node->key = 0;
+
+	// Unused bytes are part of a snapshot, so keep them predictable
+	memset(&node->value, 0, sizeof(node->value));
+
+	if (key) {
+		len = strlen(key);
+		node->key = tape_keys_intern(keys, tape, store_string(tape, key, len), len);
+	}
+
+	switch (type) {
+		case JSONObject:
+			object = json_value_get_object(v);
+			count = json_object_get_count(object);
+			node->value.count = (uint32_t) count;
+
+			for (i = 0; i < count; i++) {
+				fill(tape, keys, json_object_get_value_at(object, i), json_object_get_name(object, i));
+			}
+
+			break;
+
+		case JSONArray:
+			array = json_value_get_array(v);
+			count = json_array_get_count(array);
+			node->value.count = (uint32_t) count;
+
+			for (i = 0; i < count; i++) {
+				fill(tape, keys, json_array_get_value(array, i), NULL);
+			}
+
+			break;
+
+		case JSONString:
+			s = json_value_get_string(v);
+			len = strlen(s);
+			node->value.string.offset = store_string(tape, s, len);
+			node->value.string.length = (uint32_t) len;
+			break;
+
+		case JSONNumber:
+			node->value.number = json_value_get_number(v);
+			break;
+
+		case JSONBoolean:
+			node->value.boolean = json_value_get_boolean(v);
+			break;
+
+		default:
+			node->value.count = 0;
+			break;
+	}
+
+	// `node` is still valid -- the array was sized in advance
+	node->tag = TAPE_TAG(type, tape->count);
+}
+
+
+/// Create a tape from a JSON value
+json_tape * json_tape_new(const JSON_Value * value) {
+	json_tape * tape;
+	tape_keys * keys;
+	size_t nodes = 0;
+	size_t bytes = 1;
+
+	if (value == NULL) {
+		return NULL;
+	}
+
+	measure(value, &nodes, &bytes);
+
+	if ((nodes >= kTapeMaxNodes) || (bytes >= UINT32_MAX)) {
+		return NULL;
+	}
+
+	tape = malloc(sizeof(json_tape));
+
+	if (tape == NULL) {
+		return NULL;
+	}
+
+	tape->nodes = malloc(nodes * sizeof(tape_node));
+	tape->strings = malloc(bytes);
+	tape->count = 0;
+	tape->strings_len = 0;
+	tape->borrowed = false;
+
+	if ((tape->nodes == NULL) || (tape->strings == NULL)) {
+		json_tape_free(tape);
+		return NULL;
+	}
+
+	// Empty string at offset 0 (which is also the empty member name)
+	keys = tape_keys_new();
+	tape_keys_intern(keys, tape, store_string(tape, "", 0), 0);
+
+	fill(tape, keys, value, NULL);
+	tape_keys_free(keys);
+
+	json_tape_shrink(tape);
+
+	return tape;
+}
+
+
+/// Parse JSON directly into a tape
+json_tape * json_tape_parse(const char * json, size_t len) {
+	JSON_Value * value = json_parse_stringn_with_flags(json, len, JSONParseArena);
+	json_tape * tape = json_tape_new(value);
+
+	json_value_free(value);
+
+	return tape;
+}
+
+
+/// Free tape
+void json_tape_free(json_tape * tape) {
+	if (tape) {
+		if (!tape->borrowed) {
+			free(tape->nodes);
+			free(tape->strings);
+		}
+
+		free(tape);
+	}
+}
+
+
+/// Bytes of memory used by tape
+size_t json_tape_size(const json_tape * tape) {
+	return tape->count * sizeof(tape_node) + tape->strings_len;
+}
+
+
+/// Release unused space at the end of the string pool
+void json_tape_shrink(json_tape * tape) {
+	char * strings;
+
+	if (!tape->borrowed) {
+		strings = realloc(tape->strings, tape->strings_len ? tape->strings_len : 1);
+
+		// Otherwise the original allocation is still fine
+		if (strings) {
+			tape->strings = strings;
+		}
+	}
+}
+
+
+/// Round up to a multiple of 8 bytes
+static size_t padded(size_t len) {
+	return (len + 7) & ~(size_t) 7;
+}
+
+
+/// Update 64-bit `hash` with `len` bytes of `data`, a word at a time (the
+/// last word is padded with zeroes)
+static uint64_t checksum(uint64_t hash, const char * data, size_t len) {
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i < len; i += 8) {
+		word = 0;
+		memcpy(&word, data + i, (len - i < 8) ? len - i : 8);
+
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+
+	return hash;
+}
+
+
+/// Write tape as a snapshot
+int json_tape_write_snapshot(const json_tape * tape, FILE * out) {
+	static const char padding[8] = {0};
+	size_t nodes_len = tape->count * sizeof(tape_node);
+	size_t padding_len = padded(tape->strings_len) - tape->strings_len;
+	snapshot_header header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+	header.version = kSnapshotVersion;
+	header.byte_order = kSnapshotByteOrder;
+	header.node_size = sizeof(tape_node);
+	header.count = tape->count;
+	header.strings_len = tape->strings_len;
+	header.checksum = checksum(checksum(kChecksumSeed, (const char *) tape->nodes, nodes_len), tape->strings, tape->strings_len);
+
+	if ((fwrite(&header, sizeof(header), 1, out) != 1) ||
+			(fwrite(tape->nodes, 1, nodes_len, out) != nodes_len) ||
+			(fwrite(tape->strings, 1, tape->strings_len, out) != tape->strings_len) ||
+			(fwrite(padding, 1, padding_len, out) != padding_len)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/// Does data start with a snapshot header
+bool json_tape_is_snapshot(const void * data, size_t len) {
+	return (len >= sizeof(snapshot_header)) && (memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0);
+}
+
+
+/// Is the string at `offset` within the pool, and NUL-terminated
+static bool valid_string(const char * strings, size_t strings_len, size_t offset, size_t len) {
+	return (offset < strings_len) && (len < strings_len - offset) && (strings[offset + len] == '\0');
+}
+
+
+/// Check that every node (and string) referenced by the nodes lies within the
+/// snapshot, so that a damaged file can't lead us astray
+static bool valid_nodes(const tape_node * nodes, size_t count, const char * strings, size_t strings_len) {
+	size_t i;
+
+	// Every string is terminated, so any offset within the pool is the start
+	// of a NUL-terminated string
+	if ((strings_len == 0) || (strings[strings_len - 1] != '\0')) {
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		if ((TAPE_NEXT(&nodes[i]) <= i) || (TAPE_NEXT(&nodes[i]) > count) || (nodes[i].key >= strings_len)) {
+			return false;
+		}
+
+		switch (TAPE_TYPE(&nodes[i])) {
+			case JSONObject:
+			case JSONArray:
+				break;
+
+			case JSONString:
+				if (!valid_string(strings, strings_len, nodes[i].value.string.offset, nodes[i].value.string.length)) {
+					return false;
+				}
+
+		// fallthrough
+
+			case JSONNumber:
+			case JSONBoolean:
+			case JSONNull:
+				if (TAPE_NEXT(&nodes[i]) != i + 1) {
+					return false;
+				}
+
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	return count && (TAPE_NEXT(&nodes[0]) == count);
+}
+
+
+/// Use a snapshot as a tape, without copying
+json_tape * json_tape_from_snapshot(const void * data, size_t len) {
+	const snapshot_header * header = data;
+	const char * nodes, * strings;
+	json_tape * tape;
+	size_t nodes_len;
+
+	if (!json_tape_is_snapshot(data, len) || ((uintptr_t) data % 8) ||
+			(header->version != kSnapshotVersion) ||
+			(header->byte_order != kSnapshotByteOrder) ||
+			(header->node_size != sizeof(tape_node))) {
+		return NULL;
+	}
+
+	// Sections must fill the snapshot exactly (checked without overflowing)
+	len -= sizeof(snapshot_header);
+
+	if (header->count > len / sizeof(tape_node)) {
+		return NULL;
+	}
+
+	nodes_len = header->count * sizeof(tape_node);
+
+	if ((header->strings_len > len - nodes_len) || (padded(header->strings_len) != len - nodes_len)) {
+		return NULL;
+	}
+
+	nodes = (const char *) data + sizeof(snapshot_header);
+	strings = nodes + nodes_len;
+
+	if ((checksum(checksum(kChecksumSeed, nodes, nodes_len), strings, header->strings_len) != header->checksum) ||
+			!valid_nodes((const tape_node *) nodes, header->count, strings, header->strings_len)) {
+		return NULL;
+	}
+
+	tape = malloc(sizeof(json_tape));
+
+	if (tape) {
+		// Never modified, so the `const` can be cast away
+		tape->nodes = (tape_node *) nodes;
+		tape->count = header->count;
+		tape->strings = (char *) strings;
+		tape->strings_len = header->strings_len;
+		tape->borrowed = true;
+	}
+
+	return tape;
+}
+
+
+/// Type of node
+int json_tape_type(const json_tape * tape, size_t node) {
+	if (node >= tape->count) {
+		return JSONError;
+	}
+
+	return TAPE_TYPE(&tape->nodes[node]);
+}
+
+
+/// First child of an array or object
+size_t json_tape_first_child(const json_tape * tape, size_t node) {
+	if ((node >= tape->count) || (TAPE_NEXT(&tape->nodes[node]) == node + 1)) {
+		return kTapeNone;
+	}
+
+	return node + 1;
+}
+
+
+/// Next sibling of a member or element of `parent`
+size_t json_tape_next_sibling(const json_tape * tape, size_t parent, size_t node) {
+	size_t next = TAPE_NEXT(&tape->nodes[node]);
+
+	return (next < TAPE_NEXT(&tape->nodes[parent])) ? next : kTapeNone;
+}
+
+
+/// Member of `object` named by the `len` bytes of `name`
+size_t json_tape_get_member(const json_tape * tape, size_t object, const char * name, size_t len) {
+	const tape_node * nodes = tape->nodes;
+	const char * key;
+	size_t end, i;
+
+	if ((object >= tape->count) || (TAPE_TYPE(&nodes[object]) != JSONObject)) {
+		return kTapeNone;
+	}
+
+	end = TAPE_NEXT(&nodes[object]);
+
+	for (i = object + 1; i < end; i = TAPE_NEXT(&nodes[i])) {
+		key = tape->strings + nodes[i].key;
+
+		if ((strnlen(key, len + 1) == len) && (memcmp(key, name, len) == 0)) {
+			return i;
+		}
+	}
+
+	return kTapeNone;
+}
+
+
+/// Member of `object` at dotted path `name`
+size_t json_tape_dotget(const json_tape * tape, size_t object, const char * name) {
+	const char * dot;
+
+	while ((dot = strchr(name, '.')) != NULL) {
+		object = json_tape_get_member(tape, object, name, dot - name);
+		name = dot + 1;
+	}
+
+	return json_tape_get_member(tape, object, name, strlen(name));
+}
+
+
+/// String value of node
+const char * json_tape_string(const json_tape * tape, size_t node, size_t * len) {
+	if ((node >= tape->count) || (TAPE_TYPE(&tape->nodes[node]) != JSONString)) {
+		return NULL;
+	}
+
+	if (len) {
+		*len = tape->nodes[node].value.string.length;
+	}
+
+	return tape->strings + tape->nodes[node].value.string.offset;
+}
+
+
+#ifdef TEST
+void Test_json_tape(CuTest * tc) {
+	const char * source = "{\"a\" : [1, \"two\", {\"b\" : true}], \"c\" : {\"d\" : {\"e\" : \"f\"}}, \"g\" : null, \"a.b\" : 0}";
+	json_tape * tape = json_tape_parse(source, strlen(source));
+	size_t a, n, len = 0;
+
+	CuAssertPtrNotNull(tc, tape);
+	CuAssertIntEquals(tc, 11, (int) tape->count);
+	CuAssertIntEquals(tc, JSONObject, json_tape_type(tape, 0));
+	CuAssertIntEquals(tc, 4, (int) tape->nodes[0].value.count);
+
+	// Iterate array
+	a = json_tape_get_member(tape, 0, "a", 1);
+	CuAssertIntEquals(tc, JSONArray, json_tape_type(tape, a));
+
+	n = json_tape_first_child(tape, a);
+	CuAssertDblEquals(tc, 1, tape->nodes[n].value.number, 0);
+
+	n = json_tape_next_sibling(tape, a, n);
+	CuAssertStrEquals(tc, "two", json_tape_string(tape, n, &len));
+	CuAssertIntEquals(tc, 3, (int) len);
+
+	n = json_tape_next_sibling(tape, a, n);
+	CuAssertIntEquals(tc, JSONObject, json_tape_type(tape, n));
+	CuAssertIntEquals(tc, 1, tape->nodes[json_tape_get_member(tape, n, "b", 1)].value.boolean);
+
+	CuAssertTrue(tc, json_tape_next_sibling(tape, a, n) == kTapeNone);
+
+	// Dotted names
+	CuAssertStrEquals(tc, "f", json_tape_string(tape, json_tape_dotget(tape, 0, "c.d.e"), NULL));
+	CuAssertIntEquals(tc, JSONObject, json_tape_type(tape, json_tape_dotget(tape, 0, "c.d")));
+	CuAssertTrue(tc, json_tape_dotget(tape, 0, "c.x.e") == kTapeNone);
+	CuAssertTrue(tc, json_tape_dotget(tape, 0, "a.b") == kTapeNone);
+	CuAssertIntEquals(tc, JSONNull, json_tape_type(tape, json_tape_dotget(tape, 0, "g")));
+
+	// Empty containers and scalars
+	CuAssertTrue(tc, json_tape_first_child(tape, json_tape_dotget(tape, 0, "g")) == kTapeNone);
+	CuAssertTrue(tc, json_tape_get_member(tape, a, "b", 1) == kTapeNone);
+	CuAssertIntEquals(tc, JSONError, json_tape_type(tape, kTapeNone));
+
+	json_tape_free(tape);
+
+	CuAssertPtrEquals(tc, NULL, json_tape_parse("[1,", 3));
+	CuAssertPtrEquals(tc, NULL, json_tape_new(NULL));
+
+	// Member names are only stored once
+	source = "[{\"name\" : \"x\", \"n\" : 1}, {\"name\" : \"y\", \"n\" : 2}, {\"\" : 0, \"nam\" : 3}]";
+	tape = json_tape_parse(source, strlen(source));
+	CuAssertPtrNotNull(tc, tape);
+	CuAssertIntEquals(tc, 16, (int) sizeof(tape_node));
+	CuAssertTrue(tc, tape->nodes[2].key == tape->nodes[5].key);
+	CuAssertTrue(tc, tape->nodes[3].key == tape->nodes[6].key);
+	CuAssertIntEquals(tc, 1 + 5 + 2 + 2 + 2 + 4, (int) tape->strings_len);
+	CuAssertIntEquals(tc, 10 * 16 + 16, (int) json_tape_size(tape));
+
+	n = json_tape_get_member(tape, 7, "nam", 3);
+	CuAssertDblEquals(tc, 3, tape->nodes[n].value.number, 0);
+	CuAssertIntEquals(tc, JSONNumber, json_tape_type(tape, json_tape_get_member(tape, 7, "", 0)));
+	CuAssertTrue(tc, json_tape_get_member(tape, 7, "name", 4) == kTapeNone);
+	CuAssertTrue(tc, json_tape_get_member(tape, 1, "na", 2) == kTapeNone);
+
+	json_tape_free(tape);
+}
+
+void Test_json_tape_snapshot(CuTest * tc) {
+	const char * source = "{\"a\" : [1, \"two\", {\"b\" : true}], \"c\" : {\"d\" : {\"e\" : \"f\"}}, \"g\" : null}";
+	json_tape * tape = json_tape_parse(source, strlen(source));
+	json_tape * snapshot;
+	uint64_t * buffer;
+	char * bytes;
+	FILE * f;
+	long len;
+
+	f = tmpfile();
+	CuAssertIntEquals(tc, 0, json_tape_write_snapshot(tape, f));
+
+	len = ftell(f);
+	CuAssertIntEquals(tc, 0, (int) (len % 8));
+
+	// `uint64_t` for alignment
+	buffer = malloc(len);
+	bytes = (char *) buffer;
+	rewind(f);
+	CuAssertIntEquals(tc, (int) len, (int) fread(bytes, 1, len, f));
+	fclose(f);
+
+	CuAssertTrue(tc, json_tape_is_snapshot(bytes, len));
+	CuAssertTrue(tc, !json_tape_is_snapshot(source, strlen(source)));
+
+	snapshot = json_tape_from_snapshot(bytes, len);
+	CuAssertPtrNotNull(tc, snapshot);
+	CuAssertIntEquals(tc, (int) tape->count, (int) snapshot->count);
+	CuAssertStrEquals(tc, "f", json_tape_string(snapshot, json_tape_dotget(snapshot, 0, "c.d.e"), NULL));
+	CuAssertIntEquals(tc, 1, snapshot->nodes[json_tape_get_member(snapshot, 4, "b", 1)].value.boolean);
+	CuAssertIntEquals(tc, JSONNull, json_tape_type(snapshot, json_tape_dotget(snapshot, 0, "g")));
+
+	// Freeing the tape leaves the snapshot alone
+	json_tape_free(snapshot);
+
+	// Truncated, misaligned, or damaged
+	CuAssertPtrEquals(tc, NULL, json_tape_from_snapshot(bytes, len - 8));
+	CuAssertPtrEquals(tc, NULL, json_tape_from_snapshot(bytes, 16));
+
+	memmove(bytes + 1, bytes, len - 1);
+	CuAssertPtrEquals(tc, NULL, json_tape_from_snapshot(bytes + 1, len - 1));
+	memmove(bytes, bytes + 1, len - 1);
+
+	bytes[len - 9] ^= 1;
+	CuAssertPtrEquals(tc, NULL, json_tape_from_snapshot(bytes, len));
+	bytes[len - 9] ^= 1;
+
+	// Another version
+	bytes[4]++;
+	CuAssertPtrEquals(tc, NULL, json_tape_from_snapshot(bytes, len));
+	bytes[4]--;
+
+	snapshot = json_tape_from_snapshot(bytes, len);
+	CuAssertPtrNotNull(tc, snapshot);
+	json_tape_free(snapshot);
+
+	free(buffer);
+	json_tape_free(tape);
+}
+#endif
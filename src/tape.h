@@ -0,0 +1,196 @@
+/**
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	@file tape.h
+
+	@brief Immutable, contiguous representation of a JSON document.
+
+	A tape stores every value of a document in a single array of fixed-size
+	nodes, in document order, with all strings (and member names) in a single
+	pool.  The children of an array or object are the nodes immediately
+	following it, and each node records where the next sibling starts, so
+	iteration is a forward walk through memory rather than pointer chasing
+	across the heap.
+
+	Nodes refer to each other (and to strings) by index rather than by
+	pointer, so a tape can be written to a snapshot file and later used
+	directly from a memory mapping of that file, without parsing.
+
+
+	@author	Fletcher T. Penney
+	@bug
+
+**/
+
+/*
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	The `magnum` project is released under the MIT License.
+
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+
+#ifndef TAPE_MAGNUM_H
+#define TAPE_MAGNUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "parson.h"
+
+#ifdef TEST
+	#include "CuTest.h"
+#endif
+
+
+/// Returned when a node can't be found
+#define kTapeNone	((size_t) -1)
+
+
+/// Low bits of `tape_node.tag` hold the type, the rest the index of the next node
+#define kTapeTypeBits	3
+#define kTapeMaxNodes	((size_t) 1 << (32 - kTapeTypeBits))
+
+#define TAPE_TYPE(n)			((int) ((n)->tag & ((1u << kTapeTypeBits) - 1)))
+#define TAPE_NEXT(n)			((size_t) ((n)->tag >> kTapeTypeBits))
+#define TAPE_TAG(type, next)	((uint32_t) (type) | ((uint32_t) (next) << kTapeTypeBits))
+
+
+/// A single value (16 bytes)
+typedef struct {
+	uint32_t		tag;			//!< Type (`JSONString`, `JSONNumber`, etc.) and the index of the
+									//!< node after this value and all of its descendants
+	uint32_t		key;			//!< Offset of member name in `strings` (NUL-terminated, and
+									//!< shared by members with the same name)
+	union {
+		double		number;
+		int			boolean;
+		uint32_t	count;			//!< Number of children of an array or object
+		struct {
+			uint32_t	offset;		//!< Offset in `strings` (NUL-terminated)
+			uint32_t	length;
+		} string;
+	} value;
+} tape_node;
+
+
+/// A whole document -- the root is node 0
+typedef struct json_tape {
+	tape_node *		nodes;
+	size_t			count;			//!< Number of nodes
+	char *			strings;		//!< String pool (starts with an empty string, the key of
+									//!< nodes that aren't object members)
+	size_t			strings_len;
+	bool			borrowed;		//!< `nodes` and `strings` belong to a snapshot, not the tape
+} json_tape;
+
+
+/// Member names already in a tape's string pool, used while the tape is being
+/// built so that each name is only stored once
+typedef struct tape_keys tape_keys;
+
+
+/// Create a tape from a JSON value (which may then be freed).  Returns NULL
+/// if `value` is NULL, or the document is too large (4 GB of strings, or
+/// `kTapeMaxNodes` values).  Free with `json_tape_free()`.
+json_tape * json_tape_new(const JSON_Value * value);
+
+
+/// Parse the first `len` bytes of `json` (not necessarily NUL-terminated)
+/// into a tape.  Returns NULL on error.
+json_tape * json_tape_parse(const char * json, size_t len);
+
+
+/// Free tape
+void json_tape_free(json_tape * tape);
+
+
+/// Bytes of memory used by the nodes and strings of `tape`
+size_t json_tape_size(const json_tape * tape);
+
+
+/// Create an empty table of member names
+tape_keys * tape_keys_new(void);
+
+
+/// Free table of member names
+void tape_keys_free(tape_keys * keys);
+
+
+/// Use the `len` byte string that was just added to the end of the string
+/// pool at `offset` as a member name.  If the same name was added before, the
+/// new copy is removed from the pool.  Returns the offset of the name.
+uint32_t tape_keys_intern(tape_keys * keys, json_tape * tape, uint32_t offset, size_t len);
+
+
+/// Release unused space at the end of the string pool once the tape is built
+void json_tape_shrink(json_tape * tape);
+
+
+/// Write `tape` to `out` as a snapshot, for use with
+/// `json_tape_from_snapshot()`.  Returns 0 on success.
+int json_tape_write_snapshot(const json_tape * tape, FILE * out);
+
+
+/// Does the `len` bytes at `data` start with a snapshot header (of any version)?
+bool json_tape_is_snapshot(const void * data, size_t len);
+
+
+/// Use the `len` bytes at `data` (e.g. a memory mapped snapshot file) as a
+/// tape, without copying.  `data` must be 8-byte aligned, and remain valid
+/// until the tape is freed.  Returns NULL if `data` is not a snapshot, was
+/// written by a different version (or kind of machine), or is damaged.
+json_tape * json_tape_from_snapshot(const void * data, size_t len);
+
+
+/// Type of node (`JSONError` for `kTapeNone`)
+int json_tape_type(const json_tape * tape, size_t node);
+
+
+/// First child of an array or object, or `kTapeNone` if empty
+size_t json_tape_first_child(const json_tape * tape, size_t node);
+
+
+/// Next sibling of a member or element of `parent`, or `kTapeNone` if it was the last
+size_t json_tape_next_sibling(const json_tape * tape, size_t parent, size_t node);
+
+
+/// Member of `object` named by the `len` bytes of `name`, or `kTapeNone`
+size_t json_tape_get_member(const json_tape * tape, size_t object, const char * name, size_t len);
+
+
+/// Member of `object` at dotted path `name` (e.g. `a.b.c`), with the same
+/// rules as `json_object_dotget_value()`.  Returns `kTapeNone` if not found.
+size_t json_tape_dotget(const json_tape * tape, size_t object, const char * name);
+
+
+/// String value of node, NUL-terminated, with its length in `len` (if not NULL)
+const char * json_tape_string(const json_tape * tape, size_t node, size_t * len);
+
+
+#endif
@@ -0,0 +1,1085 @@
+/*
+
+	Magnum -- C implementation of Mustache logic-less templates
+
+	benchmark.c -- Microbenchmarks for performance-sensitive routines
+
+	Build with `make benchmark`, then run `build-bench/benchmark` to run all
+	benchmarks, or `build-bench/benchmark <name> ...` to run specific ones.
+
+	Copyright © 2017-2024 Fletcher T. Penney.
+
+	## The MIT License ##
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in
+	all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+	THE SOFTWARE.
+
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "d_string.h"
+#include "escape.h"
+#include "libMagnum.h"
+#include "number.h"
+#include "parson.h"
+#include "provider.h"
+#include "scanner.h"
+#include "serialize.h"
+#include "tape.h"
+
+
+#define kEscapeBufferSize	(16 * 1024 * 1024)
+#define kEscapeIterations	20
+
+#define kNumberCount		1000000
+
+#define kScanTemplateSize	(64 * 1024)
+#define kScanIterations		2000
+
+#define kParseRecords		100000
+#define kParseIterations	5
+#define kParseWideKeys		5000
+
+#define kRenderRecords		100000
+#define kRenderIterations	5
+
+#define kMemoryRecords		100000
+
+#define kSerializeRecords		100000
+#define kSerializeIterations	5
+
+#define kReplaceSize			(8 * 1024 * 1024)
+#define kReplaceOriginalSize	(256 * 1024)		//!< Erasing and inserting is quadratic
+#define kReplaceLineLength		40
+
+#define kAppendCount			2000000
+
+
+/// Monotonic time in seconds
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/// Print throughput for `bytes` processed in `seconds`
+static void report_throughput(const char * name, double bytes, double seconds) {
+	fprintf(stdout, "  %-36s %8.2f GB/s\n", name, bytes / seconds / 1e9);
+}
+
+
+/// Fill buffer with text, with a special character every `interval` bytes (0 for none)
+static void fill_text(char * buffer, size_t len, size_t interval) {
+	const char text[] = "The quick brown fox jumps over the lazy dog. ";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buffer[i] = text[i % (sizeof(text) - 1)];
+
+		if (interval && (i % interval == interval - 1)) {
+			buffer[i] = "<>&\""[(i / interval) % 4];
+		}
+	}
+}
+
+
+/// The original byte-at-a-time approach, for comparison
+static void escape_html_bytewise(DString * out, const char * s, size_t len) {
+	const char * end = s + len;
+
+	for (; s < end; s++) {
+		switch (*s) {
+			case '>':
+				d_string_append_c_array(out, "&gt;", 4);
+				break;
+
+			case '<':
+				d_string_append_c_array(out, "&lt;", 4);
+				break;
+
+			case '&':
+				d_string_append_c_array(out, "&amp;", 5);
+				break;
+
+			case '\"':
+				d_string_append_c_array(out, "&quot;", 6);
+				break;
+
+			default:
+				d_string_append_c(out, *s);
+				break;
+		}
+	}
+}
+
+
+static double time_escape(DString * out, const char * buffer, size_t len, escape_scanner scan) {
+	double start = now();
+	int i;
+
+	for (i = 0; i < kEscapeIterations; i++) {
+		d_string_erase(out, 0, -1);
+
+		if (scan) {
+			escape_html_with_scanner(out, buffer, len, scan);
+		} else {
+			escape_html_bytewise(out, buffer, len);
+		}
+	}
+
+	return now() - start;
+}
+
+
+static void bench_escape(void) {
+	char * buffer = malloc(kEscapeBufferSize);
+	DString * out = d_string_new("");
+	double bytes = (double) kEscapeBufferSize * kEscapeIterations;
+	size_t intervals[] = {0, 1000, 64, 8};
+	size_t i;
+
+	for (i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+		fill_text(buffer, kEscapeBufferSize, intervals[i]);
+
+		if (intervals[i]) {
+			fprintf(stdout, "escape_html: 1 special character per %lu bytes\n", (unsigned long) intervals[i]);
+		} else {
+			fprintf(stdout, "escape_html: no special characters\n");
+		}
+
+		report_throughput("byte at a time", bytes, time_escape(out, buffer, kEscapeBufferSize, NULL));
+		report_throughput("scalar", bytes, time_escape(out, buffer, kEscapeBufferSize, escape_scan_html_scalar));
+
+		#ifdef ESCAPE_HAVE_SSE2
+		report_throughput("sse2", bytes, time_escape(out, buffer, kEscapeBufferSize, escape_scan_html_sse2));
+		#endif
+
+		#ifdef ESCAPE_HAVE_AVX2
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2")) {
+			report_throughput("avx2", bytes, time_escape(out, buffer, kEscapeBufferSize, escape_scan_html_avx2));
+		}
+
+		#endif
+	}
+
+	d_string_free(out, true);
+	free(buffer);
+}
+
+
+// The original number formatting routines, for comparison.
+// From https://stackoverflow.com/questions/277772/avoid-trailing-zeroes-in-printf
+
+static void morphNumericString (char * s, int n) {
+	char * p;
+	int count;
+
+	p = strchr (s, '.');
+
+	if (p != NULL) {
+		count = n;
+
+		while (count >= 0) {
+			count--;
+
+			if (*p == '\0') {
+				break;
+			}
+
+			p++;
+		}
+
+		*p-- = '\0';
+
+		while (*p == '0') {
+			*p-- = '\0';
+		}
+
+		if (*p == '.') {
+			*p = '\0';
+		}
+	}
+}
+
+
+static void nDecimals (char * s, double d, int n) {
+	int sz;
+	double d2;
+
+	d2 = (d >= 0) ? d : -d;
+	sz = (d >= 0) ? 0 : 1;
+
+	if (d2 < 1) {
+		sz++;
+	}
+
+	while (d2 >= 1) {
+		d2 /= 10.0;
+		sz++;
+	}
+
+	sz += 1 + n;
+
+	sprintf (s, "%*.*f", sz, n, d);
+}
+
+
+static void print_double_original(DString * out, double value) {
+	char buf[50];
+
+	if (value > 1.0 ) {
+		nDecimals(buf, value, 6);
+		morphNumericString(buf, 6);
+	} else {
+		nDecimals(buf, value, 15);
+		morphNumericString(buf, 15);
+	}
+
+	d_string_append(out, buf);
+}
+
+
+/// Format all values, returning elapsed time.  `format` < 0 uses the original routine.
+static double time_numbers(DString * out, const double * values, size_t count, int format) {
+	double start = now();
+	size_t i;
+
+	d_string_erase(out, 0, -1);
+
+	for (i = 0; i < count; i++) {
+		if (format < 0) {
+			print_double_original(out, values[i]);
+		} else {
+			number_append(out, values[i], format, 2);
+		}
+
+		d_string_append_c(out, '\n');
+	}
+
+	return now() - start;
+}
+
+
+static void report_rate(const char * name, size_t count, double seconds) {
+	fprintf(stdout, "  %-36s %8.1f ns/number\n", name, seconds * 1e9 / count);
+}
+
+
+static void bench_number(void) {
+	double * values = malloc(kNumberCount * sizeof(double));
+	DString * out = d_string_new("");
+	const char * kinds[] = {"integers", "prices", "metrics"};
+	size_t i, k;
+
+	srand(42);
+
+	for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+		for (i = 0; i < kNumberCount; i++) {
+			switch (k) {
+				case 0:
+					values[i] = rand() % 1000000;
+					break;
+
+				case 1:
+					values[i] = (rand() % 1000000) / 100.0;
+					break;
+
+				default:
+					values[i] = (double) rand() / RAND_MAX * 1000.0;
+					break;
+			}
+		}
+
+		fprintf(stdout, "number: %s\n", kinds[k]);
+
+		report_rate("original (nDecimals)", kNumberCount, time_numbers(out, values, kNumberCount, -1));
+		report_rate("legacy", kNumberCount, time_numbers(out, values, kNumberCount, MAGNUM_NUMBER_LEGACY));
+		report_rate("shortest", kNumberCount, time_numbers(out, values, kNumberCount, MAGNUM_NUMBER_SHORTEST));
+		report_rate("fixed (2 decimals)", kNumberCount, time_numbers(out, values, kNumberCount, MAGNUM_NUMBER_FIXED));
+	}
+
+	d_string_free(out, true);
+	free(values);
+}
+
+
+/// Literal-heavy HTML template with a tag every `interval` bytes
+static char * scan_template(size_t len, size_t interval) {
+	const char html[] = "<div class=\"row\"><span class=\"label\">Lorem ipsum dolor sit amet</span></div>\n";
+	const char tag[] = "{{name}}";
+	char * buffer = malloc(len + 1);
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buffer[i] = html[i % (sizeof(html) - 1)];
+	}
+
+	for (i = interval; interval && (i + sizeof(tag) < len); i += interval) {
+		memcpy(buffer + i, tag, sizeof(tag) - 1);
+	}
+
+	buffer[len] = '\0';
+
+	return buffer;
+}
+
+
+/// The original approach -- strstr() for each delimiter
+static size_t scan_strstr(const char * str) {
+	const char * start = strstr(str, "{{");
+	const char * stop;
+	size_t count = 0;
+
+	while (start) {
+		stop = strstr(start + 2, "}}");
+
+		if (stop == NULL) {
+			break;
+		}
+
+		count++;
+		start = strstr(stop + 2, "{{");
+	}
+
+	return count;
+}
+
+
+static void bench_scan(void) {
+	size_t intervals[] = {0, 4096, 256};
+	double bytes = (double) kScanTemplateSize * kScanIterations;
+	scanner_index index;
+	size_t count = 0;
+	char * text;
+	const char * volatile volatile_text;
+	double start;
+	size_t i;
+	int j;
+
+	for (i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+		text = scan_template(kScanTemplateSize, intervals[i]);
+		volatile_text = text;
+
+		if (intervals[i]) {
+			fprintf(stdout, "scan: 64 KB template, 1 tag per %lu bytes\n", (unsigned long) intervals[i]);
+		} else {
+			fprintf(stdout, "scan: 64 KB template, no tags\n");
+		}
+
+		start = now();
+
+		for (j = 0; j < kScanIterations; j++) {
+			count += scan_strstr(volatile_text);
+		}
+
+		report_throughput("strstr", bytes, now() - start);
+
+		start = now();
+
+		for (j = 0; j < kScanIterations; j++) {
+			scanner_index_tags(&index, text, kScanTemplateSize, "{{", "}}");
+			count -= index.count;
+			scanner_index_free(&index);
+		}
+
+		report_throughput("scanner_index_tags", bytes, now() - start);
+
+		free(text);
+	}
+
+	// Ensure the work isn't optimized away
+	if (count) {
+		fprintf(stderr, "scan: tag counts differ\n");
+	}
+}
+
+
+/// JSON document of `count` records, about 10 values each
+static DString * parse_document(size_t count) {
+	DString * json = d_string_new("[");
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		d_string_append_printf(json, "%s{\"id\" : %lu, \"name\" : \"Item %lu\", \"price\" : %lu.%02lu, "
+			"\"tags\" : [\"a\", \"b\", \"c\"], \"active\" : %s, \"parent\" : null}",
+			i ? ", " : "", (unsigned long) i, (unsigned long) i, (unsigned long) i % 1000,
+			(unsigned long) i % 100, (i % 2) ? "true" : "false");
+	}
+
+	d_string_append(json, "]");
+
+	return json;
+}
+
+
+/// Parse and free the document, returning elapsed time.  `copy` is used as
+/// the (overwritten) buffer for in situ parsing.
+/// Pretty-printed records dominated by long string values
+static DString * parse_text_document(size_t count) {
+	DString * json = d_string_new("[\n");
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		d_string_append_printf(json, "%s    {\n        \"id\" : %lu,\n        \"text\" : \"Item %lu -- "
+			"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut "
+			"labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco "
+			"laboris nisi ut aliquip ex ea commodo consequat.\\n\"\n    }",
+			i ? ",\n" : "", (unsigned long) i, (unsigned long) i);
+	}
+
+	d_string_append(json, "\n]");
+
+	return json;
+}
+
+
+/// Array of integer IDs alternating with prices
+static DString * parse_number_document(size_t count) {
+	DString * json = d_string_new("[");
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		d_string_append_printf(json, "%s%lu, %lu.%02lu", i ? ", " : "", (unsigned long) i * 7,
+			(unsigned long) i % 5000, (unsigned long) i % 100);
+	}
+
+	d_string_append(json, "]");
+
+	return json;
+}
+
+
+/// A single object with `count` keys
+static DString * parse_wide_document(size_t count) {
+	DString * json = d_string_new("{");
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		d_string_append_printf(json, "%s\"key%lu\" : %lu", i ? ", " : "", (unsigned long) i, (unsigned long) i);
+	}
+
+	d_string_append(json, "}");
+
+	return json;
+}
+
+
+static double time_parse(DString * json, int flags, char * copy, double * free_time) {
+	double start = now(), parsed;
+	JSON_Value * v;
+	int i;
+
+	*free_time = 0;
+
+	for (i = 0; i < kParseIterations; i++) {
+		if (copy) {
+			memcpy(copy, json->str, json->currentStringLength);
+			v = json_parse_stringn_in_situ(copy, json->currentStringLength, flags);
+		} else {
+			v = json_parse_stringn_with_flags(json->str, json->currentStringLength, flags);
+		}
+
+		if (v == NULL) {
+			fprintf(stderr, "parse: invalid document\n");
+		}
+
+		parsed = now();
+		json_value_free(v);
+		*free_time += now() - parsed;
+	}
+
+	return now() - start;
+}
+
+
+static const char * kSelectFieldTemplate = "{{#.}}{{id}}\n{{/.}}";
+static const char * kSelectTitleTemplate = "{{title}}";
+
+
+/// Time parsing only the keys used by `template`
+static double time_select(DString * json, const char * template) {
+	magnum_keys * keys = magnum_keys_new();
+	double start;
+	int i;
+
+	magnum_keys_add_template(keys, template, strlen(template), NULL);
+
+	start = now();
+
+	for (i = 0; i < kParseIterations; i++) {
+		json_value_free(json_parse_stringn_filtered(json->str, json->currentStringLength, JSONParseArena,
+			magnum_keys_filter, keys));
+	}
+
+	magnum_keys_free(keys);
+
+	return now() - start;
+}
+
+
+static void bench_parse(void) {
+	DString * json = parse_document(kParseRecords);
+	double bytes = (double) json->currentStringLength * kParseIterations;
+	char * copy = malloc(json->currentStringLength);
+	double seconds, free_time;
+
+	fprintf(stdout, "parse: %lu records (%lu values, %.1f MB), parse + free\n", (unsigned long) kParseRecords,
+		(unsigned long) kParseRecords * 10 + 1, json->currentStringLength / 1e6);
+
+	seconds = time_parse(json, JSONParseDefault, NULL, &free_time);
+	report_throughput("heap", bytes, seconds);
+	fprintf(stdout, "  %-36s %8.2f ms\n", "heap (free only)", free_time * 1e3 / kParseIterations);
+
+	seconds = time_parse(json, JSONParseArena, NULL, &free_time);
+	report_throughput("arena", bytes, seconds);
+	fprintf(stdout, "  %-36s %8.2f ms\n", "arena (free only)", free_time * 1e3 / kParseIterations);
+
+	seconds = time_parse(json, JSONParseArena, copy, &free_time);
+	report_throughput("arena, in situ (including copy)", bytes, seconds);
+
+	free(copy);
+	seconds = time_select(json, kSelectFieldTemplate);
+	report_throughput("arena, template reads one field", bytes, seconds);
+
+	// A template that reads nothing from the records skips them entirely
+	d_string_prepend(json, "{\"title\" : \"Records\", \"records\" : ");
+	d_string_append(json, "}");
+
+	seconds = time_select(json, kSelectTitleTemplate);
+	report_throughput("arena, template reads title only", bytes, seconds);
+
+	d_string_free(json, true);
+
+	json = parse_text_document(kParseRecords);
+	bytes = (double) json->currentStringLength * kParseIterations;
+
+	fprintf(stdout, "parse: %lu pretty-printed text records (%.1f MB), parse + free\n", (unsigned long) kParseRecords,
+		json->currentStringLength / 1e6);
+
+	seconds = time_parse(json, JSONParseArena, NULL, &free_time);
+	report_throughput("arena", bytes, seconds);
+
+	d_string_free(json, true);
+
+	json = parse_number_document(kParseRecords * 10);
+	bytes = (double) json->currentStringLength * kParseIterations;
+
+	fprintf(stdout, "parse: %lu numbers (IDs and prices, %.1f MB), parse + free\n", (unsigned long) kParseRecords * 20,
+		json->currentStringLength / 1e6);
+
+	seconds = time_parse(json, JSONParseArena, NULL, &free_time);
+	report_throughput("arena", bytes, seconds);
+
+	d_string_free(json, true);
+
+	json = parse_wide_document(kParseWideKeys);
+
+	fprintf(stdout, "parse: one object with %lu keys (%.1f MB), parse + free\n", (unsigned long) kParseWideKeys,
+		json->currentStringLength / 1e6);
+
+	// Duplicate key checks make this quadratic, so report time per parse
+	seconds = time_parse(json, JSONParseArena, NULL, &free_time);
+	fprintf(stdout, "  %-36s %8.2f ms\n", "arena", seconds * 1e3 / kParseIterations);
+
+	seconds = time_parse(json, JSONParseArena | JSONParseTrusted, NULL, &free_time);
+	fprintf(stdout, "  %-36s %8.2f ms\n", "arena, trusted", seconds * 1e3 / kParseIterations);
+
+	d_string_free(json, true);
+}
+
+
+static const char * kRenderTemplate = "{{#items}}{{id}}: {{name}} ({{price}}) "
+	"{{#tags}}[{{.}}]{{/tags}}{{#active}} active{{/active}}\n{{/items}}";
+
+
+/// Time rendering `kRenderTemplate` from either the tree or the tape
+static double time_render(JSON_Value * root, const json_tape * tape, size_t * length) {
+	DString * out = d_string_new("");
+	size_t len = strlen(kRenderTemplate);
+	double start = now();
+	int i;
+
+	for (i = 0; i < kRenderIterations; i++) {
+		d_string_erase(out, 0, -1);
+
+		if (tape) {
+			magnum_populate_buffer_from_tape(kRenderTemplate, len, tape, out, NULL, NULL, NULL);
+		} else {
+			magnum_populate_buffer_from_json(kRenderTemplate, len, root, out, NULL, NULL, NULL);
+		}
+	}
+
+	*length = out->currentStringLength;
+	d_string_free(out, true);
+
+	return now() - start;
+}
+
+
+/// Time rendering `kRenderTemplate` from the tape into a new buffer each
+/// time, as a server would, optionally presized from a running estimate
+static double time_render_fresh(const json_tape * tape, int presize) {
+	size_t len = strlen(kRenderTemplate);
+	magnum_estimate estimate = {0};
+	magnum_options options = {0};
+	double start;
+	DString * out;
+	int i;
+
+	if (presize) {
+		options.estimate = &estimate;
+
+		// Warm up the estimate
+		out = d_string_new("");
+		magnum_populate_buffer_from_tape(kRenderTemplate, len, tape, out, NULL, NULL, &options);
+		d_string_free(out, true);
+	}
+
+	start = now();
+
+	for (i = 0; i < kRenderIterations; i++) {
+		out = d_string_new("");
+		magnum_populate_buffer_from_tape(kRenderTemplate, len, tape, out, NULL, NULL, &options);
+		d_string_free(out, true);
+	}
+
+	return now() - start;
+}
+
+
+/// Compare getting a tape by parsing JSON with loading it from a snapshot
+static void time_load(DString * json, const json_tape * tape) {
+	json_tape * loaded;
+	double start, seconds;
+	char * snapshot;
+	size_t len;
+	FILE * f;
+	int i;
+
+	f = tmpfile();
+	json_tape_write_snapshot(tape, f);
+	len = ftell(f);
+
+	// Aligned, as a mapping would be
+	snapshot = malloc(len);
+	rewind(f);
+
+	if (fread(snapshot, 1, len, f) != len) {
+		fprintf(stderr, "render: error reading snapshot\n");
+	}
+
+	fclose(f);
+
+	start = now();
+
+	for (i = 0; i < kParseIterations; i++) {
+		json_tape_free(json_tape_parse(json->str, json->currentStringLength));
+	}
+
+	seconds = now() - start;
+	fprintf(stdout, "  %-36s %8.2f ms\n", "load: parse JSON into tape", seconds * 1e3 / kParseIterations);
+
+	start = now();
+
+	for (i = 0; i < kParseIterations; i++) {
+		loaded = json_tape_from_snapshot(snapshot, len);
+
+		if (loaded == NULL) {
+			fprintf(stderr, "render: invalid snapshot\n");
+		}
+
+		json_tape_free(loaded);
+	}
+
+	seconds = now() - start;
+	fprintf(stdout, "  %-36s %8.2f ms\n", "load: check snapshot", seconds * 1e3 / kParseIterations);
+
+	free(snapshot);
+}
+
+
+static void bench_render(void) {
+	DString * json = parse_document(kRenderRecords);
+	JSON_Value * root;
+	json_tape * tape;
+	size_t tree_length, tape_length;
+	double seconds;
+
+	d_string_prepend(json, "{\"items\" : ");
+	d_string_append(json, "}");
+
+	root = json_parse_stringn_with_flags(json->str, json->currentStringLength, JSONParseArena);
+	tape = json_tape_new(root);
+
+	fprintf(stdout, "render: %lu records, section with nested list\n", (unsigned long) kRenderRecords);
+
+	seconds = time_render(root, NULL, &tree_length);
+	fprintf(stdout, "  %-36s %8.1f ns/record\n", "tree", seconds * 1e9 / kRenderRecords / kRenderIterations);
+
+	seconds = time_render(NULL, tape, &tape_length);
+	fprintf(stdout, "  %-36s %8.1f ns/record\n", "tape", seconds * 1e9 / kRenderRecords / kRenderIterations);
+
+	if (tree_length != tape_length) {
+		fprintf(stderr, "render: output lengths differ\n");
+	}
+
+	seconds = time_render_fresh(tape, 0);
+	fprintf(stdout, "  %-36s %8.1f ns/record\n", "tape, new buffer", seconds * 1e9 / kRenderRecords / kRenderIterations);
+
+	seconds = time_render_fresh(tape, 1);
+	fprintf(stdout, "  %-36s %8.1f ns/record\n", "tape, new buffer presized", seconds * 1e9 / kRenderRecords / kRenderIterations);
+
+	time_load(json, tape);
+
+	json_tape_free(tape);
+	json_value_free(root);
+	d_string_free(json, true);
+}
+
+
+/// Bytes currently allocated through parson
+static size_t parson_bytes;
+
+
+/// parson allocator that keeps track of `parson_bytes` -- the size is kept
+/// in front of each block (two words, to preserve alignment)
+static void * counting_malloc(size_t size) {
+	size_t * block = malloc(size + 2 * sizeof(size_t));
+
+	if (block == NULL) {
+		return NULL;
+	}
+
+	block[0] = size;
+	parson_bytes += size;
+
+	return block + 2;
+}
+
+
+static void counting_free(void * ptr) {
+	size_t * block = ptr;
+
+	if (block) {
+		block -= 2;
+		parson_bytes -= block[0];
+		free(block);
+	}
+}
+
+
+/// Memory used by a parsed document, per value
+static void report_memory(const char * name, size_t bytes, size_t values) {
+	fprintf(stdout, "  %-36s %8.1f bytes/value %10.1f MB\n", name, (double) bytes / values, bytes / 1e6);
+}
+
+
+static void bench_memory(void) {
+	DString * json = parse_document(kMemoryRecords);
+	JSON_Value * root;
+	json_tape * tape;
+	size_t values;
+
+	json_set_allocation_functions(counting_malloc, counting_free);
+
+	root = json_parse_stringn_with_flags(json->str, json->currentStringLength, JSONParseArena);
+	tape = json_tape_new(root);
+	values = tape->count;
+
+	fprintf(stdout, "memory: %lu records, %lu values, %.1f MB of JSON\n", (unsigned long) kMemoryRecords,
+		(unsigned long) values, json->currentStringLength / 1e6);
+
+	report_memory("tree (arena)", parson_bytes, values);
+	json_value_free(root);
+
+	root = json_parse_stringn(json->str, json->currentStringLength);
+	report_memory("tree (heap)", parson_bytes, values);
+	json_value_free(root);
+
+	report_memory("tape", json_tape_size(tape), values);
+
+	json_set_allocation_functions(malloc, free);
+
+	json_tape_free(tape);
+	d_string_free(json, true);
+}
+
+
+/// Serialize `root` (or `tape`) `kSerializeIterations` times
+static double time_serialize(JSON_Value * root, const json_tape * tape, size_t * length) {
+	DString * out = d_string_new("");
+	double start = now();
+	int i;
+
+	for (i = 0; i < kSerializeIterations; i++) {
+		d_string_erase(out, 0, -1);
+
+		if (tape) {
+			serialize_value(out, &json_tape_provider, (void *) tape, json_tape_provider_root(tape), NULL);
+		} else {
+			json_serialize_to_dstring(root, out);
+		}
+	}
+
+	*length = out->currentStringLength;
+	d_string_free(out, true);
+
+	return now() - start;
+}
+
+
+static void bench_serialize(void) {
+	DString * json = parse_document(kSerializeRecords);
+	JSON_Value * root = json_parse_stringn(json->str, json->currentStringLength);
+	json_tape * tape = json_tape_new(root);
+	size_t length, i;
+	double start, seconds;
+	char * s;
+
+	fprintf(stdout, "serialize: %lu records\n", (unsigned long) kSerializeRecords);
+
+	// parson measures, then writes
+	start = now();
+
+	for (i = 0; i < kSerializeIterations; i++) {
+		s = json_serialize_to_string(root);
+		length = strlen(s);
+		json_free_serialized_string(s);
+	}
+
+	seconds = now() - start;
+	report_throughput("json_serialize_to_string", (double) length * kSerializeIterations, seconds);
+
+	seconds = time_serialize(root, NULL, &length);
+	report_throughput("json_serialize_to_dstring", (double) length * kSerializeIterations, seconds);
+
+	seconds = time_serialize(NULL, tape, &length);
+	report_throughput("serialize_value (tape)", (double) length * kSerializeIterations, seconds);
+
+	json_tape_free(tape);
+	json_value_free(root);
+	d_string_free(json, true);
+}
+
+
+/// `len` bytes of lines to be indented
+static DString * replace_document(size_t len) {
+	DString * d = d_string_new("");
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		d_string_append_c(d, (i % kReplaceLineLength == kReplaceLineLength - 1) ? '\n' : 'x');
+	}
+
+	return d;
+}
+
+
+/// Previous d_string_replace_text_in_range() -- each match is erased and the
+/// replacement inserted, moving the rest of the string twice
+static void replace_original(DString * d, const char * original, const char * replace) {
+	size_t len_o = strlen(original);
+	size_t len_r = strlen(replace);
+	size_t pos;
+	char * match = strstr(d->str, original);
+
+	while (match) {
+		pos = match - d->str;
+		d_string_erase(d, pos, len_o);
+		d_string_insert(d, pos, replace);
+		match = strstr(d->str + pos + len_r, original);
+	}
+}
+
+
+/// Indent every line of a `len` byte document, then remove the indent again
+static void time_replace(const char * name, size_t len, bool original) {
+	DString * d = replace_document(len);
+	double start, indent, unindent;
+
+	start = now();
+
+	if (original) {
+		replace_original(d, "\n", "\n    ");
+	} else {
+		d_string_replace_text_in_range(d, 0, -1, "\n", "\n    ");
+	}
+
+	indent = now() - start;
+	start = now();
+
+	if (original) {
+		replace_original(d, "\n    ", "\n");
+	} else {
+		d_string_replace_text_in_range(d, 0, -1, "\n    ", "\n");
+	}
+
+	unindent = now() - start;
+
+	fprintf(stdout, "  %-36s %8.1f MB/s indent %8.1f MB/s unindent\n", name, len / indent / 1e6, len / unindent / 1e6);
+
+	d_string_free(d, true);
+}
+
+
+static void bench_replace(void) {
+	fprintf(stdout, "replace: a match every %d bytes\n", kReplaceLineLength);
+
+	time_replace("erase + insert (256 KB)", kReplaceOriginalSize, true);
+	time_replace("single pass (256 KB)", kReplaceOriginalSize, false);
+	time_replace("single pass (8 MB)", kReplaceSize, false);
+}
+
+
+/// From d_string.c
+int vasprintf(char ** strp, const char * fmt, va_list ap);
+
+
+/// The original approach -- format into a heap temporary, then append
+static void append_printf_original(DString * d, const char * format, ...) {
+	char * formatted = NULL;
+	va_list args;
+
+	va_start(args, format);
+	vasprintf(&formatted, format, args);
+	va_end(args);
+
+	if (formatted != NULL) {
+		d_string_append(d, formatted);
+		free(formatted);
+	}
+}
+
+
+/// The original append, which scans `s` twice
+static void append_original(DString * d, const char * s) {
+	size_t len = strlen(s);
+
+	if (d->currentStringLength + len >= d->currentStringBufferSize) {
+		d_string_reserve(d, d->currentStringBufferSize + len);		// Double, as appending does
+	}
+
+	strncat(d->str + d->currentStringLength, s, len);
+	d->currentStringLength += len;
+}
+
+
+/// Time `kAppendCount` short appends of each kind
+static void bench_append(void) {
+	const char * words[] = {"<li>", "A medium length string of text", "</li>\n", "&amp;"};
+	DString * d = d_string_new("");
+	double start;
+	int i;
+
+	fprintf(stdout, "append: %d short appends\n", kAppendCount);
+
+	start = now();
+
+	for (i = 0; i < kAppendCount; i++) {
+		append_printf_original(d, "%d, ", i);
+	}
+
+	fprintf(stdout, "  %-36s %8.1f ns/append\n", "printf via heap temporary", (now() - start) * 1e9 / kAppendCount);
+	d_string_erase(d, 0, -1);
+	start = now();
+
+	for (i = 0; i < kAppendCount; i++) {
+		d_string_append_printf(d, "%d, ", i);
+	}
+
+	fprintf(stdout, "  %-36s %8.1f ns/append\n", "printf in place", (now() - start) * 1e9 / kAppendCount);
+	d_string_erase(d, 0, -1);
+	start = now();
+
+	for (i = 0; i < kAppendCount; i++) {
+		append_original(d, words[i % 4]);
+	}
+
+	fprintf(stdout, "  %-36s %8.1f ns/append\n", "strlen + strncat", (now() - start) * 1e9 / kAppendCount);
+	d_string_erase(d, 0, -1);
+	start = now();
+
+	for (i = 0; i < kAppendCount; i++) {
+		d_string_append(d, words[i % 4]);
+	}
+
+	fprintf(stdout, "  %-36s %8.1f ns/append\n", "strlen + memcpy", (now() - start) * 1e9 / kAppendCount);
+
+	d_string_free(d, true);
+}
+
+
+typedef struct {
+	const char *	name;
+	void (*run)(void);
+} benchmark;
+
+static const benchmark benchmarks[] = {
+	{"escape", bench_escape},
+	{"number", bench_number},
+	{"scan", bench_scan},
+	{"parse", bench_parse},
+	{"render", bench_render},
+	{"memory", bench_memory},
+	{"serialize", bench_serialize},
+	{"replace", bench_replace},
+	{"append", bench_append},
+};
+
+#define kBenchmarkCount (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+
+int main(int argc, char ** argv) {
+	size_t i;
+	int j, found;
+
+	if (argc < 2) {
+		for (i = 0; i < kBenchmarkCount; i++) {
+			benchmarks[i].run();
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	for (j = 1; j < argc; j++) {
+		found = 0;
+
+		for (i = 0; i < kBenchmarkCount; i++) {
+			if (strcmp(argv[j], benchmarks[i].name) == 0) {
+				benchmarks[i].run();
+				found = 1;
+			}
+		}
+
+		if (!found) {
+			fprintf(stderr, "Unknown benchmark '%s'\n", argv[j]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}